@@ -1,7 +1,14 @@
 #ifndef _CACHE_HH_
 #define _CACHE_HH_
   
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <iostream>
 #include "ddd/util/configuration.hh"
+#include "ddd/util/cache_policy.hh"
+#include "ddd/util/direct_mapped.hh"
+#include "ddd/util/in_flight.hh"
 
 template
     <
@@ -13,32 +20,146 @@ template
 class Cache
 {
 private:
-  mutable size_t peak_;
+  /// peak of size(), recorded before the cache shrinks : see peak()
+  d3::stat_counter_t peak_;
   
   typedef typename  hash_map< std::pair<FuncType, ParamType>, ResType >::type 
                     hash_map; 
   hash_map cache_;
+  /// the size of cache_, that other threads may read, see size()
+  d3::stat_counter_t entries_;
+  typedef d3::direct_mapped_cache< std::pair<FuncType, ParamType>, ResType > bounded_t;
+  /// used instead of cache_ when the cache is bounded, see set_slots()
+  bounded_t bounded_;
+  d3::cache_counters counters_;
+  /// the entries being computed, so that two threads do not compute the same one
+  d3::util::in_flight< std::pair<FuncType, ParamType> > in_flight_;
+
+  bool is_bounded () const {
+    return bounded_.capacity() != 0;
+  }
     
 public:
-  Cache () : peak_ (0) {};
-  Cache (size_t s) : peak_ (0), cache_ (s) {};
+  Cache () : peak_ (0), entries_ (0) {};
+  Cache (size_t s) : peak_ (0), cache_ (s), entries_ (0) {};
     
   /** clear the cache, discarding all values. */
   void clear (bool keepstats = false) {
-    peak();
+    d3::stat_max(peak_, size());
     cache_.clear();
+    entries_ = 0;
+    bounded_.clear();
   }
 
-  size_t peak () const {
-    size_t s = size();
-    if ( peak_ < s )
-      peak_ = s;
-    return peak_;
+  /** Bound the cache to a direct mapped table of nb_slots (rounded up to a power of two),
+      where an entry overwrites the one in its slot. Zero makes the cache an unbounded
+      hash map again. Discards all values. */
+  void set_slots (size_t nb_slots) {
+    clear();
+    bounded_.resize(nb_slots);
+  }
+
+  /** The number of slots of a bounded cache, zero if it is unbounded. */
+  size_t slots () const {
+    return bounded_.capacity();
+  }
+
+  /** Garbage collection of the cache : discard the entries whose operation, operand or result
+      is not marked, the policy decides what is kept. To be called between the mark and
+      sweep phases of the operation and operand types. */
+  void sweep (const d3::cache_policy & policy) {
+    d3::stat_max(peak_, size());
+    size_t before = size();
+    sweep_entries(policy);
+    counters_.eviction(before - size());
+    counters_.gc();
   }
 
+  /** Hit and miss counters of insert(). */
+  const d3::cache_counters & counters () const {
+    return counters_;
+  }
+
+  /** Size and counters of the cache. */
+  d3::op_cache_stats_t stats () const {
+    d3::op_cache_stats_t res;
+    res.size = size();
+    res.peak = peak();
+    res.bytes = bytes();
+    res.total = counters_.totals();
+    if (is_bounded()) {
+      // entries overwritten in a slot are evicted too
+      res.total.evictions += bounded_.evictions();
+    }
+    res.before_gc = counters_.before_gc();
+    res.since_gc = counters_.since_gc();
+    return res;
+  }
+
+private:
+  void sweep_entries (const d3::cache_policy & policy) {
+    if (is_bounded()) {
+      size_t kept = 0;
+      bounded_.filter([&policy, &kept] (const std::pair<FuncType, ParamType> & key, const ResType & res) {
+	  bool live = key.first.is_marked() && key.second.is_marked() && res.is_marked();
+	  if (! policy.keep(live, kept))
+	    return false;
+	  ++kept;
+	  return true;
+	});
+      return;
+    }
+    typedef std::pair<std::pair<FuncType, ParamType>, ResType> entry_t;
+    std::vector<entry_t> kept;
+    if (policy.mode != d3::FULL_CLEAR) {
+      for (typename hash_map::const_iterator it = cache_.begin() ; it != cache_.end() ; ++it) {
+	bool live = it->first.first.is_marked() && it->first.second.is_marked() && it->second.is_marked();
+	if (policy.keep(live, kept.size())) {
+	  kept.push_back(*it);
+	}
+      }
+    }
+    cache_.clear();
+    for (typename std::vector<entry_t>::const_iterator it = kept.begin() ; it != kept.end() ; ++it) {
+      typename hash_map::accessor access;
+      cache_.insert(access, it->first);
+      access->second = it->second;
+    }
+    entries_ = kept.size();
+  }
+
+public:
+  /** Prints the hit rate, and the use of slots for a bounded cache. */
+  void print_stats (std::ostream & os, const std::string & name) const {
+    counters_.print(os, name);
+    if (is_bounded()) {
+      os << name << " : " << bounded_.size() << "/" << bounded_.capacity() << " slots used, "
+	 << bounded_.evictions() << " evictions" << std::endl;
+    }
+    if (in_flight_.waits() + in_flight_.bypasses() != 0) {
+      os << name << " : " << in_flight_.waits() << " waits for another thread, "
+	 << in_flight_.bypasses() << " computed again (" << in_flight_.timeouts() << " after waiting "
+	 << d3::parallel::max_wait() << " ms)" << std::endl;
+    }
+  }
+
+  /** The largest size() of the cache : size changes are not tracked, the size is recorded
+      before the cache shrinks. Like size() and stats(), it may be called while other threads
+      use the cache. */
+  size_t peak () const {
+    return std::max(peak_.load(std::memory_order_relaxed), size());
+  }
 
   size_t size () const {
-    return cache_.size();
+    return is_bounded() ? bounded_.size() : entries_.load(std::memory_order_relaxed);
+  }
+
+  /** An estimate of the bytes held by the entries : entries times the size of an entry, or
+      the slots of a bounded cache. */
+  size_t bytes () const {
+    if (is_bounded())
+      return bounded_.bytes();
+    return size() * sizeof(std::pair<std::pair<FuncType, ParamType>, ResType>);
   }
 
   ResType eval (const  FuncType & func, const ParamType  & param) const {
@@ -51,34 +172,79 @@ public:
     return true;
   }
   
+    /** Looks up a result without computing it on a miss. A hit is counted, a miss is not
+        since the caller is expected to insert() later. */
+    bool
+    contains(const FuncType& hom, const ParamType& node, ResType & result)
+    {
+      bool found = lookup(std::make_pair(hom,node), result);
+      if (found) {
+	counters_.hit();
+      }
+      return found;
+    }
+
+    /** Returns the result of hom on node, computing and caching it on a miss. The first member
+        is true if the result was inserted. In REENTRANT builds, a thread that misses an entry
+        another thread is computing waits for it. */
     std::pair<bool,ResType>
     insert(const FuncType& hom, const ParamType& node)
     {
-      bool found;
-      
-      { // lock on current bucket
-	typename hash_map::const_accessor access;
-	found = cache_.find ( access, std::make_pair(hom,node));
-	if (found)
-	  return std::make_pair(false, access->second);
-      } // end of lock on the current bucket
-      
+      std::pair<FuncType, ParamType> key (hom, node);
+      ResType result;
+      if (lookup(key, result)) {
+	counters_.hit();
+	return std::make_pair(false, result);
+      }
+      typename d3::util::in_flight< std::pair<FuncType, ParamType> >::ticket ticket = in_flight_.claim(key);
+      if (! ticket.owner() && lookup(key, result)) {
+	// computed by another thread while we waited
+	counters_.hit();
+	return std::make_pair(false, result);
+      }
+
       // wasn't in cache
-      ResType result = eval(hom, node);
-      if (should_insert (hom))
-      {
-      // lock on current bucket
-      typename hash_map::accessor access;
-      bool insertion = cache_.insert ( access, std::make_pair(hom,node));
+      counters_.miss();
+      result = eval(hom, node);
+      if (! should_insert (hom)) {
+	return std::make_pair(false, result);
+      }
+      bool insertion = true;
+      if (is_bounded()) {
+	bounded_.insert(key, result);
+      } else {
+	// lock on current bucket
+	typename hash_map::accessor access;
+	insertion = cache_.insert ( access, key);
+	if (insertion) {
+	  // should happen except in MT case
+	  access->second = result;
+	  d3::stat_add(entries_, 1);
+	}
+      }
       if (insertion) {
-	// should happen except in MT case
-	access->second = result;
+	counters_.insertion();
+      }
+      return std::make_pair(insertion, result);
+    }
+
+private:
+    bool
+    lookup(const std::pair<FuncType, ParamType> & key, ResType & result)
+    {
+      if (is_bounded()) {
+	return bounded_.find(key, result);
       }
-      return std::make_pair(insertion,result);
+      // lock on current bucket
+      typename hash_map::const_accessor access;
+      if (cache_.find (access, key)) {
+	result = access->second;
+	return true;
       }
-      else
-        return std::make_pair (false, result);
+      return false;
     }
+
+public:
   
 #ifdef HASH_STAT
   std::map<std::string, size_t> get_hits() const { return cache_.get_hits(); }
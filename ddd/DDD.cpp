@@ -34,15 +34,18 @@
 // modif
 #include <sstream>
 #include <limits>
+#include <algorithm>
 
 #include "ddd/util/configuration.hh"
 #include "ddd/DDD.h"
 #include "ddd/UniqueTableId.hh"
+#include "ddd/util/snapshot.hh"
+#include "ddd/Serialization.h"
 #include "ddd/DED.h"
 
 #ifdef REENTRANT
-#include "tbb/atomic.h"
-#include "tbb/mutex.h"
+#include <atomic>
+#include <mutex>
 #endif
 
 
@@ -50,12 +53,24 @@
 /*                             class _GDDD                                     */
 /******************************************************************************/
 
+class _GDDD;
+
+namespace unique {
+  /// _GDDD are allocated in the slab arena of the unique table.
+  template<>
+  struct destroy<_GDDD>
+  {
+    void operator()(const _GDDD* e) const;
+  };
+}
+
 typedef  UniqueTableId<_GDDD,GDDD::id_t> DDDutable;
 
 
 class _GDDD
 {
   friend class GDDD;
+  friend struct unique::destroy<_GDDD>;
   friend void saveDDD(std::ostream&, std::vector<DDD>);
 
   /// useful typedefs
@@ -65,26 +80,90 @@ class _GDDD
   /// attributes
   const int variable;
   const GDDD::valsz_t valuation_size;
+  /// values are stored on 1 << value_shift bytes
+  const unsigned char value_shift;
+
+  /// Arcs are stored as a struct of arrays : the values of the arcs follow the node,
+  /// then come the ids of their successors. Searching for a value thus scans a
+  /// contiguous array, and successors are only read for the arcs that match.
+  /// Values are stored on the smallest of 8, 16 or 32 bits (up to the width of val_t)
+  /// that fits all the values of the node.
+
+  /// smallest value_shift able to represent the values of [b,e)
+  template<class Iterator>
+  static
+  unsigned char
+  shift_of (Iterator b, Iterator e)
+  {
+    int min = 0, max = 0;
+    for (Iterator it = b ; it != e ; ++it) {
+      int v = it->first;
+      if (v < min) min = v;
+      if (v > max) max = v;
+    }
+    if (min >= std::numeric_limits<signed char>::min() && max <= std::numeric_limits<signed char>::max())
+      return 0;
+    if (sizeof(GDDD::val_t) == sizeof(short)
+	|| (min >= std::numeric_limits<short>::min() && max <= std::numeric_limits<short>::max()))
+      return 1;
+    return 2;
+  }
+
+  /// size of the values array, padded so that the successor ids are aligned
+  static
+  size_t
+  values_bytes (size_t length, unsigned char shift)
+  {
+    size_t siz = length << shift;
+    return (siz + sizeof(GDDD::id_t) - 1) & ~ (sizeof(GDDD::id_t) - 1);
+  }
+
+  /// get the address of the values array
+  char *
+  values_addr () const
+  {
+    return reinterpret_cast<char *> (const_cast<_GDDD *> (this)) + sizeof (_GDDD);
+  }
 
-  /// get the address of the valuation
-  edge_t *
-  alpha_addr () const
+  /// get the address of the successors array
+  GDDD::id_t *
+  sons_addr () const
   {
-    return reinterpret_cast<edge_t *> (reinterpret_cast<char *> (const_cast<_GDDD *> (this)) + sizeof (_GDDD) );
+    return reinterpret_cast<GDDD::id_t *> (values_addr() + values_bytes(valuation_size, value_shift));
   }
 
-  /// constructor
-  _GDDD (int var, const GDDD::Valuation & val)
-  : _GDDD (var, val.begin(), val.end())
-  {}
+  /// store the values of [b,e) on Stored
+  template<typename Stored, class Iterator>
+  void
+  store_values (Iterator b, Iterator e)
+  {
+    Stored * vals = reinterpret_cast<Stored *> (values_addr());
+    for (Iterator it = b ; it != e ; ++it, ++vals) {
+      *vals = it->first;
+    }
+  }
 
-  /// constructor (with iterators)
+  /// constructor (with iterators), shift should be shift_of(begin,end)
   template<class Iterator>
-  _GDDD (int var, Iterator begin, Iterator end)
+  _GDDD (int var, Iterator begin, Iterator end, unsigned char shift)
   : variable (var)
   , valuation_size (end-begin)
+  , value_shift (shift)
   {
-    std::copy (begin, end, alpha_addr());
+    switch (value_shift) {
+    case 0 :
+      store_values<signed char>(begin, end);
+      break;
+    case 1 :
+      store_values<short>(begin, end);
+      break;
+    default :
+      store_values<int>(begin, end);
+    }
+    GDDD::id_t * sons = sons_addr();
+    for (Iterator it = begin ; it != end ; ++it, ++sons) {
+      *sons = it->second.concret;
+    }
   }
 
   /// cannot copy or move
@@ -95,27 +174,17 @@ class _GDDD
   _GDDD & operator= (_GDDD &&) = delete;
 
 public:
-  /// destructor
-  ~_GDDD ()
-  {
-     for (const_iterator it = begin ();
-          it != end (); ++it)
-     {
-       it->~edge_t ();
-     }
-  }
-
   /// iterator API
   const_iterator
   begin () const
   {
-    return alpha_addr ();
+    return const_iterator (values_addr (), sons_addr (), value_shift);
   }
 
   const_iterator
   end () const
   {
-    return alpha_addr () + valuation_size;
+    return begin () + valuation_size;
   }
 
 
@@ -123,15 +192,22 @@ public:
   bool
   operator== (const _GDDD & g) const
   {
-    if (variable != g.variable)
+    return g.match(variable, begin(), end());
+  }
+
+  /// true if this node is labeled by var and has exactly the arcs [b,e)
+  template<class Iterator>
+  bool
+  match (int var, Iterator b, Iterator e) const
+  {
+    if (variable != var)
       return false;
-    if (valuation_size != g.valuation_size)
+    if (valuation_size != (size_t) (e - b))
       return false;
 
-    const_iterator it = begin (), jt = g.begin ();
-    for (; it != end (); ++it, ++jt)
+    for (const_iterator it = begin (); b != e; ++b, ++it)
       {
-	if (*it != *jt)
+	if (it.value () != b->first || it.son () != b->second)
 	  return false;
       }
     return true;
@@ -148,14 +224,12 @@ public:
     if (n1 < n2) return true;
     if (n1 > n2) return false;
 
-    for (const_iterator it = begin (), jt = g.begin ();
-         it != end (); ++it, ++jt)
+    for (const_iterator it = begin (), jt = g.begin (); it != end (); ++it, ++jt)
       {
-	if (*it == *jt)
-	  continue;
-	if (*it < *jt)
-	  return true;
-	return false;
+	if (it.value () != jt.value ())
+	  return it.value () < jt.value ();
+	if (it.son () != jt.son ())
+	  return it.son () < jt.son ();
       }
     return false;
   }
@@ -164,50 +238,68 @@ public:
   size_t
   hash () const
   {
-    size_t res = ddd::wang32_hash (variable);
-    for(const_iterator vi = begin (); vi != end (); ++vi)
+    return hash (variable, begin (), end ());
+  }
+
+  /// hash of a node labeled by var with arcs [b,e), shared with view
+  template<class Iterator>
+  static
+  size_t
+  hash (int var, Iterator b, Iterator e)
+  {
+    size_t res = ddd::wang32_hash (var);
+    for(Iterator vi = b; vi != e; ++vi)
       res += (size_t)(ddd::int32_hash(vi->first)+1011) * vi->second.hash();
     return res;
   }
 
   /// Memory Manager and reference counting
   void mark() const {
-    for(const_iterator vi=begin();vi!=end();++vi){
-      vi->second.mark();
+    const GDDD::id_t * sons = sons_addr ();
+    for (size_t i = 0 ; i < valuation_size ; ++i) {
+      GDDD(sons[i]).mark();
     }
   }
 
-  /// factory operation
-  static
-  GDDD::id_t
-  create_unique_GDDD (int var, const GDDD::Valuation & val)
+  /// A lookup key for the unique table : a (variable, arcs) pair that refers to
+  /// the caller's arcs, it is only copied into a new _GDDD on a miss.
+  struct view
   {
-    // a memory cell to store the temporary _GDDD to check unicity in unique table
-    // this is reallocated only if it is too small (see maxsize)
-    // this avoids repeated allocation/deallocation
-    static _GDDD * res = new (custom_new_t (), 0) _GDDD (var, {});
-    static size_t maxsize = 0;
-
-    // if the arguments is too large for the memory cell
-    if (val.size () > maxsize)
+    int variable;
+    const edge_t * b;
+    const edge_t * e;
+
+    view (int var, const edge_t * begin, const edge_t * end)
+    : variable (var), b (begin), e (end)
+    {}
+
+    size_t
+    hash () const
     {
-      // deallocate
-      delete res;
-      // update size
-      maxsize = val.size ();
-      // reallocate to the appropriate size
-      res = new (custom_new_t (), maxsize) _GDDD (var, val);
+      return _GDDD::hash (variable, b, e);
     }
-    else // there is already enough room
+
+    bool
+    operator== (const _GDDD & g) const
     {
-      // an object built with a placement new should be explicitly deleted
-      res->~_GDDD ();
-      // placement new
-      new (res) _GDDD (var, val);
+      return g.match (variable, b, e);
     }
 
-    GDDD::id_t ret = DDDutable::instance() (*res);
-    return ret;
+    _GDDD *
+    create () const
+    {
+      unsigned char shift = _GDDD::shift_of (b, e);
+      return new (custom_new_t (), e - b, shift) _GDDD (variable, b, e, shift);
+    }
+  };
+
+  /// factory operation
+  static
+  GDDD::id_t
+  create_unique_GDDD (int var, const GDDD::Valuation & val)
+  {
+    const edge_t * b = val.empty () ? NULL : &val[0];
+    return DDDutable::instance().find_or_insert (view (var, b, b + val.size ()));
   }
 
   static const _GDDD * resolve(GDDD::id_t id) 
@@ -219,12 +311,11 @@ public:
   _GDDD *
   clone () const
   {
-    return new (custom_new_t (), valuation_size) _GDDD (variable, begin (), end ());
+    return new (custom_new_t (), valuation_size, value_shift) _GDDD (variable, begin (), end (), value_shift);
   }
 
 private:
-  /// an empty struct tag type used to disambiguate between different variants of the operator new
-  /// for _GDDD. The overload that do not use 'custom_new_t' is the classical placement new.
+  /// an empty struct tag type used to disambiguate our operator new from the standard ones.
   struct custom_new_t {};
   /// custom operator new
   /// WARNING:
@@ -232,49 +323,56 @@ private:
   ///         - the first one (actually sizeof(_GDDD)) is ignored
   ///         - the second one is 'custom_new_t', for disambiguation
   ///         - the third one is the number of successors
-  /// syntax: new (custom_new_t(), nb_sons) _GDDD (constructor arguments)
+  ///         - the fourth one is the value_shift of the node
+  /// syntax: new (custom_new_t(), nb_sons, shift) _GDDD (constructor arguments)
   ///     it looks like a placement new, but this syntax
   ///     is only used to pass arguments to operator new
-  /// _GDDD should only be constructed by create_unique_GDDD or clone
+  /// _GDDD should only be constructed by view::create or clone
   /// please refer to these two functions for invokation examples
   static
   void *
-  operator new (size_t, custom_new_t, size_t length)
+  operator new (size_t, custom_new_t, size_t length, unsigned char shift)
   {
     // allocate enough memory to store the successors
-    // with the global (default) operator new
-    size_t siz = sizeof(_GDDD) + length*sizeof(edge_t);
-    return ::operator new (siz);
+    // in the slab arena of the unique table, nodes of equal size share slabs
+    return DDDutable::instance().arena().allocate(alloc_size(length, shift));
   }
 
-  /// classical placement new
-  /// NB: it is the responsibility of the caller that there is enough room to build the _GDDD.
-  ///   e.g.    new (ad) _GDDD(v, val)
-  ///     the memory chunk at 'ad' must be of size at least sizeof(_GDDD)+sizeof(edge_t)*val.size()
+  /// called if the constructor throws, in new (custom_new_t(), nb_sons, shift) _GDDD
   static
-  void *
-  operator new (size_t, void * addr)
+  void
+  operator delete (void * addr, custom_new_t, size_t length, unsigned char shift)
   {
-    return addr;
+    DDDutable::instance().arena().deallocate(addr, alloc_size(length, shift));
   }
 
-public:
-  /// custom operator delete
+  /// number of bytes for a node with length successors and values on 1 << shift bytes
   static
-  void
-  operator delete (void * addr)
+  size_t
+  alloc_size (size_t length, unsigned char shift)
   {
-    // free the memory allocated by operator new
-    // with the global (default) operator delete
-    ::operator delete (addr);
+    return sizeof(_GDDD) + values_bytes(length, shift) + length*sizeof(GDDD::id_t);
   }
+
+  /// nodes are not deleted directly, see unique::destroy<_GDDD>
+  static
+  void
+  operator delete (void * addr);
 };
 
+/// _GDDD are only destroyed by the sweep of the unique table, the memory goes back to its arena.
+void unique::destroy<_GDDD>::operator()(const _GDDD* e) const
+{
+  size_t siz = _GDDD::alloc_size(e->valuation_size, e->value_shift);
+  e->~_GDDD();
+  DDDutable::instance().arena().deallocate(const_cast<_GDDD *> (e), siz);
+}
+
 std::map<int,std::string> mapVarName;
 
 #ifdef REENTRANT
 
-static tbb::atomic<size_t> Max_DDD;
+static std::atomic<size_t> Max_DDD;
 
 class DDD_parallel_init
 {
@@ -309,12 +407,27 @@ void GDDD::mark()const{
   DDDutable::instance().mark(concret);
 }
 
+bool GDDD::is_marked()const{
+  return DDDutable::instance().is_marked(concret);
+}
+
 
 size_t GDDD::peak() {
   return DDDutable::instance().peak_size();
 }
 
 
+void GDDD::snapshot(d3::memory_snapshot_t & snap)
+{
+  // not peak(), that records the peak and should only be called by the thread using the table
+  DDDutable & table = DDDutable::instance();
+  snap.tables.push_back(d3::memory_snapshot_t::table_t("DDD", statistics(), table.peak(), table.arena().live_bytes()));
+  DDDutable::gc_stats_t gstats = table.gc_stats();
+  snap.ddd_minor_gc = gstats.minor_collections;
+  snap.ddd_major_gc = gstats.major_collections;
+  snap.ddd_reclaimed = gstats.total_reclaimed;
+}
+
 void GDDD::pstats(bool)
 {
   std::cout << "Peak number of DDD nodes in unicity table :" << peak() << std::endl; 
@@ -322,6 +435,18 @@ void GDDD::pstats(bool)
   std::cout << "sizeof(DDD::edge_t):" << sizeof(GDDD::edge_t) << std::endl;
   std::cout << "sizeof(DDD::val_t):" << sizeof(GDDD::val_t) << std::endl;
 
+  d3::slab_arena::stats_t astats = DDDutable::instance().arena().stats();
+  std::cout << "DDD node allocator : " << astats.slabs << " slabs, "
+	    << astats.reserved_bytes / 1024 << " kB reserved (peak " << astats.peak_reserved_bytes / 1024 << " kB), "
+	    << astats.used_bytes / 1024 << " kB used, "
+	    << astats.large_objects << " large nodes (" << astats.large_bytes / 1024 << " kB), "
+	    << astats.released_slabs << " slabs released (" << astats.last_released_slabs << " at last gc)" << std::endl;
+
+  DDDutable::gc_stats_t gstats = DDDutable::instance().gc_stats();
+  std::cout << "DDD garbage collections : " << gstats.minor_collections << " minor, " << gstats.major_collections << " major, "
+	    << gstats.total_reclaimed << " nodes reclaimed (" << gstats.last_reclaimed << " at last gc), "
+	    << gstats.old_objects << " old nodes, " << gstats.total_pause << " s in DDD table collection" << std::endl;
+
   
 #ifdef HASH_STAT
   std::cout << std::endl << "DDD Unicity table stats :" << std::endl;
@@ -393,115 +518,287 @@ GDDD::const_iterator GDDD::end() const{
 
 /* Visualisation */
 
-class MySize{
+/// Computes size(), nbStates() and the other counts with an explicit stack, so that the depth
+/// of a DDD is not limited by the call stack. Visited nodes are flagged in a bitmap indexed
+/// by node id, and counts are kept in hash tables of the nodes counted. Counts of the nodes
+/// that survive a garbage collection are kept, see sweep().
+class DDDCounts {
+  typedef GDDD::id_t id_t;
+
+  /// A count per node id, in a hash table of the nodes that were counted : open addressing with
+  /// linear probing over ids, 0 marking an empty slot as in the unicity table. It grows with the
+  /// nodes counted, not with the ids allocated.
+  template <typename V>
+  struct count_table {
+    /// the capacity is 0 or a power of two
+    std::vector<id_t> keys;
+    std::vector<V> value;
+    size_t count;
+
+    count_table () : count(0) {}
+
+    /// The slot of id, or the empty slot where it goes. The table is not empty.
+    size_t position (id_t id) const {
+      size_t mask = keys.size() - 1;
+      size_t i = (id * (size_t) 2654435761u) & mask;
+      while (keys[i] != 0 && keys[i] != id)
+	i = (i + 1) & mask;
+      return i;
+    }
 
-private:
-#ifdef REENTRANT
-	tbb::atomic<unsigned long int> res;
-#else
-  unsigned long int res;
-#endif
+    bool find (id_t id, V & res) const {
+      if (keys.empty())
+	return false;
+      size_t i = position(id);
+      if (keys[i] == 0)
+	return false;
+      res = value[i];
+      return true;
+    }
 
-  std::set<GDDD> s;
-  void mysize(const GDDD& g)
-  {
-    if( s.find(g) == s.end() )
-	{
-	  s.insert(g);
-	  res++;
-	  GDDD::const_iterator end = g.end();
-	  for(GDDD::const_iterator gi=g.begin();gi!=end;++gi)
-	    mysize(gi->second);
+    /// Rehashes the entries that satisfy keep into a table of the given capacity.
+    template <typename Pred>
+    void rehash (size_t capacity, Pred keep) {
+      std::vector<id_t> old_keys (capacity, 0);
+      std::vector<V> old_value (capacity);
+      old_keys.swap(keys);
+      old_value.swap(value);
+      count = 0;
+      for (size_t i = 0 ; i < old_keys.size() ; ++i) {
+	if (old_keys[i] != 0 && keep(old_keys[i])) {
+	  size_t j = position(old_keys[i]);
+	  keys[j] = old_keys[i];
+	  value[j] = old_value[i];
+	  ++count;
 	}
-  }
+      }
+    }
 
-public:
+    void insert (id_t id, const V & v) {
+      // at most half full
+      if (2 * (count + 1) > keys.size())
+	rehash(std::max<size_t>(16, 2 * keys.size()), [] (id_t) { return true; });
+      size_t i = position(id);
+      if (keys[i] == 0) {
+	keys[i] = id;
+	++count;
+      }
+      value[i] = v;
+    }
 
-  unsigned long int operator()(const GDDD& g){
-    res=0;
-    s.clear();
-    mysize(g);
-    return res;
+    /// Forget the counts of the nodes that die in the ongoing collection, the table shrinks to
+    /// the counts kept.
+    void sweep () {
+      size_t kept = 0;
+      for (size_t i = 0 ; i < keys.size() ; ++i)
+	if (keys[i] != 0 && DDDutable::instance().is_marked(keys[i]))
+	  ++kept;
+      size_t capacity = kept == 0 ? 0 : 16;
+      while (capacity != 0 && capacity < 2 * kept)
+	capacity *= 2;
+      rehash(capacity, [] (id_t id) { return DDDutable::instance().is_marked(id); });
+    }
+  };
+
+  /// \name The counts : the value of terminals, and how the count of a son adds to its father's.
+  //@{
+  /// number of paths to one
+  struct paths {
+    typedef long double value_t;
+    static value_t zero () { return 0; }
+    static value_t one () { return 1; }
+    static void add (value_t & sum, const value_t & son) { sum += son; }
+  };
+  /// number of nodes if no node was shared
+  struct unshared {
+    typedef long double value_t;
+    static value_t zero () { return 0; }
+    static value_t one () { return 1; }
+    static void add (value_t & sum, const value_t & son) { sum += son + 1; }
+  };
+  /// exact number of paths to one
+  struct exact_paths {
+    typedef d3::bigcount value_t;
+    static value_t zero () { return 0; }
+    static value_t one () { return 1; }
+    static void add (value_t & sum, const value_t & son) { sum += son; }
+  };
+  /// number of paths to one, as a base 2 logarithm
+  struct log2_paths {
+    typedef double value_t;
+    static value_t zero () { return - std::numeric_limits<double>::infinity(); }
+    static value_t one () { return 0; }
+    static void add (value_t & sum, const value_t & son) { sum = d3::log2_add(sum, son); }
+  };
+  //@}
+
+  template <typename Count>
+  static count_table<typename Count::value_t> & table () {
+    static count_table<typename Count::value_t> t;
+    return t;
   }
-};
+#ifdef REENTRANT
+  static std::mutex & mutex () {
+    static std::mutex m;
+    return m;
+  }
+#endif
 
-unsigned long int GDDD::size() const{
- static	MySize mysize;
+  struct frame {
+    id_t id;
+    GDDD::const_iterator it;
+    GDDD::const_iterator end;
+    frame (const GDDD & g) : id(g.concret), it(g.begin()), end(g.end()) {}
+  };
+
+  /// The count of a node that is a terminal or has a count.
+  template <typename Count>
+  static bool find (const GDDD & g, typename Count::value_t & res) {
+    if (g.concret == GDDD::one.concret) {
+      res = Count::one();
+      return true;
+    } else if (g.concret == GDDD::null.concret || g.concret == GDDD::top.concret) {
+      res = Count::zero();
+      return true;
+    }
+    return table<Count>().find(g.concret, res);
+  }
 
-  return mysize(*this);
-}
+  template <typename Count>
+  static typename Count::value_t count (const GDDD & g) {
+    typedef typename Count::value_t value_t;
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock(mutex());
+#endif
+    value_t res = Count::zero();
+    if (find<Count>(g, res))
+      return res;
+    std::vector<frame> stack;
+    stack.push_back(frame(g));
+    while (! stack.empty()) {
+      frame & f = stack.back();
+      // descend into the first son without a count
+      while (f.it != f.end && find<Count>(f.it.son(), res))
+	++f.it;
+      if (f.it != f.end) {
+	GDDD son = f.it.son();
+	stack.push_back(frame(son));
+	continue;
+      }
+      // all sons have a count
+      GDDD node (f.id);
+      value_t sum = Count::zero();
+      GDDD::const_iterator end = node.end();
+      for (GDDD::const_iterator it = node.begin() ; it != end ; ++it) {
+	find<Count>(it.son(), res);
+	Count::add(sum, res);
+      }
+      table<Count>().insert(f.id, sum);
+      stack.pop_back();
+    }
+    find<Count>(g, res);
+    return res;
+  }
 
-class MyNbStates{
-private:
-  int val; // val=0 donne nbState , val=1 donne noSharedSize
-  typedef ext_hash_map<GDDD,long double> cache_type;
-  static cache_type cache;
+public:
+  static long double nbStates (const GDDD & g) {
+    return count<paths>(g);
+  }
 
+  static long double noSharedSize (const GDDD & g) {
+    return count<unshared>(g);
+  }
 
-  long double nbStates(const GDDD& g){
+  static d3::bigcount exactNbStates (const GDDD & g) {
+    return count<exact_paths>(g);
+  }
 
-	if(g==GDDD::one)
-		return 1;
-	else if(g==GDDD::top || g==GDDD::null)
-		return 0;
-	else{
-	  cache_type::accessor access;  
-	  cache.find(access,g);
-  
-	  if( access.empty() ) {
-	    long double res=0;
-	    GDDD::const_iterator end = g.end();
-	    for(GDDD::const_iterator gi=g.begin();gi!=end;++gi)
-	      res+=nbStates(gi->second)+val;
-	    cache.insert(access,g);
-	    access->second = res;
-	    return res;
-	  } else {
-	    return access->second;
-	  }
+  static double log2NbStates (const GDDD & g) {
+    return count<log2_paths>(g);
+  }
 
+  /// The number of distinct nodes reachable from g, terminals included.
+  static unsigned long size (const GDDD & g) {
+    // the bitmap is per thread, and only the bits that were set are cleared after use
+    static thread_local std::vector<bool> visited;
+    std::vector<id_t> seen;
+    std::vector<id_t> stack;
+    if (visited.size() <= g.concret)
+      visited.resize(DDDutable::instance().id_bound());
+    visited[g.concret] = true;
+    seen.push_back(g.concret);
+    stack.push_back(g.concret);
+    while (! stack.empty()) {
+      GDDD node (stack.back());
+      stack.pop_back();
+      GDDD::const_iterator end = node.end();
+      for (GDDD::const_iterator it = node.begin() ; it != end ; ++it) {
+	id_t son = it.son().concret;
+	if (visited.size() <= son)
+	  visited.resize(DDDutable::instance().id_bound());
+	if (! visited[son]) {
+	  visited[son] = true;
+	  seen.push_back(son);
+	  stack.push_back(son);
 	}
-}
-
-public:
-  MyNbStates(int v):val(v){};
-  long double operator()(const GDDD& g){
-    long double res=nbStates(g);
-//    s.clear();
-    return res;
+      }
+    }
+    for (std::vector<id_t>::const_iterator it = seen.begin() ; it != seen.end() ; ++it)
+      visited[*it] = false;
+    return seen.size();
   }
 
-  static void clear () {
-    cache.clear();
+  /// Called between marking and sweeping the unicity table.
+  static void sweep () {
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock(mutex());
+#endif
+    table<paths>().sweep();
+    table<unshared>().sweep();
+    table<exact_paths>().sweep();
+    table<log2_paths>().sweep();
   }
 };
 
-ext_hash_map<GDDD,long double> MyNbStates::cache = ext_hash_map<GDDD,long double> ();
+unsigned long int GDDD::size() const{
+  return DDDCounts::size(*this);
+}
 
 long double
 GDDD::nbStates() const
 {
-#ifdef REENTRANT
-tbb::mutex nb_states_mutex_;
-  tbb::mutex::scoped_lock lock(nb_states_mutex_);
-#endif
-  static MyNbStates myNbStates(0);
-  return myNbStates(*this);
+  return DDDCounts::nbStates(*this);
 }
 
 long double GDDD::noSharedSize() const{
-  static MyNbStates myNbStates(1);
-  return myNbStates(*this);
+  return DDDCounts::noSharedSize(*this);
+}
+
+d3::bigcount GDDD::exactNbStates() const{
+  return DDDCounts::exactNbStates(*this);
+}
+
+double GDDD::log2NbStates() const{
+  return DDDCounts::log2NbStates(*this);
 }
 
 
 void GDDD::garbage(){
-  MyNbStates::clear();
+  mark_roots();
+  sweep();
+}
+
+void GDDD::mark_roots(){
   // mark terminals
   null.mark();
   one.mark();
   top.mark();
-  DDDutable::instance().garbage();
+  DDDutable::instance().mark_roots();
+}
+
+void GDDD::sweep(){
+  DDDCounts::sweep();
+  DDDutable::instance().sweep();
 }
 
 
@@ -670,47 +967,30 @@ size_t DDD::set_hash() const {
 
 //My funs
 
-unsigned long int GDDD::nodeIndex(const std::vector<GDDD::id_t> & list) const{
-    assert(this);
-    assert(concret!=0);
-    unsigned long int i=0;
-    for (i=0; i<list.size();++i)
-      if (concret==list[i]) return i;
-    return std::numeric_limits<unsigned long>::max();
-}
-
-
-void GDDD::saveNode(std::ostream& os, std::vector<GDDD::id_t>& list)const {
-    assert(this);
-    //assert(concret);
-    unsigned long int index = nodeIndex(list);
-    if (index == std::numeric_limits<unsigned long>::max() ) {
+namespace {
 
-        if (*this==one) list.push_back(concret);
-        else 
-        if (*this==null) list.push_back(concret);
-        else 
-        if (*this==top) list.push_back(concret);
-        else {
-	  assert(concret);
-	  GDDD::const_iterator end = this->end();
-	  for (GDDD::const_iterator vi=begin();vi!=end;++vi) 
-	    vi->second.saveNode(os, list);
-	  list.push_back(concret);
-        }
-    }
-}
+/// Collects the nodes in numbering order, for the text format which needs their count first.
+struct collect_nodes
+{
+  std::vector<GDDD> nodes;
+  void prepare (const GDDD &) {}
+  void operator() (const GDDD & node, uint64_t) {
+    nodes.push_back(node);
+  }
+};
 
+} // anonymous namespace
 
 
 void saveDDD(std::ostream& os, std::vector<DDD> list) {
-  std::vector<GDDD::id_t> SavedDDD;
+  d3::node_numbering<GDDD> numbering;
+  collect_nodes SavedDDD;
   for (unsigned int i= 0; i<list.size(); ++i) {
-    list[i].saveNode(os, SavedDDD);
+    numbering.number(list[i], SavedDDD);
   }
-  os<<SavedDDD.size()<<std::endl;
-  for (unsigned long int i=0; i<SavedDDD.size();++i) {
-    GDDD d = SavedDDD[i];
+  os<<SavedDDD.nodes.size()<<std::endl;
+  for (unsigned long int i=0; i<SavedDDD.nodes.size();++i) {
+    const GDDD & d = SavedDDD.nodes[i];
     if (d==GDDD::one) 
       os<<i<<" one"<<std::endl;
     else if (d==GDDD::null) 
@@ -720,13 +1000,13 @@ void saveDDD(std::ostream& os, std::vector<DDD> list) {
     else {
       os<<i<<"[ "<< d.variable();
       for (GDDD::const_iterator vi=d.begin();vi!=d.end();++vi)
-	os<<" "<<vi->first<<" "<<vi->second.nodeIndex(SavedDDD);
+	os<<" "<<vi.value()<<" "<<numbering.index(vi.son());
       os<<" ]"<<std::endl;
     }
   }
     
   os<<std::endl<<"Saved:";
-  for (unsigned int i= 0; i<list.size(); ++i) os<<" "<<list[i].nodeIndex(SavedDDD);
+  for (unsigned int i= 0; i<list.size(); ++i) os<<" "<<numbering.index(list[i]);
   os<<std::endl;
     
 }
@@ -771,8 +1051,14 @@ void loadDDD(std::istream& is, std::vector<DDD>& list) {
 #include "MemoryManager.h"
 
 // for lack of a better place to put it...
-size_t MemoryManager::last_mem = 1300000;
+size_t MemoryManager::peak_mem_ = 0;
 // for lack of a better place to put it...
 MemoryManager::hooks_t MemoryManager::hooks_ = MemoryManager::hooks_t();
 
 
+size_t MemoryManager::nb_gc_ = 0;
+double MemoryManager::last_pause_ = 0;
+double MemoryManager::max_pause_ = 0;
+double MemoryManager::total_pause_ = 0;
+size_t MemoryManager::objects_before_gc_ = 0;
+size_t MemoryManager::objects_after_gc_ = 0;
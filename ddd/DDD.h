@@ -27,9 +27,15 @@
 #include <iosfwd>
 #include <string>
 #include <vector>
+#include <iterator>
+#include <cstddef>
 
 #include "ddd/DataSet.h"
+#include "ddd/util/bignum.hh"
 #include "ddd/hashfunc.hh"
+#include "ddd/util/value_search.hh"
+
+namespace d3 { struct memory_snapshot_t; }
 
 /// pre-declaration of concrete (private) class implemented in .cpp file
 class _GDDD;
@@ -55,6 +61,10 @@ private:
   friend std::ostream& operator<<(std::ostream &os,const GDDD &g);
   /// Open access to concret for reference counting in DDD.
   friend class DDD;
+  /// Nodes store the ids of their successors.
+  friend class _GDDD;
+  /// Side tables of size() and nbStates() are indexed by id.
+  friend class DDDCounts;
 
   /// The real implementation class. All true operations are delagated on this pointer.
   /// Construction/destruction take care of ensuring concret is only instantiated once in memory.
@@ -67,25 +77,29 @@ private:
   GDDD(_GDDD *_g);
   /// Internal function used in recursion for textual printing of GDDD.
   void print(std::ostream& os,std::string s) const;
-  /// A function for DDD serialization (beta).
-  void saveNode(std::ostream&, std::vector<id_t>& )const;
-  /// Another function used in serialization.
-  unsigned long int nodeIndex(const std::vector<id_t> &)const;
 
 public:
   /// \name Public Accessors 
   //@{
   /// The type used as values of variables in a DDD.
+  /// Configure with --enable-wide-values (DDD_WIDE_VALUES) for 32 bit values.
+  /// Whatever this width, each node stores its values on 8, 16 or 32 bits depending on their range.
+#ifdef DDD_WIDE_VALUES
+  typedef int val_t;
+  /// A type wide enough to count how many outgoing edges a DDD node has, should be congruent to val_t.
+  typedef unsigned int valsz_t;
+#else
   typedef short val_t;
   /// A type wide enough to count how many outgoing edges a DDD node has, should be congruent to val_t.
   typedef unsigned short valsz_t;
+#endif
   /// An edge is a pair <value,child node>
   typedef std::pair<val_t,GDDD> edge_t;
   /// To hide how arcs are actually stored. Use GDDD::Valuation to refer to arcs type
   typedef std::vector<edge_t > Valuation;
   /// To hide how arcs are stored. Also for more compact expressions : 
   /// use GDDD::const_iterator to iterate over the arcs of a DDD
-  typedef const edge_t * const_iterator;
+  class const_iterator;
   /// Returns a node's variable.
   int variable() const;
 
@@ -174,6 +188,11 @@ public:
   size_t nbsons () const;
   /// Returns the number of states or paths represented by a given node.
   long double nbStates() const;
+  /// Returns the exact number of states, long double loses precision above 2^64 states.
+  d3::bigcount exactNbStates() const;
+  /// Returns the base 2 logarithm of the number of states, -infinity for GDDD::null.
+  /// Cheaper than exactNbStates(), and does not overflow like nbStates().
+  double log2NbStates() const;
   /// Returns the number of nodes that would be used to represent a DDD if no unicity table was used.
   long double noSharedSize() const;
 #ifdef EVDDD
@@ -204,6 +223,9 @@ public:
   /// For garbage collection internals. Marks a GDDD as in use in garbage collection phase. 
   /// 
   void mark() const;
+  /// For garbage collection internals. Whether a GDDD survives the ongoing collection,
+  /// only meaningful between mark_roots() and sweep().
+  bool is_marked() const;
   /// For storage in a hash table
   size_t hash () const { 
     return ddd::int32_hash(concret); 
@@ -211,22 +233,121 @@ public:
   /// For garbage collection, do not call this directly, use MemoryManager::garbage() instead.
   /// \todo describe garbage collection algorithm(s) + mark usage homogeneously in one place.
   static void garbage(); 
+  /// The two phases of garbage(), caches may be swept in between using is_marked().
+  static void mark_roots();
+  static void sweep();
   /// Prints some statistics to std::cout. Mostly used in debug and development phase.
   /// See also MemoryManager::pstats().
   /// \todo allow output in other place than cout. Clean up output.
   static void pstats(bool reinit=true);
+  /// Adds the unicity table and its collector statistics to a snapshot of the memory, see MemoryManager::snapshot().
+  static void snapshot(d3::memory_snapshot_t & snap);
   /// Returns the peak size of the DDD unicity table. This value is maintained up to date upon GarbageCollection.
   static size_t peak();
   //@}
   /// \name Serialization functions.
   //@{
-  /// Function for serialization. Save a set of DDD to a stream.
+  /// Function for serialization. Save a set of DDD to a stream, in a text format.
   friend void saveDDD(std::ostream&, std::vector<DDD>);
-  /// Function for deserialization. Load a set of DDD from a stream.
+  /// Function for deserialization. Load a set of DDD from a stream, list should have the size of the saved set.
   friend void loadDDD(std::istream&, std::vector<DDD>&);
   //@}
 };
 
+/// \name Binary serialization.
+//@{
+/// Save a set of DDD to a binary stream : a versioned header, then each node once, sons first,
+/// with varint encoded values and successors. Time is linear in the number of nodes, and
+/// nodes are written as they are reached, the only state kept is the index of written nodes.
+/// See Serialization.h for the format, and to save DDD together with SDD.
+void saveDDDBinary(std::ostream&, const std::vector<DDD>&);
+/// Load a set of DDD saved by saveDDDBinary, list is resized to the number of saved DDD.
+/// Throws std::runtime_error if the stream is not in this format, or is corrupted.
+void loadDDDBinary(std::istream&, std::vector<DDD>&);
+//@}
+
+
+/// Iterator over the arcs of a node.
+/// Nodes store the values of their arcs and their successors in two separate arrays,
+/// this iterator walks both in step and rebuilds an edge_t on dereference.
+/// As there is no edge_t in memory to refer to, * returns the edge_t by value and -> a proxy
+/// that holds one. The iterator is thus only an input iterator for the standard library,
+/// although it supports the operations of a random access iterator.
+/// value() and son() only read one of the arrays, prefer them in tight loops.
+/// Values are stored on 1 << shift bytes, the smallest width that fits all the values of the node.
+class GDDD::const_iterator
+{
+  const char * val_;
+  const id_t * son_;
+  unsigned char shift_;
+public:
+  /// What -> returns, it holds the edge_t it points to.
+  class arrow {
+    edge_t edge_;
+  public:
+    arrow (const edge_t & e) : edge_(e) {}
+    const edge_t * operator-> () const { return & edge_; }
+  };
+
+  typedef std::input_iterator_tag iterator_category;
+  typedef edge_t value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef arrow pointer;
+  typedef edge_t reference;
+
+  const_iterator () : val_(NULL), son_(NULL), shift_(0) {}
+  const_iterator (const char * val, const id_t * son, unsigned char shift) : val_(val), son_(son), shift_(shift) {}
+
+  /// value labeling the arc
+  val_t value () const {
+    switch (shift_) {
+    case 0 :
+      return * reinterpret_cast<const signed char *> (val_);
+    case 1 :
+      return * reinterpret_cast<const short *> (val_);
+    default :
+      return * reinterpret_cast<const int *> (val_);
+    }
+  }
+  /// successor node of the arc
+  GDDD son () const { return GDDD(*son_); }
+
+  reference operator* () const { return edge_t(value(), son()); }
+  pointer operator-> () const { return arrow(operator*()); }
+  value_type operator[] (difference_type n) const { return *(*this + n); }
+
+  const_iterator & operator++ () { val_ += 1 << shift_; ++son_; return *this; }
+  const_iterator operator++ (int) { const_iterator tmp = *this; ++*this; return tmp; }
+  const_iterator & operator-- () { val_ -= 1 << shift_; --son_; return *this; }
+  const_iterator operator-- (int) { const_iterator tmp = *this; --*this; return tmp; }
+  const_iterator & operator+= (difference_type n) { val_ += n * (1 << shift_); son_ += n; return *this; }
+  const_iterator & operator-= (difference_type n) { val_ -= n * (1 << shift_); son_ -= n; return *this; }
+  const_iterator operator+ (difference_type n) const { return const_iterator(val_ + n * (1 << shift_), son_ + n, shift_); }
+  const_iterator operator- (difference_type n) const { return const_iterator(val_ - n * (1 << shift_), son_ - n, shift_); }
+  difference_type operator- (const const_iterator & other) const { return son_ - other.son_; }
+
+  bool operator== (const const_iterator & other) const { return son_ == other.son_; }
+  bool operator!= (const const_iterator & other) const { return son_ != other.son_; }
+  bool operator< (const const_iterator & other) const { return son_ < other.son_; }
+  bool operator> (const const_iterator & other) const { return son_ > other.son_; }
+  bool operator<= (const const_iterator & other) const { return son_ <= other.son_; }
+  bool operator>= (const const_iterator & other) const { return son_ >= other.son_; }
+
+  /// Returns the first arc in [*this, end) with a value not less than v, or end.
+  /// Arcs are sorted by increasing values, so this skips over the arcs with a smaller value
+  /// without touching their successors.
+  const_iterator seek (val_t v, const const_iterator & end) const {
+    size_t n = end.son_ - son_;
+    switch (shift_) {
+    case 0 :
+      return *this + d3::lower_bound_index_narrow(reinterpret_cast<const signed char *> (val_), n, v);
+    case 1 :
+      return *this + d3::lower_bound_index_narrow(reinterpret_cast<const short *> (val_), n, v);
+    default :
+      return *this + d3::lower_bound_index_narrow(reinterpret_cast<const int *> (val_), n, v);
+    }
+  }
+};
 
 /// Textual output of DDD into a stream in (relatively) human readable format.
 std::ostream& operator<<(std::ostream &,const GDDD &);
@@ -319,6 +440,10 @@ public:
   bool set_less_than (const DataSet & b) const ;
   /// Compares to DataSet for equality.
    long double set_size() const;
+  /// Exact size of the DDD, see GDDD::exactNbStates().
+   d3::bigcount set_exact_size() const { return exactNbStates(); }
+  /// Size of the DDD as a base 2 logarithm, see GDDD::log2NbStates().
+   double set_log2_size() const { return log2NbStates(); }
   /// Returns a hash key for the DDD.
    size_t set_hash() const;
   /// Textual (human readable) output of a DDD.
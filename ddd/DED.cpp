@@ -25,49 +25,34 @@
 #include <set>
 #include <iostream>
 #include <map>
+#include <algorithm>
 #include <cassert>
 #include <typeinfo>
 // ajout
 
 #include "ddd/util/configuration.hh"
 #include "ddd/util/set.hh"
+#include "ddd/util/small_vector.hh"
 #include "ddd/DDD.h"
 #include "ddd/DED.h"
 #include "ddd/Hom.h"
-#include "ddd/UniqueTable.h"
+#include "ddd/util/sharded_table.hh"
+#include "ddd/util/cache_policy.hh"
+#include "ddd/util/op_stats.hh"
 
 #ifdef REENTRANT
-#include "tbb/atomic.h"
+#include <atomic>
 #endif
 /******************************************************************************/
 
-typedef UniqueTable<_DED> DEDtable;
+typedef d3::util::sharded_table<_DED> DEDtable;
 
 static DEDtable uniqueDED;
 
-#ifdef REENTRANT
-
-static tbb::atomic<int> Hits;
-static tbb::atomic<int> Misses;
-class DED_parallel_init
-{
-public:
-	 
-	DED_parallel_init()
-	{
-		Hits = 0;
-		Misses = 0;
-	}
-		
-};
-static DED_parallel_init DED_init;
-
-#else
-static int Hits=0;
-static int Misses=0;
-
-#endif
-
+/// per kind counters of the operation cache
+struct DED_counters_tag {};
+static d3::op_counters<DED_counters_tag, DED::NB_OP_KINDS> counters;
+static const char * const op_kind_names [DED::NB_OP_KINDS] = { "Add", "Mult", "Minus", "Concat", "Hom" };
 
 /******************************************************************************/
 class _DED{
@@ -81,13 +66,25 @@ public:
   virtual bool operator==(const _DED &) const=0;
   // NB :clone in DED should also assign result.
   virtual _DED * clone () const=0;
+  /* Memory Manager : true if the operands and the result survive the ongoing garbage collection */
+  virtual bool is_live() const =0;
+  /* Stats : the kind of operation, to count cache hits per kind */
+  virtual DED::op_kind kind() const =0;
 
   /* Transform */
   virtual GDDD eval() const=0;
 };
 
 static GDDD compute (const _DED & op) {
-  return uniqueDED(op)->result;  
+  bool found;
+  const _DED * res = uniqueDED(op, found);
+  if (found) {
+    counters.hit(op.kind());
+  } else {
+    counters.miss(op.kind());
+    counters.insertion(op.kind());
+  }
+  return res->result;  
 }
 
 
@@ -97,13 +94,21 @@ static GDDD compute (const _DED & op) {
 class _DED_Add:public _DED{
 private:
   std::vector<GDDD> parameters;
-  _DED_Add(const std::set<GDDD> &d):parameters(d.begin(),d.end()){};
+  _DED_Add(std::vector<GDDD> &d){ parameters.swap(d); };
 public:
-  static  GDDD create(const std::set<GDDD> &d);
+  /// operands are sorted and distinct
+  static  GDDD create(const GDDD * first, const GDDD * last);
   /* Compare */
   size_t hash() const;
   bool operator==(const _DED &e)const;
   _DED * clone () const { auto res =  new _DED_Add(*this); res->result = res->eval() ; return res; }
+  DED::op_kind kind() const { return DED::OP_ADD; }
+  bool is_live() const {
+    for (std::vector<GDDD>::const_iterator it = parameters.begin() ; it != parameters.end() ; ++it)
+      if (! it->is_marked())
+	return false;
+    return result.is_marked();
+  }
   /* Transform */
   GDDD eval() const;
 
@@ -159,12 +164,32 @@ GHom pushEVDDD(int v){return new _pushEVDDD(v);};
 
 
 /* Transform */
+namespace {
+  /// A position in the arcs of one operand of a union.
+  struct arc_cursor {
+    GDDD::const_iterator it;
+    GDDD::const_iterator end;
+    arc_cursor (const GDDD & d) : it(d.begin()), end(d.end()) {}
+    /// for a min-heap on the value of the current arc
+    bool operator< (const arc_cursor & other) const { return it.value() > other.it.value(); }
+  };
+
+  typedef d3::util::small_vector<GDDD,8> sons_t;
+
+  /// the union of the sons gathered for a value, which are not sorted yet
+  GDDD add_sons (sons_t & sons) {
+    if (sons.size() == 1)
+      return sons[0];
+    sons.sort_unique();
+    return DED::add(sons.begin(), sons.end());
+  }
+}
+
 GDDD _DED_Add::eval() const{
   assert(parameters.size()>1);
   int variable=parameters.begin()->variable();
 
   GDDD::Valuation value;
-  std::map<int,std::set<GDDD> > map_set;
 
 #ifdef EVDDD
   if (variable == DISTANCE) {
@@ -203,46 +228,84 @@ GDDD _DED_Add::eval() const{
 //       }
 //     }
     return GDDD (variable,min,succ);
-  } else {
-    /// normal node canonization
-#endif  
-  for(std::vector<GDDD>::const_iterator si=parameters.begin();si!=parameters.end();++si){
-    GDDD::const_iterator end = si->end();
-    for(GDDD::const_iterator vi=si->begin();vi!=end;++vi){
-      map_set[vi->first].insert(vi->second);
+  }
+#endif
+
+  if (parameters.size() == 2) {
+    // the common case, a merge of two sorted arc arrays
+    GDDD::const_iterator it1 = parameters[0].begin(), end1 = parameters[0].end();
+    GDDD::const_iterator it2 = parameters[1].begin(), end2 = parameters[1].end();
+    value.reserve((end1 - it1) + (end2 - it2));
+    while (it1 != end1 && it2 != end2) {
+      GDDD::val_t v1 = it1.value(), v2 = it2.value();
+      if (v1 < v2) {
+	value.push_back(GDDD::edge_t(v1, it1.son()));
+	++it1;
+      } else if (v2 < v1) {
+	value.push_back(GDDD::edge_t(v2, it2.son()));
+	++it2;
+      } else {
+	GDDD s1 = it1.son(), s2 = it2.son();
+	value.push_back(GDDD::edge_t(v1, (s1 == s2) ? s1 : s1 + s2));
+	++it1;
+	++it2;
+      }
     }
+    for ( ; it1 != end1 ; ++it1)
+      value.push_back(GDDD::edge_t(it1.value(), it1.son()));
+    for ( ; it2 != end2 ; ++it2)
+      value.push_back(GDDD::edge_t(it2.value(), it2.son()));
+    return GDDD(variable,value);
   }
-#ifdef EVDDD
+
+  // k-way merge of the sorted arc arrays, with a heap of cursors ordered by value
+  d3::util::small_vector<arc_cursor,8> heap;
+  for(std::vector<GDDD>::const_iterator si=parameters.begin();si!=parameters.end();++si){
+    heap.push_back(arc_cursor(*si));
   }
-#endif
-  for(std::map<int,std::set<GDDD> >::const_iterator map_set_i=map_set.begin();map_set_i!=map_set.end();++map_set_i){
-    assert(map_set_i->second.size()!=0);
-    std::pair<int,GDDD> x;
-    x.first=map_set_i->first;
-    if(map_set_i->second.size()==1)
-      x.second=*(map_set_i->second.begin());
-    else
-      x.second=DED::add(map_set_i->second);
-    value.push_back(x);
+  std::make_heap(heap.begin(), heap.end());
+  sons_t sons;
+  while (! heap.empty()) {
+    GDDD::val_t v = heap[0].it.value();
+    sons.clear();
+    // pop every cursor on value v, and push back those that have more arcs
+    while (! heap.empty() && heap[0].it.value() == v) {
+      sons.push_back(heap[0].it.son());
+      std::pop_heap(heap.begin(), heap.end());
+      arc_cursor & c = heap.back();
+      if (++c.it == c.end)
+	heap.pop_back();
+      else
+	std::push_heap(heap.begin(), heap.end());
+    }
+    value.push_back(GDDD::edge_t(v, add_sons(sons)));
   }
   return GDDD(variable,value);
 };
 
 /* constructor*/
-GDDD _DED_Add::create(const std::set<GDDD> &s){
-  assert(s.size()!=0); // s is not empty
-  std::set<GDDD> parameters=s;
-  parameters.erase(GDDD::null);
+GDDD _DED_Add::create(const GDDD * first, const GDDD * last){
+  assert(first!=last); // s is not empty
+  std::vector<GDDD> parameters;
+  parameters.reserve(last-first);
+  bool terminal=false;
+  for(const GDDD * si=first;si!=last;++si){
+    if(*si==GDDD::null)
+      continue;
+    if(*si==GDDD::top||*si==GDDD::one)
+      terminal=true;
+    parameters.push_back(*si);
+  }
   if(parameters.size()==1)
-    return *parameters.begin();  
+    return parameters.front();
   else { 
     if(parameters.size()==0)
       return GDDD::null;
-    else if(parameters.find(GDDD::top)!=parameters.end()||parameters.find(GDDD::one)!=parameters.end()){ // 
+    else if(terminal){ // 
       return GDDD::top;
     }
     else{ 
-      std::set<GDDD>::const_iterator si=parameters.begin();
+      std::vector<GDDD>::const_iterator si=parameters.begin();
       int variable = si->variable();
       for(;(si!=parameters.end())?(variable == si->variable()):false;++si){}
       if(si!=parameters.end())// s contains at least 2 GDDDs with different variables
@@ -266,6 +329,8 @@ public:
   size_t hash() const;
   bool operator==(const _DED &e)const;
   _DED * clone () const { auto res= new _DED_Mult(*this);res->result = res->eval() ; return res; }
+  DED::op_kind kind() const { return DED::OP_MULT; }
+  bool is_live() const { return parameter1.is_marked() && parameter2.is_marked() && result.is_marked(); }
   /* Transform */
   GDDD eval() const;
 
@@ -331,18 +396,18 @@ GDDD _DED_Mult::eval() const{
   GDDD::const_iterator v1end=parameter1.end();
   GDDD::const_iterator v2end=parameter2.end();
 
+  // leapfrog over the sorted values, successors are only read on matches
   while(v1!=v1end&&v2!=v2end){
-    if(v1->first<v2->first)
-      ++v1;
-    else if(v1->first>v2->first)
-      ++v2;
+    GDDD::val_t val1 = v1.value();
+    GDDD::val_t val2 = v2.value();
+    if(val1<val2)
+      v1 = v1.seek(val2, v1end);
+    else if(val1>val2)
+      v2 = v2.seek(val1, v2end);
     else{
-      GDDD g=(v1->second)*(v2->second);
+      GDDD g=(v1.son())*(v2.son());
       if(g!=GDDD::null){
-        std::pair<int,GDDD> x;
-	x.first=v1->first;
-	x.second=g;
-	value.push_back(x);
+	value.push_back(GDDD::edge_t(val1,g));
       }
       ++v1;
       ++v2;
@@ -382,6 +447,8 @@ public:
   size_t hash() const;
   bool operator==(const _DED &e)const;
   _DED * clone () const { auto res = new _DED_Minus(*this); res->result = res->eval() ; return res;}
+  DED::op_kind kind() const { return DED::OP_MINUS; }
+  bool is_live() const { return parameter1.is_marked() && parameter2.is_marked() && result.is_marked(); }
   /* Transform */
   GDDD eval() const;
 
@@ -419,26 +486,28 @@ GDDD _DED_Minus::eval() const{
   GDDD::const_iterator v2end=parameter2.end();
 
   while(v1!=v1end&&v2!=v2end){
-    if(v1->first<v2->first){
-      std::pair<int,GDDD> x(v1->first,v1->second);
-      value.push_back(x);
-      ++v1;
+    GDDD::val_t val1 = v1.value();
+    GDDD::val_t val2 = v2.value();
+    if(val1<val2){
+      // keep every arc of parameter1 up to the next value of parameter2
+      GDDD::const_iterator next = v1.seek(val2, v1end);
+      for ( ; v1 != next ; ++v1)
+	value.push_back(*v1);
     }
-    else if(v1->first>v2->first)
-      ++v2;
+    else if(val1>val2)
+      v2 = v2.seek(val1, v2end);
     else{
-      GDDD g=(v1->second)-(v2->second);
+      GDDD g=(v1.son())-(v2.son());
       if(g!=GDDD::null){
-        std::pair<int,GDDD> x(v1->first,g);
-	value.push_back(x);
+	value.push_back(GDDD::edge_t(val1,g));
       }
       ++v1;
       ++v2;
     }
   }
 
-  for(;v1!=parameter1.end();++v1){
-    value.push_back(std::make_pair(v1->first,v1->second));
+  for(;v1!=v1end;++v1){
+    value.push_back(*v1);
   }
 
   return GDDD(variable,value);
@@ -474,6 +543,8 @@ public:
   size_t hash() const;
   bool operator==(const _DED &e)const;
   _DED * clone () const { auto res = new _DED_Concat(*this); res->result = res->eval() ; return res; }
+  DED::op_kind kind() const { return DED::OP_CONCAT; }
+  bool is_live() const { return parameter1.is_marked() && parameter2.is_marked() && result.is_marked(); }
   /* Transform */
   GDDD eval() const;
 
@@ -533,6 +604,8 @@ public:
   size_t hash() const;
   bool operator==(const _DED &e)const;
   _DED * clone () const { auto res = new _DED_Hom(*this); res->result = res->eval() ; return res;}
+  DED::op_kind kind() const { return DED::OP_HOM; }
+  bool is_live() const { return hom.is_marked() && parameter.is_marked() && result.is_marked(); }
 
   /* Transform */
   GDDD eval() const;
@@ -571,59 +644,71 @@ GDDD _DED_Hom::create(const GHom &g,const GDDD &d){
 
   /* Memory Manager */
 unsigned int DED::statistics() {
-  return uniqueDED.table.size();
+  return uniqueDED.size();
 }
 
 void DED::pstats(bool reinit)
 {
   std::cout << "*\nCache Stats : size=" << uniqueDED.size() << std::endl;  
-  std::cout << "\nCache hit ratio : " << double (Hits*100) / double(Misses+1+Hits) << "%" << std::endl;
+  std::cout << std::endl;
+  stats().print(std::cout);
+  if (uniqueDED.waits() + uniqueDED.bypasses() != 0) {
+    std::cout << "In flight : " << uniqueDED.waits() << " waits for another thread, "
+	      << uniqueDED.bypasses() << " computed again (" << uniqueDED.timeouts() << " after waiting "
+	      << d3::parallel::max_wait() << " ms)" << std::endl;
+  }
   
 #ifdef HASH_STAT
   std::cout << std::endl << "DED Unicity table stats :" << std::endl;
   print_hash_stats(cache.get_hits(), cache.get_misses(), cache.get_bounces());
 #endif // HASH_STAT
-  // long hitr=(Hits*100) / (Misses+1+Hits) ;
   if (reinit){
-    Hits = 0;
-    Misses = 0;  
+    counters.reset();
   }  
 
 }
 
-#ifdef REENTRANT
-static tbb::atomic<size_t> DEDpeak;
-class DEDpeak_parallel_init
-{
-public:
-	 
-	DEDpeak_parallel_init()
-	{
-		DEDpeak = 0;
-	}
-		
-};
-static DEDpeak_parallel_init DEDpeak_init;
-
-#else
-static size_t DEDpeak = 0;
-#endif
+/// peak size of the table, recorded before it shrinks
+static d3::stat_counter_t DEDpeak (0);
 
 namespace DED {
 
 size_t peak() {
-  if (uniqueDED.table.size() > DEDpeak)
-    DEDpeak = uniqueDED.table.size();
-  return DEDpeak;
+  return std::max(DEDpeak.load(std::memory_order_relaxed), uniqueDED.size());
+}
+d3::op_cache_stats_t stats() {
+  d3::op_cache_stats_t res;
+  res.size = uniqueDED.size();
+  res.peak = peak();
+  // a lower bound, the operands held by each kind of operation are not counted
+  res.bytes = res.size * sizeof(_DED);
+  counters.fill(res, op_kind_names);
+  return res;
 }
+
 // Todo
 void garbage(){
-  if (uniqueDED.size() > DEDpeak)
-    DEDpeak = uniqueDED.size();
-  for (auto ded : uniqueDED.table ){
-    delete ded;
+  d3::stat_max(DEDpeak, uniqueDED.size());
+  const d3::cache_policy & policy = d3::cache_policy::current();
+  if (policy.mode == d3::FULL_CLEAR) {
+    uniqueDED.sweep([] (const _DED * ded) {
+	counters.eviction(ded->kind());
+	return true;
+      });
+    counters.gc();
+    return;
   }
-  uniqueDED.table.clear();
+  // keep the entries that are still live, operands and result are marked by now
+  size_t kept = 0;
+  uniqueDED.sweep([&policy, &kept] (const _DED * ded) {
+      if (policy.keep(ded->is_live(), kept)) {
+	++kept;
+	return false;
+      }
+      counters.eviction(ded->kind());
+      return true;
+    });
+  counters.gc();
 }; 
 
 // eval and std::set to NULL the DED
@@ -639,17 +724,33 @@ GDDD add(const std::set<GDDD> &s){
   } else if (s.size() == 1) {
     return *s.begin();
   } else {
-    return _DED_Add::create(s);
+    std::vector<GDDD> v(s.begin(), s.end());
+    return _DED_Add::create(&v[0], &v[0] + v.size());
+  }
+};
+
+GDDD add(const GDDD * first, const GDDD * last){
+  if (first == last) {
+    return GDDD::null;
+  } else if (first + 1 == last) {
+    return *first;
+  } else {
+    return _DED_Add::create(first, last);
   }
 };
 
 } // namespace DED
   
 GDDD operator+(const GDDD &g1,const GDDD &g2){
-  d3::set<GDDD>::type s;
-  s.insert(g1);
-  s.insert(g2);
-  return DED::add(s);
+  // binary fast path, without building a set
+  if (g1 == g2 || g2 == GDDD::null)
+    return g1;
+  if (g1 == GDDD::null)
+    return g2;
+  GDDD ops [2] = { g1, g2 };
+  if (g2 < g1)
+    std::swap(ops[0], ops[1]);
+  return _DED_Add::create(ops, ops + 2);
 }
 
 GDDD operator*(const GDDD &g1,const GDDD &g2){
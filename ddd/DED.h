@@ -28,6 +28,7 @@
 #include "ddd/DDD.h"
 #include "ddd/Hom.h"
 #include "ddd/util/hash_support.hh"
+#include "ddd/util/op_stats.hh"
 
 class _DED;
 class GDDD;
@@ -36,9 +37,17 @@ class GHom;
 /******************************************************************************/
 namespace DED {
   GDDD add(const d3::set<GDDD>::type &);
+  /// Union of the operands in [first,last), which must be sorted and hold no duplicates,
+  /// e.g. a d3::util::small_vector after sort_unique. Avoids building a std::set.
+  GDDD add(const GDDD * first, const GDDD * last);
+
+  /// The kinds of operations stored in the cache.
+  enum op_kind { OP_ADD, OP_MULT, OP_MINUS, OP_CONCAT, OP_HOM, NB_OP_KINDS };
 
   /* Memory Manager */
   unsigned int statistics();
+  /// Size of the cache, and hits, misses, insertions and evictions per kind of operation.
+  d3::op_cache_stats_t stats();
   void pstats(bool reinit=true);
   size_t peak();
   void garbage(); 
@@ -24,6 +24,9 @@
 #define __DATASET_H__
 
 #include <iosfwd>
+#include <cmath>
+
+#include "ddd/util/bignum.hh"
 
 /// This class is an abstraction of a set of data.
 /// Set Decision Diagrams SDD arcs are labeled by a DataSet *, canonization of SDD requires
@@ -63,6 +66,11 @@ class DataSet
   virtual bool set_less_than (const DataSet & b) const =0;
   /// \return the size (number of elements) in a set
   virtual long double set_size() const = 0;
+  /// \return the exact size of a set. The default is computed from set_size(), 
+  /// sets that may hold more than 2^64 elements should override it.
+  virtual d3::bigcount set_exact_size() const { return d3::bigcount::from(set_size()); }
+  /// \return the base 2 logarithm of the size of a set, -infinity for the empty set.
+  virtual double set_log2_size() const { return std::log2((double) set_size()); }
   /// returns a hash function, used in the SDD hash function computation
   virtual size_t set_hash() const =0;
   /// returns a formatted string description of the set
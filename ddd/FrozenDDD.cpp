@@ -0,0 +1,417 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "ddd/FrozenDDD.h"
+#include "ddd/Serialization.h"
+
+namespace {
+
+const char frozen_magic [4] = { 'D', 'D', 'D', 'F' };
+const uint32_t frozen_version = 1;
+const uint32_t frozen_byte_order = 0x01020304;
+
+/// Collects the nodes in numbering order.
+struct collect_nodes
+{
+  std::vector<GDDD> nodes;
+  void prepare (const GDDD &) {}
+  void operator() (const GDDD & node, uint64_t) {
+    nodes.push_back(node);
+  }
+};
+
+/// True if the records counted in the header fit in a file of the given size. The counts are
+/// read from the file, each one is checked against the space left so that nothing overflows.
+bool fits (const FrozenDDD::header_t & h, size_t size) {
+  size_t left = size - sizeof(FrozenDDD::header_t);
+  if (h.nb_nodes > left / sizeof(FrozenDDD::node_t))
+    return false;
+  left -= h.nb_nodes * sizeof(FrozenDDD::node_t);
+  if (h.nb_arcs > left / sizeof(FrozenDDD::arc_t))
+    return false;
+  left -= h.nb_arcs * sizeof(FrozenDDD::arc_t);
+  return h.nb_roots <= left / sizeof(uint32_t);
+}
+
+/// Key of the memory of the set operations : a stored node and a live one.
+typedef std::pair<uint32_t, GDDD> op_key_t;
+
+struct op_key_hash
+{
+  size_t operator() (const op_key_t & k) const {
+    return k.second.hash() ^ ddd::wang32_hash(k.first);
+  }
+};
+
+typedef std::unordered_map<op_key_t, GDDD, op_key_hash> op_cache_t;
+
+/// Builds live nodes of a store, each once.
+class importer
+{
+  std::unordered_map<uint32_t, GDDD> done_;
+public:
+  GDDD operator() (const FrozenDDD::node & f) {
+    switch (f.id()) {
+    case 0 : return GDDD::null;
+    case 1 : return GDDD::one;
+    case 2 : return GDDD::top;
+    }
+    std::unordered_map<uint32_t, GDDD>::const_iterator it = done_.find(f.id());
+    if (it != done_.end())
+      return it->second;
+    GDDD::Valuation value;
+    value.reserve(f.nbsons());
+    for (FrozenDDD::const_iterator arc = f.begin() ; arc != f.end() ; ++arc) {
+      value.push_back(GDDD::edge_t(arc.value(), (*this)(arc.son())));
+    }
+    GDDD res (f.variable(), value);
+    done_[f.id()] = res;
+    return res;
+  }
+};
+
+/// f * g, with the semantics of GDDD::operator*, only builds nodes of the result.
+GDDD intersect (const FrozenDDD::node & f, const GDDD & g, op_cache_t & cache) {
+  uint32_t id = f.id();
+  if (id == 0 || g == GDDD::null)
+    return GDDD::null;
+  if (id == 1 && g == GDDD::one)
+    return GDDD::one;
+  if (id == 1 || id == 2 || g == GDDD::one || g == GDDD::top)
+    return GDDD::top;
+  if (f.variable() != g.variable())
+    return GDDD::null;
+
+  op_key_t key (id, g);
+  op_cache_t::const_iterator it = cache.find(key);
+  if (it != cache.end())
+    return it->second;
+
+  GDDD::Valuation value;
+  FrozenDDD::const_iterator fi = f.begin(), fend = f.end();
+  GDDD::const_iterator gi = g.begin(), gend = g.end();
+  while (fi != fend && gi != gend) {
+    if (fi.value() < gi.value()) {
+      ++fi;
+    } else if (gi.value() < fi.value()) {
+      ++gi;
+    } else {
+      GDDD son = intersect(fi.son(), gi.son(), cache);
+      if (son != GDDD::null)
+	value.push_back(GDDD::edge_t(fi.value(), son));
+      ++fi;
+      ++gi;
+    }
+  }
+  GDDD res (f.variable(), value);
+  cache[key] = res;
+  return res;
+}
+
+/// g - f, with the semantics of GDDD::operator-, only builds nodes of the result.
+GDDD difference (const GDDD & g, const FrozenDDD::node & f, op_cache_t & cache) {
+  uint32_t id = f.id();
+  if (g == GDDD::top && id == 2)
+    return GDDD::top;
+  if (g == GDDD::null || (g == GDDD::one && id == 1))
+    return GDDD::null;
+  if (id == 0)
+    return g;
+  if (id == 1 || id == 2 || g == GDDD::one || g == GDDD::top)
+    return GDDD::top;
+  if (f.variable() != g.variable())
+    return g;
+
+  op_key_t key (id, g);
+  op_cache_t::const_iterator it = cache.find(key);
+  if (it != cache.end())
+    return it->second;
+
+  GDDD::Valuation value;
+  FrozenDDD::const_iterator fi = f.begin(), fend = f.end();
+  GDDD::const_iterator gi = g.begin(), gend = g.end();
+  while (gi != gend) {
+    while (fi != fend && fi.value() < gi.value())
+      ++fi;
+    if (fi != fend && fi.value() == gi.value()) {
+      GDDD son = difference(gi.son(), fi.son(), cache);
+      if (son != GDDD::null)
+	value.push_back(GDDD::edge_t(gi.value(), son));
+    } else {
+      value.push_back(*gi);
+    }
+    ++gi;
+  }
+  GDDD res (g.variable(), value);
+  cache[key] = res;
+  return res;
+}
+
+} // anonymous namespace
+
+
+void FrozenDDD::save (const std::string & path, const std::vector<DDD> & list) {
+  d3::node_numbering<GDDD> numbering;
+  collect_nodes visit;
+  // terminals are the first nodes
+  visit.nodes.push_back(GDDD::null);
+  visit.nodes.push_back(GDDD::one);
+  visit.nodes.push_back(GDDD::top);
+  numbering.assign(GDDD::null);
+  numbering.assign(GDDD::one);
+  numbering.assign(GDDD::top);
+  for (size_t i = 0 ; i < list.size() ; ++i) {
+    numbering.number(list[i], visit);
+  }
+  if (visit.nodes.size() > UINT32_MAX) {
+    throw std::runtime_error("FrozenDDD::save : too many nodes");
+  }
+
+  header_t h;
+  std::memcpy(h.magic, frozen_magic, 4);
+  h.version = frozen_version;
+  h.byte_order = frozen_byte_order;
+  h.reserved = 0;
+  h.nb_nodes = visit.nodes.size();
+  h.nb_arcs = 0;
+  h.nb_roots = list.size();
+
+  std::vector<node_t> nodes (visit.nodes.size());
+  for (size_t i = 0 ; i < visit.nodes.size() ; ++i) {
+    const GDDD & d = visit.nodes[i];
+    nodes[i].variable = d.variable();
+    nodes[i].nbsons = i < 3 ? 0 : d.nbsons();
+    nodes[i].first_arc = h.nb_arcs;
+    h.nb_arcs += nodes[i].nbsons;
+  }
+
+  std::ofstream os (path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (! os) {
+    throw std::runtime_error("FrozenDDD::save : cannot open " + path);
+  }
+  os.write(reinterpret_cast<const char *> (&h), sizeof(h));
+  os.write(reinterpret_cast<const char *> (nodes.data()), nodes.size() * sizeof(node_t));
+  std::vector<arc_t> arcs;
+  for (size_t i = 3 ; i < visit.nodes.size() ; ++i) {
+    const GDDD & d = visit.nodes[i];
+    arcs.clear();
+    GDDD::const_iterator end = d.end();
+    for (GDDD::const_iterator it = d.begin() ; it != end ; ++it) {
+      arc_t a;
+      a.value = it.value();
+      a.son = numbering.index(it.son());
+      arcs.push_back(a);
+    }
+    os.write(reinterpret_cast<const char *> (arcs.data()), arcs.size() * sizeof(arc_t));
+  }
+  for (size_t i = 0 ; i < list.size() ; ++i) {
+    uint32_t root = numbering.index(list[i]);
+    os.write(reinterpret_cast<const char *> (&root), sizeof(root));
+  }
+  if (! os.flush()) {
+    throw std::runtime_error("FrozenDDD::save : cannot write " + path);
+  }
+}
+
+FrozenDDD::FrozenDDD (const std::string & path) : map_(NULL), map_size_(0) {
+#ifdef _WIN32
+  // no mapping, the file is read in one go
+  std::ifstream is (path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+  if (! is) {
+    throw std::runtime_error("FrozenDDD : cannot open " + path);
+  }
+  map_size_ = is.tellg();
+  map_ = std::malloc(map_size_ ? map_size_ : 1);
+  is.seekg(0);
+  if (map_ == NULL || ! is.read(static_cast<char *> (map_), map_size_)) {
+    std::free(map_);
+    throw std::runtime_error("FrozenDDD : cannot read " + path);
+  }
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("FrozenDDD : cannot open " + path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("FrozenDDD : cannot stat " + path);
+  }
+  map_size_ = st.st_size;
+  if (map_size_ != 0) {
+    map_ = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (map_size_ == 0 || map_ == MAP_FAILED) {
+    map_ = NULL;
+    throw std::runtime_error("FrozenDDD : cannot map " + path);
+  }
+#endif
+  header_ = static_cast<const header_t *> (map_);
+  if (map_size_ < sizeof(header_t) || std::memcmp(header_->magic, frozen_magic, 4) != 0
+      || header_->version != frozen_version || header_->byte_order != frozen_byte_order
+      || header_->nb_nodes < 3 || ! fits(*header_, map_size_)) {
+    unmap();
+    throw std::runtime_error("FrozenDDD : not a DDD store, or written with another byte order " + path);
+  }
+  nodes_ = reinterpret_cast<const node_t *> (header_ + 1);
+  arcs_ = reinterpret_cast<const arc_t *> (nodes_ + header_->nb_nodes);
+  roots_ = reinterpret_cast<const uint32_t *> (arcs_ + header_->nb_arcs);
+}
+
+FrozenDDD::~FrozenDDD () {
+  unmap();
+}
+
+void FrozenDDD::unmap () {
+  if (map_ == NULL)
+    return;
+#ifdef _WIN32
+  std::free(map_);
+#else
+  munmap(map_, map_size_);
+#endif
+  map_ = NULL;
+}
+
+bool FrozenDDD::verify () const {
+  uint64_t nb_nodes = header_->nb_nodes;
+  for (uint64_t i = 0 ; i < nb_nodes ; ++i) {
+    const node_t & n = nodes_[i];
+    if (n.first_arc > header_->nb_arcs || n.nbsons > header_->nb_arcs - n.first_arc)
+      return false;
+    if (i < 3 && n.nbsons != 0)
+      return false;
+    for (uint64_t a = n.first_arc ; a < n.first_arc + n.nbsons ; ++a) {
+      if (arcs_[a].son >= i)
+	return false;
+      if (a > n.first_arc && arcs_[a].value <= arcs_[a - 1].value)
+	return false;
+    }
+  }
+  for (uint64_t r = 0 ; r < header_->nb_roots ; ++r) {
+    if (roots_[r] >= nb_nodes)
+      return false;
+  }
+  return true;
+}
+
+
+int FrozenDDD::node::variable () const {
+  return store_->nodes_[id_].variable;
+}
+
+size_t FrozenDDD::node::nbsons () const {
+  return store_->nodes_[id_].nbsons;
+}
+
+FrozenDDD::const_iterator FrozenDDD::node::begin () const {
+  return const_iterator(store_, store_->arcs_ + store_->nodes_[id_].first_arc);
+}
+
+FrozenDDD::const_iterator FrozenDDD::node::end () const {
+  const node_t & n = store_->nodes_[id_];
+  return const_iterator(store_, store_->arcs_ + n.first_arc + n.nbsons);
+}
+
+long double FrozenDDD::node::nbStates () const {
+  // sons are before their father, one pass over the nodes counts the paths of all of them
+  std::call_once(store_->states_once_, [this] () {
+      const FrozenDDD & s = *store_;
+      std::vector<long double> & states = s.states_;
+      states.assign(s.header_->nb_nodes, 0);
+      states[1] = 1;
+      for (uint64_t i = 3 ; i < s.header_->nb_nodes ; ++i) {
+	const node_t & n = s.nodes_[i];
+	long double res = 0;
+	for (uint64_t a = n.first_arc ; a < n.first_arc + n.nbsons ; ++a)
+	  res += states[s.arcs_[a].son];
+	states[i] = res;
+      }
+    });
+  return store_->states_[id_];
+}
+
+bool FrozenDDD::node::contains (const std::vector<GDDD::val_t> & path) const {
+  node cur = *this;
+  for (std::vector<GDDD::val_t>::const_iterator v = path.begin() ; v != path.end() ; ++v) {
+    if (cur.id() < 3)
+      return false;
+    const arc_t * first = store_->arcs_ + store_->nodes_[cur.id()].first_arc;
+    const arc_t * last = first + cur.nbsons();
+    const arc_t * arc = std::lower_bound(first, last, *v,
+					 [] (const arc_t & a, GDDD::val_t val) { return a.value < val; });
+    if (arc == last || arc->value != *v)
+      return false;
+    cur = node(store_, arc->son);
+  }
+  return cur.id() == 1;
+}
+
+GDDD FrozenDDD::node::import () const {
+  importer imp;
+  return imp(*this);
+}
+
+
+GDDD operator* (const FrozenDDD::node & f, const GDDD & g) {
+  op_cache_t cache;
+  return intersect(f, g, cache);
+}
+
+GDDD operator* (const GDDD & g, const FrozenDDD::node & f) {
+  return f * g;
+}
+
+GDDD operator- (const GDDD & g, const FrozenDDD::node & f) {
+  op_cache_t cache;
+  return difference(g, f, cache);
+}
+
+GDDD operator- (const FrozenDDD::node & f, const GDDD & g) {
+  return f.import() - g;
+}
+
+GDDD operator+ (const FrozenDDD::node & f, const GDDD & g) {
+  return f.import() + g;
+}
+
+GDDD operator+ (const GDDD & g, const FrozenDDD::node & f) {
+  return g + f.import();
+}
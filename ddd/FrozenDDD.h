@@ -0,0 +1,171 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+#ifndef __FROZEN_DDD_H__
+#define __FROZEN_DDD_H__
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <stdint.h>
+
+#include "ddd/DDD.h"
+
+/// A read-only store of DDD, memory mapped from a file written by FrozenDDD::save().
+///
+/// The file is a flat array of nodes, sons before their father, and a flat array of arcs.
+/// A node is designated by its index in the node array, terminals null, one and top are
+/// nodes 0, 1 and 2. Opening a store maps the file and checks its header, nodes are then
+/// read in place : there is no deserialization, and pages of the file are loaded on demand.
+/// A store does not use the unicity table : it is not affected by garbage collection, and
+/// its nodes only become DDD when they meet live DDD in a set operation.
+///
+/// The file is in the byte order of the machine that wrote it.
+class FrozenDDD
+{
+public:
+  /// The header of a store file.
+  struct header_t
+  {
+    char magic [4];
+    uint32_t version;
+    /// 0x01020304 as written, to detect a store written with another byte order
+    uint32_t byte_order;
+    uint32_t reserved;
+    uint64_t nb_nodes;
+    uint64_t nb_arcs;
+    uint64_t nb_roots;
+  };
+  /// A node : its variable, and its arcs in the arc array.
+  struct node_t
+  {
+    int32_t variable;
+    uint32_t nbsons;
+    uint64_t first_arc;
+  };
+  /// An arc : its value and its son, sons have a smaller index than their father.
+  struct arc_t
+  {
+    int32_t value;
+    uint32_t son;
+  };
+
+  class node;
+
+  /// Iterates over the arcs of a node, in increasing order of value.
+  class const_iterator
+  {
+    const FrozenDDD * store_;
+    const arc_t * arc_;
+  public:
+    const_iterator (const FrozenDDD * store, const arc_t * arc) : store_(store), arc_(arc) {}
+    /// value labeling the arc
+    GDDD::val_t value () const { return arc_->value; }
+    /// successor node of the arc
+    node son () const { return node(store_, arc_->son); }
+    const_iterator & operator++ () { ++arc_; return *this; }
+    const_iterator operator++ (int) { const_iterator tmp = *this; ++arc_; return tmp; }
+    bool operator== (const const_iterator & other) const { return arc_ == other.arc_; }
+    bool operator!= (const const_iterator & other) const { return arc_ != other.arc_; }
+  };
+
+  /// A node of a store, the read-only part of the GDDD interface. Valid as long as the store is.
+  class node
+  {
+    const FrozenDDD * store_;
+    uint32_t id_;
+  public:
+    node (const FrozenDDD * store, uint32_t id) : store_(store), id_(id) {}
+    /// The index of the node in the store.
+    uint32_t id () const { return id_; }
+    /// The store of the node.
+    const FrozenDDD & store () const { return *store_; }
+    /// Returns the node's variable, as GDDD::variable().
+    int variable () const;
+    /// Returns the number of arcs of the node.
+    size_t nbsons () const;
+    /// API for iterating over the arcs of the node, as GDDD::begin() and GDDD::end().
+    const_iterator begin () const;
+    const_iterator end () const;
+    /// Returns the number of paths to one, as GDDD::nbStates().
+    long double nbStates () const;
+    /// Returns true if the path made of one value per variable, from the top, is in the set.
+    bool contains (const std::vector<GDDD::val_t> & path) const;
+    /// Builds the equivalent live DDD.
+    GDDD import () const;
+    bool operator== (const node & other) const { return store_ == other.store_ && id_ == other.id_; }
+    bool operator!= (const node & other) const { return ! (*this == other); }
+  };
+
+  /// Writes a set of DDD to a store file. Throws std::runtime_error if the file cannot be written.
+  static void save (const std::string & path, const std::vector<DDD> & list);
+
+  /// Maps a store file. Throws std::runtime_error if the file cannot be mapped or is not a
+  /// store written on this kind of machine. Only the header and the file size are checked,
+  /// see verify().
+  explicit FrozenDDD (const std::string & path);
+  /// Unmaps the file, the nodes of the store become invalid.
+  ~FrozenDDD ();
+
+  /// The number of DDD saved in the store.
+  size_t size () const { return header_->nb_roots; }
+  /// The i-th DDD saved in the store.
+  node operator[] (size_t i) const { return node(this, roots_[i]); }
+  /// The number of nodes of the store, terminals included.
+  size_t nbNodes () const { return header_->nb_nodes; }
+  /// Checks that every arc and every root designates a node, and that sons are before
+  /// their father. Reads the whole file.
+  bool verify () const;
+
+private:
+  // not copyable, a store owns its mapping
+  FrozenDDD (const FrozenDDD &);
+  FrozenDDD & operator= (const FrozenDDD &);
+  void unmap ();
+
+  void * map_;
+  size_t map_size_;
+  const header_t * header_;
+  const node_t * nodes_;
+  const arc_t * arcs_;
+  const uint32_t * roots_;
+
+  /// number of paths of each node, computed on the first call to nbStates()
+  mutable std::vector<long double> states_;
+  mutable std::once_flag states_once_;
+};
+
+/// \name Set operations between a stored DDD and a live DDD.
+/// The stored DDD is imported on demand : an intersection and the difference of a live
+/// DDD and a stored one only create nodes of the result, the other operations import
+/// the stored DDD.
+//@{
+GDDD operator* (const FrozenDDD::node & f, const GDDD & g);
+GDDD operator* (const GDDD & g, const FrozenDDD::node & f);
+GDDD operator- (const GDDD & g, const FrozenDDD::node & f);
+GDDD operator- (const FrozenDDD::node & f, const GDDD & g);
+GDDD operator+ (const FrozenDDD::node & f, const GDDD & g);
+GDDD operator+ (const GDDD & g, const FrozenDDD::node & f);
+//@}
+
+#endif
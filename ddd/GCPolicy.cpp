@@ -0,0 +1,183 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "ddd/GCPolicy.h"
+#include "ddd/process.hpp"
+
+bool RssPolicy::sample (const GCState & state, size_t & rss) {
+  if (++checks_ < period_ && state.objects < objects_at_read_ + growth_)
+    return false;
+  checks_ = 0;
+  objects_at_read_ = state.objects;
+  ++reads_;
+  rss = process::getResidentMemory();
+  return true;
+}
+
+
+std::string RssGrowthPolicy::name () const {
+  std::ostringstream os;
+  os << "rss growth " << ratio_ * 100 << "% over " << threshold_ << " kB";
+  return os.str();
+}
+
+bool RssGrowthPolicy::should_garbage (const GCState & state) {
+  size_t mem;
+  if (! sample(state, mem))
+    return false;
+  if (mem == 0)
+    return true;
+  if (mem > threshold_ + threshold_ * ratio_) {
+    threshold_ = mem;
+    return true;
+  }
+  return false;
+}
+
+
+std::string RssBudgetPolicy::name () const {
+  std::ostringstream os;
+  os << "rss budget " << budget_ << " kB";
+  return os.str();
+}
+
+bool RssBudgetPolicy::should_garbage (const GCState & state) {
+  if (state.objects < state.objects_after_gc + state.objects_after_gc * min_growth_)
+    return false;
+  size_t mem;
+  if (! sample(state, mem))
+    return false;
+  return mem == 0 || mem > budget_;
+}
+
+
+namespace {
+
+/// The first number in a file, 0 if it cannot be read, or holds "max".
+size_t read_number (const std::string & path) {
+  std::ifstream in (path.c_str());
+  unsigned long long v = 0;
+  if (! (in >> v))
+    return 0;
+  return v;
+}
+
+/// The path of the cgroup of the process in the given hierarchy, from /proc/self/cgroup :
+/// "0::/path" for cgroup v2, "n:memory:/path" for cgroup v1.
+std::string cgroup_path (bool v2) {
+  std::ifstream in ("/proc/self/cgroup");
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t first = line.find(':');
+    size_t second = line.find(':', first + 1);
+    if (first == std::string::npos || second == std::string::npos)
+      continue;
+    std::string controllers = line.substr(first + 1, second - first - 1);
+    if (v2 ? (line.compare(0, first, "0") == 0 && controllers.empty())
+	: (("," + controllers + ",").find(",memory,") != std::string::npos)) {
+      return line.substr(second + 1);
+    }
+  }
+  return "";
+}
+
+} // anonymous namespace
+
+size_t CgroupPolicy::cgroupLimit () {
+  size_t bytes = 0;
+  // cgroup v2, memory.max holds "max" when there is no limit
+  std::string path = cgroup_path(true);
+  if (! path.empty()) {
+    bytes = read_number("/sys/fs/cgroup" + path + "/memory.max");
+    if (bytes == 0)
+      bytes = read_number("/sys/fs/cgroup/memory.max");
+  }
+  // cgroup v1, no limit is a huge value
+  if (bytes == 0) {
+    path = cgroup_path(false);
+    if (! path.empty()) {
+      bytes = read_number("/sys/fs/cgroup/memory" + path + "/memory.limit_in_bytes");
+    }
+    if (bytes == 0)
+      bytes = read_number("/sys/fs/cgroup/memory/memory.limit_in_bytes");
+    if (bytes >= ((size_t) 1 << 60))
+      bytes = 0;
+  }
+  return bytes / 1024;
+}
+
+CgroupPolicy::CgroupPolicy (double fraction, double min_growth) : RssBudgetPolicy(0, min_growth), limit_(cgroupLimit()), fraction_(fraction) {
+  size_t limit = limit_;
+#ifndef _WIN32
+  if (limit == 0) {
+    long pages = sysconf(_SC_PHYS_PAGES);
+    long page_size = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && page_size > 0)
+      limit = (size_t) pages * (page_size / 1024);
+  }
+#endif
+  budget_ = (size_t) (limit * fraction_);
+}
+
+std::string CgroupPolicy::name () const {
+  std::ostringstream os;
+  os << "cgroup budget " << budget_ << " kB (" << fraction_ * 100 << "% of " << (limit_ ? "the cgroup limit)" : "physical memory)");
+  return os.str();
+}
+
+
+std::string AdaptivePolicy::name () const {
+  std::ostringstream os;
+  os << "adaptive growth " << ratio_ * 100 << "% of live objects (at least " << min_objects_ << ")";
+  return os.str();
+}
+
+bool AdaptivePolicy::should_garbage (const GCState & state) {
+  size_t allowance = std::max(min_objects_, (size_t) (state.objects_after_gc * ratio_));
+  return state.objects >= state.objects_after_gc + allowance;
+}
+
+void AdaptivePolicy::collected (const GCState & state) {
+  if (state.objects_before_gc == 0)
+    return;
+  double live = (double) state.objects_after_gc / state.objects_before_gc;
+  if (live > 0.8)
+    ratio_ = std::min(max_ratio_, ratio_ * 2);
+  else if (live < 0.3)
+    ratio_ = std::max(min_ratio_, ratio_ / 2);
+}
+
+
+std::string AllocationPolicy::name () const {
+  std::ostringstream os;
+  os << "allocation of " << threshold_ << " objects";
+  return os.str();
+}
@@ -0,0 +1,157 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+#ifndef __GC_POLICY_H__
+#define __GC_POLICY_H__
+
+#include <string>
+#include <stddef.h>
+
+/// What a GCPolicy knows of the memory when it decides, filled by MemoryManager.
+/// Objects are entries of the unicity tables and operation caches, see MemoryManager::nbObjects().
+struct GCState {
+  /// the objects now
+  size_t objects;
+  /// the objects just before and just after the last collection, 0 if none happened
+  size_t objects_before_gc;
+  size_t objects_after_gc;
+  /// the number of collections so far
+  size_t nb_gc;
+};
+
+/// Decides when MemoryManager::should_garbage() triggers a collection.
+/// A policy is installed with MemoryManager::setGCPolicy(), and reported by MemoryManager::pstats()
+/// and MemoryManager::snapshot().
+class GCPolicy {
+public:
+  virtual ~GCPolicy() {}
+  /// A short description of the policy and its settings, for statistics. It should not hold quotes.
+  virtual std::string name () const = 0;
+  /// Returns true if a collection should occur now. Called once per iteration of top level fixpoints,
+  /// so it should be cheap.
+  virtual bool should_garbage (const GCState & state) = 0;
+  /// Called at the end of every collection.
+  virtual void collected (const GCState &) {}
+  /// The number of readings of the resident memory.
+  virtual size_t rss_reads () const { return 0; }
+};
+
+/// Base of the policies that read the resident memory. Reading it is a system call, so it is
+/// only read once every period calls, or as soon as growth objects were created since the
+/// last reading.
+class RssPolicy : public GCPolicy {
+  size_t period_;
+  size_t growth_;
+  size_t checks_;
+  size_t objects_at_read_;
+  size_t reads_;
+protected:
+  /// Returns true if the resident memory is due for a reading, and then reads it in kB.
+  /// A rss of 0 means the resident memory cannot be read on this system.
+  bool sample (const GCState & state, size_t & rss);
+public:
+  RssPolicy () : period_(256), growth_(100000), checks_(0), objects_at_read_(0), reads_(0) {}
+  /// Sets the reading period, 1 reads the resident memory on every call.
+  void setSampling (size_t period, size_t growth) {
+    period_ = period ? period : 1;
+    growth_ = growth;
+  }
+  void collected (const GCState & state) {
+    checks_ = 0;
+    objects_at_read_ = state.objects;
+  }
+  size_t rss_reads () const { return reads_; }
+};
+
+/// Collects when the resident memory grew by a ratio since the last collection it triggered,
+/// or first reaches a threshold. This is the default policy, with a 10% growth over 1300000 kB.
+class RssGrowthPolicy : public RssPolicy {
+  size_t threshold_;
+  double ratio_;
+public:
+  RssGrowthPolicy (size_t threshold_kb = 1300000, double ratio = 0.1) : threshold_(threshold_kb), ratio_(ratio) {}
+  std::string name () const;
+  bool should_garbage (const GCState & state);
+};
+
+/// Collects when the resident memory exceeds a budget. As memory is seldom given back
+/// to the system, a collection is only triggered if the objects grew by min_growth (a ratio
+/// of the objects alive after the last collection) since then, so that a live set above
+/// the budget does not cause a collection on every call.
+class RssBudgetPolicy : public RssPolicy {
+protected:
+  size_t budget_;
+  double min_growth_;
+public:
+  RssBudgetPolicy (size_t budget_kb, double min_growth = 0.1) : budget_(budget_kb), min_growth_(min_growth) {}
+  std::string name () const;
+  bool should_garbage (const GCState & state);
+};
+
+/// A budget that is a fraction of the memory limit of the cgroup of the process (cgroup v2
+/// memory.max, or cgroup v1 memory.limit_in_bytes), or of the physical memory if there is no limit.
+/// The limit is read once, when the policy is built.
+class CgroupPolicy : public RssBudgetPolicy {
+  size_t limit_;
+  double fraction_;
+public:
+  CgroupPolicy (double fraction = 0.8, double min_growth = 0.1);
+  std::string name () const;
+  /// The limit found, in kB, 0 if none could be read.
+  size_t limit () const { return limit_; }
+  /// Reads the memory limit of the cgroup of the process in kB, 0 if there is none.
+  static size_t cgroupLimit ();
+};
+
+/// Collects when the objects grew by a given ratio of the objects alive after the last
+/// collection, at least min_objects. The ratio adapts to the live-after-collection ratio :
+/// when most objects survive, collections were mostly wasted and the ratio doubles, when
+/// most objects die, the ratio halves. Does not read the resident memory.
+class AdaptivePolicy : public GCPolicy {
+  size_t min_objects_;
+  double ratio_;
+  double min_ratio_;
+  double max_ratio_;
+public:
+  AdaptivePolicy (size_t min_objects = 1000000, double ratio = 1, double min_ratio = 0.25, double max_ratio = 16)
+    : min_objects_(min_objects), ratio_(ratio), min_ratio_(min_ratio), max_ratio_(max_ratio) {}
+  std::string name () const;
+  bool should_garbage (const GCState & state);
+  void collected (const GCState & state);
+  /// The current growth ratio.
+  double ratio () const { return ratio_; }
+};
+
+/// Collects when a number of objects were created since the last collection.
+/// Does not read the resident memory.
+class AllocationPolicy : public GCPolicy {
+  size_t threshold_;
+public:
+  AllocationPolicy (size_t objects) : threshold_(objects) {}
+  std::string name () const;
+  bool should_garbage (const GCState & state) {
+    return state.objects >= state.objects_after_gc + threshold_;
+  }
+};
+
+#endif
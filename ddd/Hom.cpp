@@ -24,9 +24,16 @@
 #include <iostream>
 #include <cassert>
 #include <map>
+#include <atomic>
 #include <algorithm>
+#include <tuple>
+#include <unordered_map>
+#ifdef REENTRANT
+#include <mutex>
+#endif
 
 #include "ddd/util/set.hh"
+#include "ddd/util/small_vector.hh"
 #include "ddd/Hom.h"
 #include "ddd/DDD.h"
 #include "ddd/DED.h"
@@ -37,6 +44,7 @@
 #include "ddd/Cache.hh"
 #include "ddd/MemoryManager.h"
 #include "ddd/FixObserver.hh"
+#include "ddd/Parallel.h"
 
 namespace d3 { namespace util {
   template<>
@@ -204,22 +212,25 @@ public:
     d3::set<GDDD>::type toadd;
 
     for ( ; it1 != it1end && it2 != it2end ; ) {
-      if (it1->first == it2->first) {
+      GDDD::val_t val1 = it1.value();
+      GDDD::val_t val2 = it2.value();
+      if (val1 == val2) {
 	// We have a match
-	const GDDD & son = it2->second;
+	const GDDD son = it2.son();
+	const GDDD succ = it1.son();
 	GDDD::const_iterator sonend = son.end();
 	for (GDDD::const_iterator it3 = son.begin() ; it3 != sonend ; ++it3) {
-	  toadd.insert( GDDD(d.variable(),it3->first,it1->second) );
+	  toadd.insert( GDDD(d.variable(),it3.value(),succ) );
 	}
 	++it1;
 	++it2;
-      } else if (it1->first > it2->first) {
+      } else if (val1 > val2) {
 	// the value in transition => no such current value in d
 	// shift tr
-	++it2;
+	it2 = it2.seek(val1, it2end);
       } else {
 	// so no such arc in tr => no successor for this arc
-	++it1;
+	it1 = it1.seek(val2, it1end);
       }
     }
 
@@ -526,14 +537,129 @@ public:
   typedef std::vector<GHom> param_t;
   typedef param_t::const_iterator param_it;
 
-  typedef std::pair< GHom , std::set<GHom> > partition;
-  typedef std::map<int,partition> partition_cache_type;
+  /// For a variable, the F part (the operands that skip it, as a single union) and the
+  /// G part (the operands that must be applied at this level, sorted).
+  typedef std::pair< GHom , param_t > partition;
 
   // public for direct manipulation in fixpoint
   param_t parameters;
+private:
+  /// The partitions by variable. The variables an Add meets are not known when it is built,
+  /// so a partition is computed on the first visit of its variable, then published with a CAS.
+  /// Variables 0 to dense_size-1 have a slot in chunks of chunk_size slots, allocated on the
+  /// first visit of one of their variables : lookups take no lock, and memory follows the
+  /// variables actually visited. Other variables (negative or large) have their slot in a map.
+  class partition_table {
+  public:
+    typedef std::atomic<const partition *> slot_t;
+  private:
+    static const unsigned chunk_bits = 8;
+    static const size_t chunk_size = (size_t) 1 << chunk_bits;
+    static const size_t nb_chunks = 64;
+    static const size_t dense_size = nb_chunks * chunk_size;
+    mutable std::atomic<slot_t *> chunks_ [nb_chunks];
+    typedef std::unordered_map<int, slot_t> sparse_t;
+    mutable sparse_t sparse_;
+#ifdef REENTRANT
+    mutable std::mutex sparse_lock_;
+#endif
+
+    partition_table & operator= (const partition_table &);
+
+    slot_t & sparse_slot (int var) const {
+#ifdef REENTRANT
+      std::lock_guard<std::mutex> lock (sparse_lock_);
+#endif
+      // slots are not moved by an insertion in the map
+      return sparse_.emplace(std::piecewise_construct, std::forward_as_tuple(var),
+			     std::forward_as_tuple((const partition *) NULL)).first->second;
+    }
+  public:
+    partition_table () {
+      for (size_t c = 0 ; c < nb_chunks ; ++c)
+	chunks_[c].store(NULL, std::memory_order_relaxed);
+    }
+    /// A copy (the clone of an Add) computes its own partitions.
+    partition_table (const partition_table &) : partition_table() {}
+
+    ~partition_table () {
+      for (size_t c = 0 ; c < nb_chunks ; ++c) {
+	slot_t * slots = chunks_[c].load();
+	if (slots == NULL)
+	  continue;
+	for (size_t i = 0 ; i < chunk_size ; ++i)
+	  delete slots[i].load();
+	delete [] slots;
+      }
+      for (sparse_t::iterator it = sparse_.begin() ; it != sparse_.end() ; ++it)
+	delete it->second.load();
+    }
+
+    slot_t & slot (int var) const {
+      if (var < 0 || (size_t) var >= dense_size)
+	return sparse_slot(var);
+      size_t c = (size_t) var >> chunk_bits;
+      slot_t * slots = chunks_[c].load(std::memory_order_acquire);
+      if (slots == NULL) {
+	slot_t * fresh = new slot_t [chunk_size];
+	for (size_t i = 0 ; i < chunk_size ; ++i)
+	  fresh[i].store(NULL, std::memory_order_relaxed);
+	if (chunks_[c].compare_exchange_strong(slots, fresh, std::memory_order_acq_rel)) {
+	  slots = fresh;
+	} else {
+	  // another thread won the race, slots holds its chunk
+	  delete [] fresh;
+	}
+      }
+      return slots[(size_t) var & (chunk_size - 1)];
+    }
+
+    /// Calls f on each partition computed. Not to be called while partitions are computed.
+    template <typename F>
+    void for_each (F f) const {
+      for (size_t c = 0 ; c < nb_chunks ; ++c) {
+	slot_t * slots = chunks_[c].load();
+	if (slots == NULL)
+	  continue;
+	for (size_t i = 0 ; i < chunk_size ; ++i)
+	  if (const partition * part = slots[i].load())
+	    f(*part);
+      }
+      for (sparse_t::const_iterator it = sparse_.begin() ; it != sparse_.end() ; ++it)
+	if (const partition * part = it->second.load())
+	  f(*part);
+    }
+  };
+  partition_table partitions_;
+
+  const partition & partition_of (int var) const {
+    partition_table::slot_t & slot = partitions_.slot(var);
+    const partition * part = slot.load(std::memory_order_acquire);
+    if (part != NULL)
+      return *part;
+    partition * fresh = new partition;
+    std::set<GHom> F;
+    for(param_it gi=parameters.begin();gi!=parameters.end();++gi)
+      {
+	if( get_concret(*gi)->skip_variable(var) )
+	  {
+	    // F part
+	    F.insert(*gi);
+	  }
+	else
+	  {
+	    // G part
+	    fresh->second.push_back(*gi);
+	  }
+      }
+    fresh->first = GHom::add(F);
+    if (slot.compare_exchange_strong(part, fresh, std::memory_order_acq_rel))
+      return *fresh;
+    // another thread computed it meanwhile
+    delete fresh;
+    return *part;
+  }
 public:
-
-  mutable partition_cache_type partition_cache;
   bool have_id;
        
 public:
@@ -594,19 +720,11 @@ public:
       } 
     else 
       {
-	int var = d.variable();
-	
-	partition_cache_type::iterator part_it = partition_cache.find(var);
-	if( part_it == partition_cache.end() )
-          {
-	    this->skip_variable(var);
-	    part_it = partition_cache.find(var);
-          }              
-	
-	GHom& F = part_it->second.first;
-        std::set<GHom> & G = part_it->second.second;
+	const partition & part = partition_of(d.variable());
+	const GHom & F = part.first;
+	const param_t & G = part.second;
         
-	for( std::set<GHom>::iterator it = G.begin() ; it != G.end(); ++it)
+	for( param_it it = G.begin() ; it != G.end(); ++it)
 	  {
 	    GDDD img = it->has_image(d);
 	    if (! (img == GDDD::null)) {
@@ -642,8 +760,7 @@ public:
   partition
   get_partition(int var) const
   {
-        this->skip_variable(var);
-        return partition_cache.find(var)->second;
+        return partition_of(var);
   }
 
   GHom invert  (const GDDD & pot) const {
@@ -686,29 +803,7 @@ public:
   bool
   skip_variable(int var) const
   {
-    partition_cache_type::iterator part_it = partition_cache.find(var);
-    if( part_it == partition_cache.end() )
-      {
-	partition& part = partition_cache.insert(std::make_pair(var,partition())).first->second;
-	
-	std::set<GHom> F;
-	for(param_it gi=parameters.begin();gi!=parameters.end();++gi)
-	  {
-	    if( get_concret(*gi)->skip_variable(var) )
-	      {
-		// F part
-		F.insert(*gi);
-	      }
-	    else
-	      {
-		// G part
-		part.second.insert(*gi);
-	      }
-	  }
-	part.first = GHom::add(F);
-	return part.second.empty();
-      }
-    return part_it->second.second.empty();
+    return partition_of(var).second.empty();
   }
   
   /* Eval */
@@ -721,42 +816,36 @@ public:
       }
       else if( d == GDDD::one || d == GDDD::top )
       {
-          std::set<GDDD> s;
+          d3::util::small_vector<GDDD,8> s;
           
           for(param_it gi=parameters.begin();gi!=parameters.end();++gi)
           {
-              s.insert((*gi)(d));
+              s.push_back((*gi)(d));
           }
-          return DED::add(s);
+          s.sort_unique();
+          return DED::add(s.begin(), s.end());
       }
       else
       {
-          std::set<GDDD> s;
-          int var = d.variable();
-                    
-          partition_cache_type::iterator part_it = partition_cache.find(var);
-          if( part_it == partition_cache.end() )
-          {
-              this->skip_variable(var);
-              part_it = partition_cache.find(var);
-          }              
-          
-          GHom& F = part_it->second.first;
-        std::set<GHom> & G = part_it->second.second;
+          d3::util::small_vector<GDDD,8> s;
+          const partition & part = partition_of(d.variable());
+          const GHom & F = part.first;
+          const param_t & G = part.second;
           
-          for( std::set<GHom>::iterator it = G.begin() ; it != G.end(); ++it)
+          for( param_it it = G.begin() ; it != G.end(); ++it)
 	    {
-	      s.insert((*it)(d));                  
+	      s.push_back((*it)(d));                  
 	    } 
           
           
           GDDD v = F(d);
           if( v != GDDD::null )
           {
-              s.insert(v);
+              s.push_back(v);
           }
 
-          return DED::add(s);
+          s.sort_unique();
+          return DED::add(s.begin(), s.end());
       }
   }
     
@@ -764,7 +853,8 @@ public:
   void mark() const{
     for(param_it gi=parameters.begin();gi!=parameters.end();++gi)
       gi->mark();
-    partition_cache.clear();
+    // the partitions are kept across collections, their G part is made of operands
+    partitions_.for_each([] (const partition & part) { part.first.mark(); });
   }
 
  void print (std::ostream & os) const {
@@ -1541,12 +1631,13 @@ public:
 
 			if (!wasInterrupted) {
                         // Apply ( G + Id )
-                      std::set<GDDD> tmp;
-                      for (std::set<GHom>::const_iterator it = partition.second.begin() ; it != partition.second.end() ; ++it ) {
-                        tmp.insert ((*it) (d2));
+                      d3::util::small_vector<GDDD,8> tmp;
+                      for (Add::param_it it = partition.second.begin() ; it != partition.second.end() ; ++it ) {
+                        tmp.push_back ((*it) (d2));
                       }
-                      tmp.insert (d2);
-                      d2 = DED::add (tmp);
+                      tmp.push_back (d2);
+                      tmp.sort_unique();
+                      d2 = DED::add (tmp.begin(), tmp.end());
                       
                       if (fobs::get_fixobserver ()->was_interrupted ()) 	wasInterrupted = true;
                       if (testShouldInterrupt(can_garbage, d1, d2)) {
@@ -1563,7 +1654,7 @@ public:
                           d2.mark();
                           //arg.mark();
                           F_part.mark();
-                          for (std::set<GHom>::const_iterator it = partition.second.begin() ; it != partition.second.end() ; ++it ) {
+                          for (Add::param_it it = partition.second.begin() ; it != partition.second.end() ; ++it ) {
                             it->mark();
                           }
                           Hom tt = Hom(this);
@@ -1664,12 +1755,13 @@ _GHom::has_image_skip(const GDDD& d) const
       return d;
     }
     
-    for( GDDD::const_iterator it = d.begin() ; it != d.end() ; ++it )
+    GDDD::const_iterator dend = d.end();
+    for( GDDD::const_iterator it = d.begin() ; it != dend ; ++it )
       {
-	GDDD son = ghom.has_image(it->second);
+	GDDD son = ghom.has_image(it.son());
 	if( son != GDDD::null )
 	  {
-	    return GDDD(d.variable(), it->first, son) ;
+	    return GDDD(d.variable(), it.value(), son) ;
 	  }
       }
     return GDDD::null;
@@ -1678,6 +1770,10 @@ _GHom::has_image_skip(const GDDD& d) const
   return has_image(d);
 }
 
+#ifdef PARALLEL_DD
+static GDDD eval_skip_parallel (const GHom & h, const GDDD & d);
+#endif
+
 GDDD 
 _GHom::eval_skip(const GDDD& d) const
 {
@@ -1701,13 +1797,19 @@ _GHom::eval_skip(const GDDD& d) const
       if (ghom == GHom::id) {
 	return d;
       }
+#ifdef PARALLEL_DD
+      if (d.nbsons() > 1 && d3::parallel::threads() > 1) {
+	return eval_skip_parallel(ghom, d);
+      }
+#endif
         GDDD::Valuation v;
-        for( GDDD::const_iterator it = d.begin() ; it != d.end() ; ++it )
+        GDDD::const_iterator dend = d.end();
+        for( GDDD::const_iterator it = d.begin() ; it != dend ; ++it )
         {
-            GDDD son = ghom (it->second);
+            GDDD son = ghom (it.son());
             if( son != GDDD::null )
             {
-                v.push_back(std::make_pair(it->first, son));
+                v.push_back(GDDD::edge_t(it.value(), son));
             }
         }
         
@@ -1936,6 +2038,52 @@ GDDD ImgHomCache::eval(const GHom & func, const GDDD  & param) const {
 
 static ImgHomCache imgcache;
 
+#ifdef PARALLEL_DD
+/// _GHom::eval_skip with the sons forked as tasks. The cache hits are picked up first,
+/// the remaining sons are weighted by their number of arcs.
+static GDDD eval_skip_parallel (const GHom & h, const GDDD & d) {
+  size_t n = d.nbsons();
+  std::vector<GDDD> sons;
+  sons.reserve(n);
+  std::vector<size_t> todo, weights;
+  size_t total = 0;
+  GDDD::const_iterator dend = d.end();
+  for (GDDD::const_iterator it = d.begin() ; it != dend ; ++it) {
+    GDDD son = it.son();
+    GDDD res;
+    if (cache.contains(h, son, res)) {
+      sons.push_back(res);
+    } else {
+      todo.push_back(sons.size());
+      weights.push_back(son.nbsons() + 1);
+      total += weights.back();
+      sons.push_back(son);
+    }
+  }
+  if (d3::parallel::worth_forking(total)) {
+    size_t misses = cache.counters().misses();
+    d3::parallel::for_each(todo.size(), &weights[0], [&] (size_t k) {
+	sons[todo[k]] = h(sons[todo[k]]);
+      });
+    d3::parallel::record(todo.size(), cache.counters().misses() - misses);
+  } else {
+    for (size_t k = 0 ; k < todo.size() ; ++k)
+      sons[todo[k]] = h(sons[todo[k]]);
+  }
+  GDDD::Valuation v;
+  size_t i = 0;
+  for (GDDD::const_iterator it = d.begin() ; it != dend ; ++it, ++i) {
+    if (sons[i] != GDDD::null) {
+      v.push_back(GDDD::edge_t(it.value(), sons[i]));
+    }
+  }
+  if (v.empty())
+    return GDDD::null;
+  else
+    return GDDD(d.variable(), v);
+}
+#endif
+
 /* Eval */
 GDDD
 GHom::operator()(const GDDD &d) const
@@ -2020,23 +2168,55 @@ void GHom::mark()const{
   }
 };
 
+void GHom::setCacheSlots (size_t nb_slots) {
+  cache.set_slots(nb_slots);
+}
+
+void GHom::setImageCacheSlots (size_t nb_slots) {
+  imgcache.set_slots(nb_slots);
+}
+
+d3::op_cache_stats_t GHom::cacheStats () {
+  return cache.stats();
+}
+
+d3::op_cache_stats_t GHom::imageCacheStats () {
+  return imgcache.stats();
+}
+
+bool GHom::is_marked()const{
+  return concret->marking;
+}
+
 void GHom::garbage(){
-  cache.clear();
-  imgcache.clear();
-  // mark phase
+  mark_roots();
+  sweep_caches();
+  sweep();
+}
+
+void GHom::mark_roots(){
+  // iterate over refcounted homs only
   for(UniqueTable<_GHom>::Table::iterator di=canonical.table.begin();di!=canonical.table.end();++di){
     if((*di)->refCounter!=0){
       (*di)->marking=true;
       (*di)->mark();
     }
   }
-  // sweep phase
+}
+
+void GHom::sweep_caches(){
+  const d3::cache_policy & policy = d3::cache_policy::current();
+  cache.sweep(policy);
+  imgcache.sweep(policy);
+}
+
+void GHom::sweep(){
   for(UniqueTable<_GHom>::Table::iterator di=canonical.table.begin();di!=canonical.table.end();){
     if(!((*di)->marking)){
       UniqueTable<_GHom>::Table::iterator ci=di;
       ++di;
       const _GHom *g=(*ci);
-      canonical.table.erase(ci);
+      canonical.erase(ci);
       delete g;
     }
     else{
@@ -2449,9 +2629,33 @@ bool _GHom::operator< (const _GHom &h) const {
   return creation_counter > h.creation_counter;
 }
 
+size_t _GHom::next_creation () {
+#ifdef REENTRANT
+  static std::atomic<size_t> counter (0);
+#else
+  static size_t counter = 0;
+#endif
+  return counter++;
+}
+
+size_t GHom::peak()
+{
+  return canonical.peak();
+}
+
+void GHom::snapshot(d3::memory_snapshot_t & snap)
+{
+  // homomorphisms derive from _GHom, what they add is not counted
+  snap.tables.push_back(d3::memory_snapshot_t::table_t("Hom", statistics(), peak(), statistics() * sizeof(_GHom)));
+  snap.caches.push_back(std::make_pair(std::string("Hom"), cache.stats()));
+  snap.caches.push_back(std::make_pair(std::string("HomImage"), imgcache.stats()));
+}
+
 void GHom::pstats(bool)
 {
   std::cout << "*\nGHom Stats : size unicity table = " <<  canonical.size() << std::endl;
+  cache.print_stats(std::cout, "GHom cache");
+  imgcache.print_stats(std::cout, "GHom image cache");
   
 #ifdef HASH_STAT
   std::cout << std::endl << "GHom Unicity table stats :" << std::endl;
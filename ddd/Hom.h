@@ -27,6 +27,7 @@
 #include "ddd/DDD.h"
 #include "ddd/util/hash_support.hh"
 #include "ddd/util/set.hh"
+#include "ddd/util/op_stats.hh"
 
 #include <map>
 #include <cassert>
@@ -231,9 +232,13 @@ public:
   //@{
   /// Returns unicity table current size. Gives the number of different _GHom created and not yet destroyed.
   static  unsigned int statistics();
+  /// Returns the peak size of the unicity table.
+  static size_t peak();
   /// Prints some statistics to std::cout. Mostly used in debug and development phase.
   /// \todo allow output in other place than cout. Clean up output.
   static void pstats(bool reinit=true);
+  /// Adds the unicity table and the operation caches to a snapshot of the memory, see MemoryManager::snapshot().
+  static void snapshot(d3::memory_snapshot_t & snap);
   /// For garbage collection internals. Marks a GHom as in use in garbage collection phase. 
   void mark()const;
   /// For storage in a hash table
@@ -248,6 +253,20 @@ public:
   /// are destroyed. This avoids maintaining reference counts during operation : only external references made through
   /// the DDD class are counted, and no recursive reference counting is needed.
   static void garbage(); 
+  /// The phases of garbage(). Operation caches are swept after every GHom and GDDD was marked,
+  /// and keep the entries that are still live according to MemoryManager::setCachePolicy().
+  static void mark_roots();
+  static void sweep_caches();
+  static void sweep();
+  /// For garbage collection internals. Whether a GHom survives the ongoing collection.
+  bool is_marked() const;
+  /// Bound the operation cache (resp. the has_image cache) to a direct mapped table of nb_slots
+  /// entries, that never grows nor rehashes, see Cache::set_slots(). Zero (the default) means unbounded.
+  static void setCacheSlots (size_t nb_slots);
+  static void setImageCacheSlots (size_t nb_slots);
+  /// Size and hit, miss, insertion and eviction counts of the operation cache (resp. the has_image cache).
+  static d3::op_cache_stats_t cacheStats ();
+  static d3::op_cache_stats_t imageCacheStats ();
   //@}
 };
 
@@ -408,6 +427,8 @@ private:
   /// Counter of objects created (see constructors).
   /// This is used for the ordering between homomorphisms.
   size_t creation_counter;
+  /// The next value of the creation counter, safe to call from any thread in REENTRANT builds.
+  static size_t next_creation ();
  
   GDDD eval_skip(const GDDD &) const;
 public:
@@ -457,8 +478,7 @@ public:
   /// list of derived classes constructors (hard coded operations and StrongShom).
   _GHom(int ref=0,bool im=false):refCounter(ref),marking(false),immediat(im){
     // creation counter
-    static size_t counter = 0;
-    creation_counter = counter++;
+    creation_counter = next_creation();
   }
   /// Virtual Destructor. Default behavior. 
   virtual ~_GHom(){};
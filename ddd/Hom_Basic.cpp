@@ -489,7 +489,7 @@ void iterateDDD (const GDDD & node, callback_t * cb, std::vector<DDD::val_t> & p
 		// do it
 		(*cb)(prefix);
 	} else {
-		for (auto & edge : node) {
+		for (const auto & edge : node) {
 			prefix.push_back(edge.first);
 			iterateDDD (edge.second, cb, prefix);
 			prefix.pop_back();
@@ -25,7 +25,7 @@
 
 
 // static initialization
-UniqueTable<std::vector<int> > IntDataSet::canonical = UniqueTable<std::vector<int> > ();
+UniqueTable<std::vector<int> > IntDataSet::canonical;
 
 const std::vector<int> * IntDataSet::empty_ = canonical(std::vector<int>(0));
 
@@ -35,11 +35,12 @@ IntDataSet::marktable_t IntDataSet::marktable = marktable_t();
 void IntDataSet::garbage () {
   // sweep phase  
   for(canonical_it di=canonical.table.begin();di!=canonical.table.end();){
-    if(marktable.find(*di) == marktable.end() ){
+    // empty_ is never collected, empty() compares with it
+    if(*di != empty_ && marktable.find(*di) == marktable.end() ){
       canonical_it ci=di;
       di++;
       const std::vector<int> *g=(*ci);
-      canonical.table.erase(ci);
+      canonical.erase(ci);
       delete g;
     }else {
       di++;
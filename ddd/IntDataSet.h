@@ -139,6 +139,9 @@ public :
   long double set_size() const {
     return data->size();
   }
+  d3::bigcount set_exact_size() const {
+    return d3::bigcount(data->size());
+  }
   /// returns a hash function, used in the SDD hash function computation
   virtual size_t set_hash() const {
     return d3::util::hash<std::vector<int>* > () (data);
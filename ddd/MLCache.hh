@@ -2,6 +2,7 @@
 #define _MLCACHE_HH_
   
 #include "ddd/util/configuration.hh"
+#include "ddd/util/direct_mapped.hh"
 
 
 template
@@ -18,6 +19,8 @@ private:
   typedef typename  hash_map< std::pair<MLHomType, NodeType>, HomNodeMapType >::type 
                     hash_map; 
   hash_map cache_;
+  /// used instead of cache_ when the cache is bounded, see set_slots()
+  d3::direct_mapped_cache< std::pair<MLHomType, NodeType>, HomNodeMapType > bounded_;
     
 public:
   MLCache () : peak_ (0) {};
@@ -26,6 +29,15 @@ public:
   void clear (bool keepstats = false) {
     peak();
     cache_.clear();
+    bounded_.clear();
+  }
+
+  /** Bound the cache to a direct mapped table of nb_slots (rounded up to a power of two),
+      where an entry overwrites the one in its slot. Zero makes the cache an unbounded
+      hash map again. Discards all values. */
+  void set_slots (size_t nb_slots) {
+    clear();
+    bounded_.resize(nb_slots);
   }
 
   size_t peak () const {
@@ -37,12 +49,21 @@ public:
 
 
   size_t size () const {
-    return cache_.size();
+    return bounded_.capacity() != 0 ? bounded_.size() : cache_.size();
   }
 
     std::pair<bool,HomNodeMapType>
     insert(const MLHomType& hom, const NodeType& node)
     {
+      if (bounded_.capacity() != 0) {
+	std::pair<MLHomType, NodeType> key (hom, node);
+	HomNodeMapType result;
+	if (bounded_.find(key, result))
+	  return std::make_pair(false, result);
+	result = hom.eval(node);
+	bounded_.insert(key, result);
+	return std::make_pair(true, result);
+      }
       bool found;
       
       { // lock on current bucket
@@ -283,6 +283,10 @@ MLHom operator+(const MLHom &h1,const MLHom &h2){
   return canonical( Add(s));
 }
 
+void MLHom::setCacheSlots (size_t nb_slots) {
+  mlcache.set_slots(nb_slots);
+}
+
 void MLHom::garbage(){
   // clear operation cache
   mlcache.clear();
@@ -299,7 +303,7 @@ void MLHom::garbage(){
       UniqueTable<_MLHom>::Table::iterator ci=di;
       ++di;
       const _MLHom *g=*ci;
-      canonical.table.erase(ci);
+      canonical.erase(ci);
       delete g;
     }
     else{
@@ -100,6 +100,9 @@ public :
   /// MemoryManager::garbage() as order of calls (among GSDD::garbage(), GShom::garbage(), 
   /// SDED::garbage()) is important.
   static void garbage();
+  /// Bound the operation cache to a direct mapped table of nb_slots entries, see Cache::set_slots().
+  /// Zero (the default) means unbounded.
+  static void setCacheSlots (size_t nb_slots);
 
 };
 
@@ -257,7 +257,7 @@ void MLShom::garbage(){
       UniqueTable<_MLShom>::Table::iterator ci=di;
       di++;
       const _MLShom *g=*ci;
-      canonical.table.erase(ci);
+      canonical.erase(ci);
       delete g;
     }
     else{
@@ -0,0 +1,139 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "ddd/MemoryManager.h"
+
+d3::memory_snapshot_t MemoryManager::snapshot () {
+  // collections and policy changes wait for the snapshot
+  std::lock_guard<std::recursive_mutex> lock (stats_mutex());
+  d3::memory_snapshot_t snap;
+  snap.timestamp = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+  snap.rss_kb = process::getResidentMemory();
+
+  // FIXME : if you dont use SDD suppress the following
+  snap.caches.push_back(std::make_pair(std::string("SDED"), SDED::stats()));
+  GShom::snapshot(snap);
+  GSDD::snapshot(snap);
+  // END FIXME
+
+  snap.caches.push_back(std::make_pair(std::string("DED"), DED::stats()));
+  GHom::snapshot(snap);
+  GDDD::snapshot(snap);
+
+  snap.gc_count = nb_gc_;
+  snap.gc_total_pause = total_pause_;
+  snap.gc_max_pause = max_pause_;
+  snap.gc_last_pause = last_pause_;
+  snap.gc_policy = gcPolicy().name();
+  snap.gc_rss_reads = gcPolicy().rss_reads();
+  return snap;
+}
+
+namespace {
+
+/// The periodic sampler, there is at most one.
+class sampler_t
+{
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_;
+  std::ofstream out_;
+  double period_;
+  bool csv_;
+
+  void write () {
+    d3::memory_snapshot_t snap = MemoryManager::snapshot();
+    if (csv_) {
+      snap.to_csv(out_);
+    } else {
+      snap.to_json(out_);
+      out_ << std::endl;
+    }
+  }
+
+  void run () {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (! stop_) {
+      write();
+      wake_.wait_for(lock, std::chrono::duration<double>(period_));
+    }
+    write();
+  }
+
+public:
+  sampler_t () : stop_(false), period_(1), csv_(false) {}
+
+  ~sampler_t () {
+    stop();
+  }
+
+  bool start (const std::string & path, double period, bool csv) {
+    if (thread_.joinable())
+      return false;
+    out_.open(path.c_str(), std::ios::out | std::ios::app);
+    if (! out_)
+      return false;
+    period_ = period;
+    csv_ = csv;
+    stop_ = false;
+    if (csv_) {
+      MemoryManager::snapshot().csv_header(out_);
+    }
+    thread_ = std::thread(&sampler_t::run, this);
+    return true;
+  }
+
+  void stop () {
+    if (! thread_.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+    out_.close();
+  }
+};
+
+sampler_t & sampler () {
+  static sampler_t instance;
+  return instance;
+}
+
+} // anonymous namespace
+
+bool MemoryManager::startSampler (const std::string & path, double period, bool csv) {
+  return sampler().start(path, period, csv);
+}
+
+void MemoryManager::stopSampler () {
+  sampler().stop();
+}
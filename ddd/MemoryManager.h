@@ -34,6 +34,15 @@
 
 
 #include "ddd/process.hpp"
+#include "ddd/GCPolicy.h"
+#include "ddd/Parallel.h"
+#include "ddd/util/cache_policy.hh"
+#include "ddd/util/snapshot.hh"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <iostream>
 
 
 class GCHook {
@@ -76,51 +85,127 @@ public:
   /// \todo : track usage and check whether this is useful, SDD version undefined.  
   static void mark(const GHom &h){h.mark();};
 
-  /// tester for memory management routine triggering in a top level fixpoint
-    static bool should_garbage() {
-      // trigger at rougly 5 million objects =1 Gig RAM
-      //return nbDED() + nbSDED() + nbShom() + nbSDD() > 3000000;
-      size_t mem = process::getResidentMemory();
-      if (mem == 0)
-	return true;
-      // add ten percent growth
-      if (mem > last_mem + last_mem / 10 ) {
-/* 	std::cerr << "GC triggered at mem=" << mem << std::endl; */
-	last_mem = mem;
-	return true;
-      } else {
-/* 	std::cerr << "GC not triggered mem=" << mem << std::endl; */
-	return false;
-      }
-    }
+  /// Returns the number of entries of the unicity tables and operation caches.
+  /// It is cheap to compute, and measures what was allocated since the last garbage().
+  static size_t nbObjects () {
+    return nbDDD() + nbDED() + nbHom() + nbSDD() + nbSDED() + nbShom();
+  }
+
+  /// tester for memory management routine triggering in a top level fixpoint.
+  /// The decision is taken by the policy set with setGCPolicy(), by default an RssGrowthPolicy :
+  /// a collection is triggered when the resident memory grew by 10% since the last collection.
+  /// Never while forked evaluations may run, see d3::parallel::active().
+  static bool should_garbage() {
+    if (d3::parallel::active())
+      return false;
+    std::lock_guard<std::recursive_mutex> lock (stats_mutex());
+    GCState state = gcState();
+    return gcPolicy().should_garbage(state);
+  }
+
+  /// Sets the policy that decides when should_garbage() triggers a collection.
+  /// MemoryManager takes ownership of policy.
+  static void setGCPolicy (GCPolicy * policy) {
+    std::lock_guard<std::recursive_mutex> lock (stats_mutex());
+    policy_ref().reset(policy);
+  }
+
+  /// The current policy. It is only valid until the next setGCPolicy().
+  static GCPolicy & gcPolicy () {
+    return *policy_ref();
+  }
+
+  /// The lock held by garbage(), setGCPolicy(), should_garbage(), pstats() and snapshot(), so that
+  /// snapshot() may read the policy and the statistics of collections from another thread.
+  static std::recursive_mutex & stats_mutex () {
+    static std::recursive_mutex mutex;
+    return mutex;
+  }
+
+  /// Sets how often the current policy reads the resident memory, if it is an RssPolicy :
+  /// every period calls, or as soon as growth objects were created since the last reading.
+  static void setGCSampling (size_t period, size_t growth = 100000) {
+    std::lock_guard<std::recursive_mutex> lock (stats_mutex());
+    RssPolicy * p = dynamic_cast<RssPolicy *> (&gcPolicy());
+    if (p != NULL)
+      p->setSampling(period, growth);
+  }
+
+  /// Triggers collections when objects entries were created in the tables and caches since the
+  /// last collection, see nbObjects(). Shorthand for setGCPolicy() with an AllocationPolicy,
+  /// 0 restores the default policy.
+  static void setGCAllocationThreshold (size_t objects) {
+    if (objects != 0)
+      setGCPolicy(new AllocationPolicy(objects));
+    else
+      setGCPolicy(new RssGrowthPolicy());
+  }
+
+ private :
+  static std::unique_ptr<GCPolicy> & policy_ref () {
+    static std::unique_ptr<GCPolicy> policy (new RssGrowthPolicy());
+    return policy;
+  }
+
+  static GCState gcState () {
+    GCState state;
+    state.objects = nbObjects();
+    state.objects_before_gc = objects_before_gc_;
+    state.objects_after_gc = objects_after_gc_;
+    state.nb_gc = nb_gc_;
+    return state;
+  }
+
+ public :
 
   /// Garbage collection function. 
   /// Call this to reclaim intermediate nodes, unused operations and related cache.
-  /// Note that this function is quite costly, and it totally destroys the cache
+  /// Note that this function is quite costly, the entries of the caches that are kept
+  /// depend on the policy set with setCachePolicy().
   static void garbage(){
+    std::lock_guard<std::recursive_mutex> lock (stats_mutex());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    objects_before_gc_ = nbObjects();
     for (hooks_it it = hooks_.begin(); it != hooks_.end() ; ++it) {
       (*it)->preGarbageCollect();
     }
 
     MLHom::garbage();
     // FIXME : if you dont use SDD suppress the following
+    // caches are swept between the mark and sweep phases, so that live entries may be kept
+    GShom::mark_roots();
+    GSDD::mark_roots();
     SDED::garbage();
-    GShom::garbage();
-    GSDD::garbage();
+    GShom::sweep_caches();
+    GShom::sweep();
+    GSDD::sweep();
     // clear the IntDataSet
     IntDataSet::garbage();
     // END FIXME 
+    GHom::mark_roots();
+    GDDD::mark_roots();
     DED::garbage();
-    GHom::garbage();
-    GDDD::garbage();
+    GHom::sweep_caches();
+    GHom::sweep();
+    GDDD::sweep();
 
     for (hooks_it it = hooks_.begin(); it != hooks_.end() ; ++it) {
       (*it)->postGarbageCollect();
     }
+
+    double pause = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ++nb_gc_;
+    last_pause_ = pause;
+    total_pause_ += pause;
+    if (pause > max_pause_)
+      max_pause_ = pause;
+    objects_after_gc_ = nbObjects();
+    gcPolicy().collected(gcState());
   };
 
   /// Prints some statistics about use of unicity tables, also reinitializes peak sizes.
   static void pstats(bool reinit=true){
+    std::lock_guard<std::recursive_mutex> lock (stats_mutex());
     //cout << " Memory Usage " << MemUsage() << " %" << endl;
     
     // FIXME : if you dont use SDD suppress the following
@@ -132,15 +217,50 @@ public:
     DED::pstats(reinit);
     GHom::pstats(reinit);
     GDDD::pstats(reinit);    
+
+    std::cout << "Garbage collections : " << nb_gc_ << ", pause total " << total_pause_
+	      << " s, max " << max_pause_ << " s, last " << last_pause_ << " s" << std::endl;
+    std::cout << "GC policy : " << gcPolicy().name() << ", resident memory read "
+	      << gcPolicy().rss_reads() << " times" << std::endl;
+#ifdef PARALLEL_DD
+    d3::parallel::pstats(std::cout);
+#endif
   }
 
+  /// Sets what garbage() keeps of the operation caches : nothing (d3::FULL_CLEAR), the entries whose
+  /// operands and result are live (d3::KEEP_LIVE, the default), or at most bound such entries
+  /// per cache (d3::KEEP_LIVE_BOUNDED).
+  static void setCachePolicy (d3::cache_sweep_t mode, size_t bound = 0) {
+    d3::cache_policy & policy = d3::cache_policy::current();
+    policy.mode = mode;
+    policy.bound = bound;
+  }
+
+  /// Returns the sizes, peaks, bytes and cache counters of every table, the garbage collection
+  /// statistics and the resident memory. Serialize it with to_json() or to_csv().
+  /// It only reads atomic counters, and what collections update under stats_mutex(), so it
+  /// may be called from another thread while the library is in use.
+  static d3::memory_snapshot_t snapshot ();
+
+  /// Starts a thread that appends a snapshot() to the file at path every period seconds,
+  /// one JSON object per line, or CSV rows if csv is true. Figures sampled while operations
+  /// are running are not taken at a single instant : sizes and counters may be a few updates apart.
+  /// Returns false if the file cannot be opened, or if a sampler is already running.
+  static bool startSampler (const std::string & path, double period, bool csv = false);
+  /// Stops the sampler thread, after it wrote a last snapshot.
+  static void stopSampler ();
+
+  /// Sets the default policy, an RssGrowthPolicy with this initial threshold.
   static void setGCThreshold (size_t nbKbyte) {
-    last_mem = nbKbyte;
+    setGCPolicy(new RssGrowthPolicy(nbKbyte));
   }
 
+  /// Returns the largest resident memory read by this function, in kB.
   static size_t getPeakMemory () {
-    should_garbage();
-    return last_mem;
+    size_t mem = process::getResidentMemory();
+    if (mem > peak_mem_)
+      peak_mem_ = mem;
+    return peak_mem_;
   }
 
   static void addHook (GCHook * hook) {
@@ -149,7 +269,15 @@ public:
 
  private :
   // actually defined in DDD.cpp, bottom of file.
-  static size_t last_mem;
+  static size_t peak_mem_;
+  /// number of calls to garbage(), and their duration in seconds
+  static size_t nb_gc_;
+  static double last_pause_;
+  static double max_pause_;
+  static double total_pause_;
+  /// objects before and after the last collection, see nbObjects()
+  static size_t objects_before_gc_;
+  static size_t objects_after_gc_;
 
 
 };
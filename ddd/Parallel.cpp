@@ -0,0 +1,769 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+#include <vector>
+#include <algorithm>
+
+#include "ddd/Parallel.h"
+
+#ifdef PARALLEL_DD
+# if defined(__has_include) && ! defined(D3_NO_TBB)
+#  if __has_include(<tbb/task_group.h>)
+#   define D3_PARALLEL_TBB 1
+#  endif
+# endif
+#endif
+
+#ifdef PARALLEL_DD
+# include <thread>
+# include <chrono>
+# include <mutex>
+# include <deque>
+# include <memory>
+# include <fstream>
+# include <sstream>
+# include <exception>
+# include <system_error>
+# include <condition_variable>
+# include <stdint.h>
+# if defined(__has_include)
+#  if __has_include(<pthread.h>)
+#   include <pthread.h>
+#   define D3_PARALLEL_PTHREAD 1
+#  endif
+# endif
+# ifdef __linux__
+#  include <sched.h>
+# endif
+# ifdef D3_PARALLEL_TBB
+#  include <tbb/task_group.h>
+#  if __has_include(<tbb/global_control.h>)
+#   include <tbb/global_control.h>
+#   define D3_PARALLEL_TBB_CONTROL 1
+#  endif
+#  if __has_include(<tbb/task_scheduler_observer.h>)
+#   include <tbb/task_scheduler_observer.h>
+#   define D3_PARALLEL_TBB_OBSERVER 1
+#  endif
+# endif
+#endif
+
+namespace d3 { namespace parallel {
+
+namespace {
+  const size_t MIN_GRAIN = 4;
+  const size_t MAX_GRAIN = 1 << 16;
+
+  std::atomic<unsigned> max_wait_ (50);
+
+#ifdef PARALLEL_DD
+  std::atomic<size_t> grain_ (64);
+  std::atomic<bool> adaptive_ (true);
+  std::atomic<bool> node_buffers_ (true);
+  std::atomic<size_t> nb_batches (0), nb_forked (0), nb_tasks (0);
+#else
+  size_t grain_ = 64;
+  size_t nb_batches = 0;
+  context context_;
+#endif
+
+#ifdef PARALLEL_DD
+  /// cuts [0,n) into chunks of about grain weight, as the indexes where chunks end
+  void cut (size_t n, const size_t * weights, size_t grain, std::vector<size_t> & ends) {
+    size_t acc = 0;
+    for (size_t i = 0 ; i < n ; ++i) {
+      acc += weights[i];
+      if (acc >= grain) {
+	ends.push_back(i + 1);
+	acc = 0;
+      }
+    }
+    if (ends.empty() || ends.back() != n)
+      ends.push_back(n);
+  }
+#endif
+
+  void run_chunk (const std::function<void (size_t)> & body, size_t begin, size_t end) {
+    for (size_t i = begin ; i < end ; ++i)
+      body(i);
+  }
+}
+
+#ifdef PARALLEL_DD
+std::atomic<int> active_batches (0);
+
+namespace {
+
+/// The counters of a thread, on a cache line of their own.
+struct slot {
+  std::atomic<size_t> chunks;
+  std::atomic<uint64_t> busy_ns;
+  char pad [64 - sizeof(std::atomic<size_t>) - sizeof(std::atomic<uint64_t>)];
+  slot () : chunks(0), busy_ns(0) {}
+};
+
+#ifdef D3_PARALLEL_TBB_OBSERVER
+class placer;
+#endif
+
+/// What install() sets up from a context.
+struct setup {
+  context ctx;
+  /// ctx.threads resolved
+  unsigned threads;
+  /// the CPUs the workers run on, empty if they are not placed
+  std::vector<int> cpus;
+  /// distinguishes setups, for the thread_local state that refers to one
+  unsigned generation;
+  std::unique_ptr<slot[]> slots;
+  std::atomic<unsigned> next_slot;
+  std::atomic<unsigned> next_worker;
+  std::chrono::steady_clock::time_point since;
+#ifdef D3_PARALLEL_TBB_CONTROL
+  std::unique_ptr<tbb::global_control> parallelism;
+  std::unique_ptr<tbb::global_control> stack;
+#endif
+#ifdef D3_PARALLEL_TBB_OBSERVER
+  std::unique_ptr<placer> observer;
+#endif
+  setup () : threads(1), generation(0), next_slot(0), next_worker(1) {}
+  ~setup ();
+};
+
+std::mutex setup_lock;
+std::atomic<setup *> setup_ (NULL);
+unsigned generations = 0;
+
+#ifdef __linux__
+/// The CPUs of a NUMA node, read from sysfs. Empty if the node is unknown.
+std::vector<int> node_cpus (int node) {
+  std::vector<int> res;
+  std::ostringstream path;
+  path << "/sys/devices/system/node/node" << node << "/cpulist";
+  std::ifstream in (path.str().c_str());
+  std::string list;
+  if (! std::getline(in, list))
+    return res;
+  // ranges as in "0-3,8-11"
+  std::istringstream ranges (list);
+  std::string range;
+  while (std::getline(ranges, range, ',')) {
+    int first = 0, last = 0;
+    char dash = 0;
+    std::istringstream r (range);
+    if (! (r >> first))
+      continue;
+    if (! (r >> dash >> last))
+      last = first;
+    for (int c = first ; c <= last ; ++c)
+      res.push_back(c);
+  }
+  return res;
+}
+
+/// The CPUs the process may run on.
+std::vector<int> process_cpus () {
+  std::vector<int> res;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int c = 0 ; c < CPU_SETSIZE ; ++c)
+      if (CPU_ISSET(c, &set))
+	res.push_back(c);
+  }
+  return res;
+}
+
+void bind (const int * cpus, size_t n) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (size_t i = 0 ; i < n ; ++i)
+    CPU_SET(cpus[i], &set);
+  // 0 is the calling thread
+  sched_setaffinity(0, sizeof(set), &set);
+}
+#endif
+
+/// Places the calling thread, the worker-th worker, on the CPUs of the setup.
+void place (const setup & s, unsigned worker) {
+#ifdef __linux__
+  if (s.cpus.empty())
+    return;
+  if (s.ctx.pin)
+    bind(&s.cpus[worker % s.cpus.size()], 1);
+  else
+    bind(&s.cpus[0], s.cpus.size());
+#else
+  (void) s;
+  (void) worker;
+#endif
+}
+
+#ifdef D3_PARALLEL_TBB_OBSERVER
+/// Places the TBB workers as they join the scheduler.
+class placer : public tbb::task_scheduler_observer {
+  setup & owner_;
+public:
+  placer (setup & s) : owner_(s) {
+    observe(true);
+  }
+  ~placer () {
+    observe(false);
+  }
+  void on_scheduler_entry (bool is_worker) {
+    static thread_local unsigned placed = 0;
+    if (is_worker && placed != owner_.generation) {
+      placed = owner_.generation;
+      place(owner_, owner_.next_worker.fetch_add(1));
+    }
+  }
+};
+#endif
+
+setup::~setup () {
+#ifdef D3_PARALLEL_TBB_OBSERVER
+  observer.reset();
+#endif
+}
+
+setup * make_setup (const context & ctx) {
+  std::unique_ptr<setup> s (new setup);
+  s->ctx = ctx;
+  s->generation = ++generations;
+#ifdef __linux__
+  if (ctx.numa_node >= 0)
+    s->cpus = node_cpus(ctx.numa_node);
+  else if (ctx.pin)
+    s->cpus = process_cpus();
+#endif
+  s->threads = ctx.threads;
+  if (s->threads == 0)
+    s->threads = ctx.numa_node >= 0 && ! s->cpus.empty() ? s->cpus.size() : std::max(1u, std::thread::hardware_concurrency());
+  s->slots.reset(new slot [s->threads]);
+  s->since = std::chrono::steady_clock::now();
+#ifdef D3_PARALLEL_TBB
+  if (! ctx.executor) {
+#ifdef D3_PARALLEL_TBB_CONTROL
+    s->parallelism.reset(new tbb::global_control(tbb::global_control::max_allowed_parallelism, s->threads));
+    if (ctx.stack_size != 0)
+      s->stack.reset(new tbb::global_control(tbb::global_control::thread_stack_size, ctx.stack_size));
+#endif
+#ifdef D3_PARALLEL_TBB_OBSERVER
+    if (! s->cpus.empty())
+      s->observer.reset(new placer(*s));
+#endif
+  }
+#endif
+  return s.release();
+}
+
+/// The setup installed, the default one if none was.
+setup & get_setup () {
+  setup * s = setup_.load(std::memory_order_acquire);
+  if (s == NULL) {
+    std::lock_guard<std::mutex> guard (setup_lock);
+    s = setup_.load();
+    if (s == NULL) {
+      s = make_setup(context());
+      setup_.store(s, std::memory_order_release);
+    }
+  }
+  return *s;
+}
+
+/// The counters of the calling thread, it takes the next free slot when it first runs a chunk.
+slot & my_slot (setup & s) {
+  static thread_local unsigned generation = 0;
+  static thread_local unsigned index = 0;
+  if (generation != s.generation) {
+    generation = s.generation;
+    index = s.next_slot.fetch_add(1) % s.threads;
+  }
+  return s.slots[index];
+}
+
+/// Runs a forked chunk and counts it. Chunks a thread runs within another are not timed again.
+void run_timed (const std::function<void (size_t)> & body, size_t begin, size_t end) {
+  static thread_local unsigned depth = 0;
+  slot & counters = my_slot(get_setup());
+  counters.chunks.fetch_add(1, std::memory_order_relaxed);
+  if (depth != 0) {
+    run_chunk(body, begin, end);
+    return;
+  }
+  struct timer {
+    slot & counters;
+    std::chrono::steady_clock::time_point start;
+    timer (slot & c) : counters(c), start(std::chrono::steady_clock::now()) { ++depth; }
+    ~timer () {
+      --depth;
+      counters.busy_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+				 std::memory_order_relaxed);
+    }
+  } t (counters);
+  run_chunk(body, begin, end);
+}
+
+/// A thread with the given stack size, 0 for the default.
+class worker {
+  std::function<void ()> run_;
+#ifdef D3_PARALLEL_PTHREAD
+  pthread_t id_;
+  static void * start (void * w) {
+    static_cast<worker *>(w)->run_();
+    return NULL;
+  }
+public:
+  worker (const std::function<void ()> & run, size_t stack_size) : run_(run) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // below the minimum of the system, keep the default
+    if (stack_size != 0)
+      pthread_attr_setstacksize(&attr, stack_size);
+    int err = pthread_create(&id_, &attr, &worker::start, this);
+    pthread_attr_destroy(&attr);
+    if (err != 0)
+      throw std::system_error(err, std::generic_category(), "libDDD worker thread");
+  }
+  void join () {
+    pthread_join(id_, NULL);
+  }
+#else
+  std::thread thread_;
+public:
+  worker (const std::function<void ()> & run, size_t) : run_(run), thread_(run) {}
+  void join () {
+    thread_.join();
+  }
+#endif
+};
+
+/// for_each through the executor of a context. Each job submitted runs chunks that no thread
+/// started, as does the calling thread, so jobs the host runs late find nothing left to do and
+/// never touch the body once for_each returned.
+struct batch {
+  const std::function<void (size_t)> * body;
+  std::vector<size_t> ends;
+  std::atomic<size_t> next;
+  std::atomic<size_t> done;
+  std::mutex lock;
+  std::exception_ptr error;
+
+  batch (const std::function<void (size_t)> & b, const std::vector<size_t> & e) : body(&b), ends(e), next(0), done(0) {}
+
+  void help () {
+    for (size_t c = next.fetch_add(1) ; c < ends.size() ; c = next.fetch_add(1)) {
+      try {
+	run_timed(*body, c == 0 ? 0 : ends[c - 1], ends[c]);
+      } catch (...) {
+	std::lock_guard<std::mutex> guard (lock);
+	if (! error)
+	  error = std::current_exception();
+      }
+      done.fetch_add(1);
+    }
+  }
+};
+
+void run_on (const std::function<void (job_t)> & executor, const std::function<void (size_t)> & body, const std::vector<size_t> & ends) {
+  std::shared_ptr<batch> b = std::make_shared<batch>(body, ends);
+  try {
+    for (size_t c = 1 ; c < ends.size() ; ++c)
+      executor([b] { b->help(); });
+  } catch (...) {
+    // the host refused a job, the chunks it would have run are run here
+  }
+  b->help();
+  while (b->done.load() != ends.size())
+    std::this_thread::yield();
+  if (b->error)
+    std::rethrow_exception(b->error);
+}
+
+} // namespace
+
+#ifndef D3_PARALLEL_TBB
+namespace {
+
+/// A work-stealing pool : each thread pushes and pops its own tasks at the back of its queue,
+/// idle threads steal from the front of the others. A thread waiting for its forked tasks runs
+/// tasks meanwhile, so nested for_each calls do not block the pool.
+class pool {
+  struct group {
+    std::atomic<size_t> pending;
+    std::mutex lock;
+    std::exception_ptr error;
+    group (size_t n) : pending(n) {}
+  };
+
+  struct task {
+    const std::function<void (size_t)> * body;
+    size_t begin, end;
+    group * owner;
+  };
+
+  struct queue {
+    std::mutex lock;
+    std::deque<task> tasks;
+  };
+
+  // queue 0 is shared by the threads outside the pool
+  std::vector<std::unique_ptr<queue> > queues_;
+  std::vector<std::unique_ptr<worker> > threads_;
+  std::atomic<bool> stop_;
+  std::atomic<size_t> queued_;
+  std::mutex sleep_lock_;
+  std::condition_variable wake_;
+
+  static thread_local size_t self_;
+
+  void push (const task & t) {
+    queue & q = *queues_[self_];
+    {
+      std::lock_guard<std::mutex> guard (q.lock);
+      q.tasks.push_back(t);
+    }
+    queued_.fetch_add(1);
+    wake_.notify_one();
+  }
+
+  bool pop (task & t) {
+    {
+      queue & q = *queues_[self_];
+      std::lock_guard<std::mutex> guard (q.lock);
+      if (! q.tasks.empty()) {
+	t = q.tasks.back();
+	q.tasks.pop_back();
+	queued_.fetch_sub(1);
+	return true;
+      }
+    }
+    for (size_t k = 1 ; k < queues_.size() ; ++k) {
+      queue & q = *queues_[(self_ + k) % queues_.size()];
+      std::lock_guard<std::mutex> guard (q.lock);
+      if (! q.tasks.empty()) {
+	t = q.tasks.front();
+	q.tasks.pop_front();
+	queued_.fetch_sub(1);
+	return true;
+      }
+    }
+    return false;
+  }
+
+  static void execute (const task & t) {
+    try {
+      run_timed(*t.body, t.begin, t.end);
+    } catch (...) {
+      std::lock_guard<std::mutex> guard (t.owner->lock);
+      if (! t.owner->error)
+	t.owner->error = std::current_exception();
+    }
+    t.owner->pending.fetch_sub(1);
+  }
+
+  bool run_one () {
+    task t;
+    if (! pop(t))
+      return false;
+    execute(t);
+    return true;
+  }
+
+  void work (const setup & s, size_t self) {
+    self_ = self;
+    place(s, self);
+    while (! stop_.load()) {
+      if (! run_one()) {
+	std::unique_lock<std::mutex> guard (sleep_lock_);
+	wake_.wait_for(guard, std::chrono::milliseconds(1), [this] { return stop_.load() || queued_.load() != 0; });
+      }
+    }
+  }
+
+public:
+  /// the workers but the calling thread, with the stack size and CPUs of the setup
+  pool (const setup & s) : stop_(false), queued_(0) {
+    for (unsigned i = 0 ; i < s.threads ; ++i)
+      queues_.push_back(std::unique_ptr<queue> (new queue));
+    for (unsigned i = 1 ; i < s.threads ; ++i)
+      threads_.push_back(std::unique_ptr<worker> (new worker(std::bind(&pool::work, this, std::cref(s), i), s.ctx.stack_size)));
+  }
+
+  ~pool () {
+    stop_.store(true);
+    wake_.notify_all();
+    for (size_t i = 0 ; i < threads_.size() ; ++i)
+      threads_[i]->join();
+  }
+
+  /// forks the chunks but the last, runs the last one here, then helps until all are done
+  void run (const std::function<void (size_t)> & body, const std::vector<size_t> & ends) {
+    group g (ends.size() - 1);
+    size_t begin = 0;
+    for (size_t c = 0 ; c + 1 < ends.size() ; ++c) {
+      task t = { &body, begin, ends[c], &g };
+      push(t);
+      begin = ends[c];
+    }
+    std::exception_ptr error;
+    try {
+      run_timed(body, begin, ends.back());
+    } catch (...) {
+      error = std::current_exception();
+    }
+    while (g.pending.load() != 0) {
+      if (! run_one())
+	std::this_thread::yield();
+    }
+    if (! error)
+      error = g.error;
+    if (error)
+      std::rethrow_exception(error);
+  }
+};
+
+thread_local size_t pool::self_ = 0;
+
+std::mutex pool_lock;
+std::unique_ptr<pool> the_pool;
+
+pool & get_pool () {
+  const setup & s = get_setup();
+  std::lock_guard<std::mutex> guard (pool_lock);
+  if (! the_pool)
+    the_pool.reset(new pool(s));
+  return *the_pool;
+}
+
+} // namespace
+#endif // D3_PARALLEL_TBB
+#endif // PARALLEL_DD
+
+void install (const context & ctx) {
+#ifdef PARALLEL_DD
+  std::lock_guard<std::mutex> guard (setup_lock);
+#ifndef D3_PARALLEL_TBB
+  {
+    // the workers refer to the setup
+    std::lock_guard<std::mutex> guard (pool_lock);
+    the_pool.reset();
+  }
+#endif
+  delete setup_.exchange(NULL);
+  setup_.store(make_setup(ctx));
+#else
+  context_ = ctx;
+#endif
+}
+
+context current () {
+#ifdef PARALLEL_DD
+  return get_setup().ctx;
+#else
+  return context_;
+#endif
+}
+
+unsigned threads () {
+#ifdef PARALLEL_DD
+  return get_setup().threads;
+#else
+  return 1;
+#endif
+}
+
+void set_threads (unsigned n) {
+  context ctx = current();
+  ctx.threads = n;
+  install(ctx);
+}
+
+size_t grain () {
+#ifdef PARALLEL_DD
+  return grain_.load();
+#else
+  return grain_;
+#endif
+}
+
+void set_grain (size_t g, bool adaptive) {
+  g = std::min(std::max(g, MIN_GRAIN), MAX_GRAIN);
+#ifdef PARALLEL_DD
+  grain_.store(g);
+  adaptive_.store(adaptive);
+#else
+  grain_ = g;
+  (void) adaptive;
+#endif
+}
+
+bool worth_forking (size_t total_weight) {
+  return threads() > 1 && total_weight >= 2 * grain();
+}
+
+void for_each (size_t n, const size_t * weights, const std::function<void (size_t)> & body) {
+#ifdef PARALLEL_DD
+  nb_batches.fetch_add(1);
+  std::vector<size_t> ends;
+  if (threads() > 1)
+    cut(n, weights, grain(), ends);
+  if (ends.size() < 2) {
+    run_chunk(body, 0, n);
+    return;
+  }
+  nb_forked.fetch_add(1);
+  nb_tasks.fetch_add(ends.size() - 1);
+  active_batches.fetch_add(1);
+  thread_state & self = this_thread();
+  self.forking.fetch_add(1);
+  struct leave {
+    thread_state & self;
+    ~leave () {
+      self.forking.fetch_sub(1);
+      active_batches.fetch_sub(1);
+    }
+  } guard = { self };
+  const setup & s = get_setup();
+  if (s.ctx.executor) {
+    run_on(s.ctx.executor, body, ends);
+    return;
+  }
+#ifdef D3_PARALLEL_TBB
+  tbb::task_group group;
+  size_t begin = 0;
+  for (size_t c = 0 ; c + 1 < ends.size() ; ++c) {
+    size_t end = ends[c];
+    group.run([&body, begin, end] { run_timed(body, begin, end); });
+    begin = end;
+  }
+  try {
+    run_timed(body, begin, n);
+  } catch (...) {
+    try {
+      group.wait();
+    } catch (...) {
+    }
+    throw;
+  }
+  group.wait();
+#else
+  get_pool().run(body, ends);
+#endif
+#else
+  (void) weights;
+  ++nb_batches;
+  run_chunk(body, 0, n);
+#endif
+}
+
+void record (size_t items, size_t misses) {
+#ifdef PARALLEL_DD
+  if (! adaptive_.load() || items == 0)
+    return;
+  size_t g = grain_.load();
+  if (misses < items) {
+    // mostly cache hits, the items are cheap : fewer, larger chunks
+    g = std::min(g * 2, MAX_GRAIN);
+  } else if (misses > 8 * items) {
+    // every item computes a lot : smaller chunks balance better
+    g = std::max(g / 2, MIN_GRAIN);
+  }
+  grain_.store(g);
+#else
+  (void) items;
+  (void) misses;
+#endif
+}
+
+thread_state & this_thread () {
+  static thread_local thread_state state;
+  return state;
+}
+
+unsigned max_wait () {
+  return max_wait_.load(std::memory_order_relaxed);
+}
+
+void set_max_wait (unsigned ms) {
+  max_wait_.store(ms);
+}
+
+bool node_buffers () {
+#ifdef PARALLEL_DD
+  return node_buffers_.load(std::memory_order_relaxed) && threads() > 1;
+#else
+  return false;
+#endif
+}
+
+void set_node_buffers (bool use) {
+#ifdef PARALLEL_DD
+  node_buffers_.store(use);
+#else
+  (void) use;
+#endif
+}
+
+stats_t stats () {
+  stats_t res;
+#ifdef PARALLEL_DD
+  res.batches = nb_batches.load();
+  res.forked = nb_forked.load();
+  res.tasks = nb_tasks.load();
+#else
+  res.batches = nb_batches;
+#endif
+  res.grain = grain();
+  return res;
+}
+
+std::vector<worker_stats_t> worker_stats () {
+  std::vector<worker_stats_t> res;
+#ifdef PARALLEL_DD
+  const setup & s = get_setup();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - s.since).count();
+  for (unsigned i = 0 ; i < s.threads ; ++i) {
+    worker_stats_t w;
+    w.chunks = s.slots[i].chunks.load();
+    w.busy = s.slots[i].busy_ns.load() * 1e-9;
+    w.utilization = elapsed > 0 ? w.busy / elapsed : 0;
+    res.push_back(w);
+  }
+#endif
+  return res;
+}
+
+void pstats (std::ostream & os) {
+  stats_t s = stats();
+  os << "Parallel evaluation : " << threads() << " threads, " << s.forked << "/" << s.batches
+     << " batches forked in " << s.tasks << " tasks, grain " << s.grain << std::endl;
+  std::vector<worker_stats_t> workers = worker_stats();
+  if (workers.size() > 1) {
+    os << "Worker utilization :";
+    for (size_t i = 0 ; i < workers.size() ; ++i)
+      os << " " << int(100 * workers[i].utilization) << "% (" << workers[i].chunks << " chunks)";
+    os << std::endl;
+  }
+}
+
+}} // namespace d3::parallel
@@ -0,0 +1,160 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <functional>
+#include <ostream>
+#include <vector>
+#include <atomic>
+#include <stddef.h>
+
+/// Fork/join evaluation of the sons of a node, used by _GHom::eval_skip and _GShom::eval_skip
+/// when the library is built with PARALLEL_DD. Tasks run on TBB when its headers are found
+/// (current oneTBB or older TBB), else on a built-in work-stealing pool of std::thread.
+/// Without PARALLEL_DD everything here is sequential.
+///
+/// How the work runs is set by installing a context : the number of threads, the stack size
+/// and placement of the workers, or a thread pool of the host application to run on instead.
+///
+/// The work of a son is estimated by a weight, its number of arcs. The sons of a node are only
+/// forked when their total weight reaches twice the grain, in chunks of about the grain. The
+/// grain adapts to the cache misses the forked work causes : sons that mostly hit the cache are
+/// cheap and are grouped in larger chunks.
+namespace d3 { namespace parallel {
+
+  /// A job submitted to the executor of a context.
+  typedef std::function<void ()> job_t;
+
+  /// The execution context : what runs the forked work, see install().
+  struct context {
+    /// The number of threads that evaluate, the calling thread included. 0 for the hardware
+    /// concurrency, or for the number of CPUs of numa_node when it is set.
+    unsigned threads;
+    /// The stack size of the worker threads in bytes, 0 for the system default. Evaluation
+    /// recurses once per level of the decision diagram, deep models need large stacks.
+    size_t stack_size;
+    /// The NUMA node whose CPUs the workers run on, -1 for any CPU. Linux only.
+    int numa_node;
+    /// If true, each worker is bound to a single CPU (of numa_node if it is set). Linux only.
+    bool pin;
+    /// If set, forked chunks are submitted to it instead of to the workers of the library, so
+    /// that the library runs in the thread pool of the host application ; threads should then
+    /// be the parallelism of that pool. The jobs may run late and in any order : the calling
+    /// thread also runs the chunks that no job started yet, and jobs that find none left return
+    /// at once. The other fields do not apply to the threads of the host.
+    std::function<void (job_t)> executor;
+
+    context (unsigned n = 0) : threads(n), stack_size(0), numa_node(-1), pin(false) {}
+  };
+
+  /// Installs a context, replacing the workers of the previous one. To be called before
+  /// evaluating, not while a computation runs. A default context is installed on first use.
+  void install (const context & ctx);
+  /// The context installed.
+  context current ();
+
+  /// The number of threads that evaluate, the calling thread included.
+  unsigned threads ();
+  /// Installs the current context with n threads, 0 for the hardware concurrency.
+  void set_threads (unsigned n);
+
+  /// The weight of a chunk of forked work.
+  size_t grain ();
+  /// Sets the grain, and whether it adapts to cache misses afterwards.
+  void set_grain (size_t g, bool adaptive = true);
+
+  /// True if items of this total weight are worth forking.
+  bool worth_forking (size_t total_weight);
+
+  /// Runs body(i) for i in [0,n), in chunks of about grain() weight given weights[i]. The calling
+  /// thread runs chunks too and returns once all are done. An exception thrown by a body is
+  /// rethrown here after the other chunks complete.
+  void for_each (size_t n, const size_t * weights, const std::function<void (size_t)> & body);
+
+  /// Tunes the grain : a forked batch of items caused this many cache misses.
+  void record (size_t items, size_t misses);
+
+  /// What a thread publishes for the others, to decide whether to wait for a computation it
+  /// runs (see d3::util::in_flight).
+  struct thread_state {
+    /// the thread it waits for, NULL if none
+    std::atomic<const thread_state *> waits_on;
+    /// the number of for_each with forked chunks it is running
+    std::atomic<unsigned> forking;
+    thread_state () : waits_on(NULL), forking(0) {}
+  };
+  /// The state of the calling thread.
+  thread_state & this_thread ();
+
+  /// How long, in ms, a thread waits for a computation running on another one before it
+  /// computes it again. 50 by default.
+  unsigned max_wait ();
+  void set_max_wait (unsigned ms);
+
+  /// True if threads create DDD nodes through a buffer of their own (see UniqueTableId), which
+  /// is the case by default when more than one thread evaluates.
+  bool node_buffers ();
+  /// Sets whether threads use node buffers. To be called before evaluating.
+  void set_node_buffers (bool use);
+
+#ifdef PARALLEL_DD
+  /// the number of for_each running with forked chunks
+  extern std::atomic<int> active_batches;
+  /// True while forked work may run. Garbage collection must not happen then.
+  inline bool active () { return active_batches.load(std::memory_order_relaxed) != 0; }
+#else
+  inline bool active () { return false; }
+#endif
+
+  /// Counts of batches.
+  struct stats_t {
+    /// for_each calls, and those that forked
+    size_t batches;
+    size_t forked;
+    /// chunks forked as tasks
+    size_t tasks;
+    /// the current grain
+    size_t grain;
+    stats_t () : batches(0), forked(0), tasks(0), grain(0) {}
+  };
+  stats_t stats ();
+
+  /// What a thread did since the context was installed.
+  struct worker_stats_t {
+    /// forked chunks run
+    size_t chunks;
+    /// seconds spent running them, and the share of the elapsed time it represents
+    double busy;
+    double utilization;
+    worker_stats_t () : chunks(0), busy(0), utilization(0) {}
+  };
+  /// One entry per thread of the context, in the order threads first ran a chunk. Threads of
+  /// the host beyond the declared count share the entries.
+  std::vector<worker_stats_t> worker_stats ();
+
+  void pstats (std::ostream & os);
+
+}} // namespace d3::parallel
+
+#endif /* __PARALLEL_H__ */
@@ -29,6 +29,10 @@
 #include <sstream>
 #include <cassert>
 #include <typeinfo>
+#include <atomic>
+#include <unordered_set>
+#include <unordered_map>
+#include <limits>
 
 #include "ddd/SDED.h"
 #include "ddd/SDD.h"
@@ -38,11 +42,13 @@
 #include "ddd/SHom.h"
 #include "ddd/util/hash_support.hh"
 #include "ddd/util/ext_hash_map.hh"
+#include "ddd/util/snapshot.hh"
+#include "ddd/Parallel.h"
 
 
 #ifdef REENTRANT
-#include "tbb/atomic.h"
-#include "tbb/queuing_rw_mutex.h"
+#include <atomic>
+#include <mutex>
 #endif
 
 
@@ -195,26 +201,50 @@ void mark_if_refd () const {
 
 
 // map<int,string> mapVarName;
-#ifdef REENTRANT
 
-static tbb::atomic<size_t> Max_SDD;
-class SDD_parallel_init
-{
-public:
-	 
-	SDD_parallel_init()
-	{
-		Max_SDD = 0;
-	}
-		
-};
-static SDD_parallel_init SDD_init;
+static UniqueTable<_GSDD> canonical;
+
+#ifdef PARALLEL_DD
+namespace {
+  /// Incremented by every sweep of canonical, to drop the node caches of the threads.
+  std::atomic<size_t> sweep_epoch (0);
 
-#else
-static size_t Max_SDD=0;
+  /// The nodes a thread looked up recently, checked before taking the lock of canonical.
+  struct node_cache {
+    static const size_t size = 1024;
+    size_t epoch;
+    size_t hashes [size];
+    const _GSDD * nodes [size];
+  };
+}
 #endif
 
-static UniqueTable<_GSDD> canonical;
+/// The canonical node equal to g. With node buffers, see d3::parallel::node_buffers(),
+/// a thread looks it up in its own cache first.
+static const _GSDD * unique_node (const _GSDD & g) {
+#ifdef PARALLEL_DD
+  if (d3::parallel::node_buffers()) {
+    static thread_local node_cache cache = node_cache();
+    size_t epoch = sweep_epoch.load(std::memory_order_acquire);
+    if (cache.epoch != epoch) {
+      std::fill(cache.nodes, cache.nodes + node_cache::size, (const _GSDD *) NULL);
+      cache.epoch = epoch;
+    }
+    size_t h = g.hash();
+    size_t c = ddd::wang32_hash(h) & (node_cache::size - 1);
+    const _GSDD * res = cache.nodes[c];
+    if (res != NULL && cache.hashes[c] == h && *res == g) {
+      return res;
+    }
+    res = canonical(g);
+    cache.hashes[c] = h;
+    cache.nodes[c] = res;
+    return res;
+  }
+#endif
+  return canonical(g);
+}
+
 namespace sns{
   UniqueTable<_GShom> canonical;
 }
@@ -272,10 +302,13 @@ void _GSDD::mark()const{
 }
 
 size_t GSDD::peak() {
- if (canonical.size() > Max_SDD) 
-    Max_SDD=canonical.size();  
+  return canonical.peak();
+}
 
-  return Max_SDD;
+void GSDD::snapshot(d3::memory_snapshot_t & snap)
+{
+  // the arcs of a node are not counted
+  snap.tables.push_back(d3::memory_snapshot_t::table_t("SDD", statistics(), peak(), statistics() * sizeof(_GSDD)));
 }
 
 void GSDD::pstats(bool)
@@ -326,14 +359,14 @@ std::ostream& operator<<(std::ostream &os,const GSDD &g){
 GSDD::GSDD(const _GSDD *_g):concret(_g){
 } 
 
-GSDD::GSDD(const _GSDD &_g):concret(canonical(_g)){ 
+GSDD::GSDD(const _GSDD &_g):concret(unique_node(_g)){ 
 }
 
 
 
 GSDD::GSDD(int variable,Valuation value){
   
-  concret= value.size() != 0 ?  canonical(_GSDD(variable,value)) : null.concret;
+  concret= value.size() != 0 ?  unique_node(_GSDD(variable,value)) : null.concret;
 }
 
 
@@ -343,7 +376,7 @@ GSDD::GSDD(int var,const DataSet &val,const GSDD &d):concret(null.concret){ //va
     // cast to (DataSet*) to lose "const" type
     std::pair<DataSet *, GSDD> x( val.newcopy(),d);
     _g.valuation.push_back(x);
-    concret=canonical(_g);    
+    concret=unique_node(_g);    
   }
   //  concret->refCounter++;
 }
@@ -355,7 +388,7 @@ GSDD::GSDD(int var,const GSDD &va,const GSDD &d):concret(null.concret){ //var-va
     // cast to (DataSet*) to lose "const" type
     std::pair<DataSet *, GSDD> x( val.newcopy(),d);
     _g.valuation.push_back(x);
-    concret=canonical(_g);    
+    concret=unique_node(_g);    
   }
   //  concret->refCounter++;
 }
@@ -366,7 +399,7 @@ GSDD::GSDD(int var,const SDD &val,const GSDD &d):concret(null.concret){ //var-va
     // cast to (DataSet*) to lose "const" type
     std::pair<DataSet *, GSDD> x( val.newcopy(),d);
     _g.valuation.push_back(x);
-    concret=canonical(_g);    
+    concret=unique_node(_g);    
   }
   //  concret->refCounter++;
 }
@@ -406,174 +439,264 @@ unsigned int GSDD::refCounter() const{
   return concret->refCounter();
 }
 
+/// Counts the nodes of an SDD and of the DDD and SDD on its arcs, with explicit stacks.
+/// An instance counts one SDD, there is no shared state.
 class SddSize{
 private:
-
-  bool firstError;
-  d3::set<GSDD>::type s;
+  std::unordered_set<GSDD, d3::util::hash<GSDD> > s;
   // Was used to compute number of nodes in referenced datasets as well
   // but dataset doesn't define what we need as it is not necessarily 
   // a decision diagram implementation => number of nodes = ??
-//   set<DataSet &> sd3;
   // trying to repair it : consider we reference only SDD or DDD for now, corresponds to current usage patterns
-  d3::set<GDDD>::type sd3;
+  std::unordered_set<GDDD, d3::util::hash<GDDD> > sd3;
+  std::vector<GSDD> todo;
+  std::vector<GDDD> todo3;
 
-
-
-  void sddsize(const GSDD& g)
-{
-    if(s.find(g)==s.end()){
-      s.insert(g);
+  void visit (const GSDD & g) {
+    if (s.insert(g).second) {
       res++;
-      for(GSDD::const_iterator gi=g.begin();gi!=g.end();++gi) 
-	sddsize(gi->first);
-      
-      for(GSDD::const_iterator gi=g.begin();gi!=g.end();++gi)
-	sddsize(gi->second);
-      
+      todo.push_back(g);
     }
   }
 
-  void sddsize(const DataSet* g)
-{
+  void visit (const GDDD & g) {
+    if (sd3.insert(g).second) {
+      d3res++;
+      todo3.push_back(g);
+    }
+  }
+
+  void visit (const DataSet* g) {
     // Used to work for referenced DDD
-    if (typeid(*g) == typeid(GSDD) ) {
-      sddsize( GSDD ((SDD &) *g) );
+    if (typeid(*g) == typeid(GSDD) || typeid(*g) == typeid(SDD)) {
+      visit( GSDD ((const GSDD &) *g) );
     } else if (typeid(*g) == typeid(DDD)) {
-      sddsize( GDDD ((DDD &) *g) );
+      visit( GDDD ((const DDD &) *g) );
     } else if (typeid(*g) == typeid(IntDataSet)) {
       // nothing, no nodes for this implem
     } else {
-      if (firstError) {
+      static std::atomic<bool> warned (false);
+      if (! warned.exchange(true)) {
         std::cerr << "Warning : unknown referenced dataset type on arc, node count is inacurate"<<std::endl;
         std::cerr << "Read type :" << typeid(*g).name() <<std::endl ;
-	firstError = false;
       }
     }
   }
 
-  void sddsize(const GDDD& g)
-	{
-      if (sd3.find(g)==sd3.end()) {
-	sd3.insert(g);
-	d3res ++;
-	for(GDDD::const_iterator gi=g.begin();gi!=g.end();++gi)
-	  sddsize(gi->second);
-      }
-  }
-
 public:
   unsigned long int res;
   unsigned long int d3res;
 
-	SddSize()
-		:
-		firstError(true), res(0), d3res(0)
-	{
-	};
-//  pair<unsigned long int,unsigned long int> operator()(const GSDD& g){
-	unsigned long int operator()(const GSDD& g){
-#ifndef REENTRANT
-    res=0;
-    d3res=0;
-    sd3.clear();
-    s.clear();
-#endif
-    sddsize(g);
-    // we used to return a pair : number of nodes in SDD, number of nodes in referenced data structures
-//    return make_pair(res,d3res);
-    return res;
+  SddSize() : res(0), d3res(0) {}
+
+  void operator()(const GSDD& g){
+    visit(g);
+    while (! todo.empty() || ! todo3.empty()) {
+      if (! todo.empty()) {
+	GSDD n = todo.back();
+	todo.pop_back();
+	for(GSDD::const_iterator gi=n.begin();gi!=n.end();++gi) {
+	  visit(gi->first);
+	  visit(gi->second);
+	}
+      } else {
+	GDDD n = todo3.back();
+	todo3.pop_back();
+	for(GDDD::const_iterator gi=n.begin();gi!=n.end();++gi)
+	  visit(gi.son());
+      }
+    }
   }
 };
 
 
 std::pair<unsigned long int,unsigned long int> GSDD::node_size() const{
-#ifndef REENTRANT
-	static 
-#endif
-	SddSize sddsize;
-	sddsize(*this);
-	return std::make_pair(sddsize.res,sddsize.d3res);
+  SddSize sddsize;
+  sddsize(*this);
+  // number of nodes in SDD, number of nodes in referenced data structures
+  return std::make_pair(sddsize.res,sddsize.d3res);
 }
 
 // old prototype
 // pair<unsigned long int,unsigned long int> GSDD::size() const{
 unsigned long int GSDD::size() const{
-  static SddSize sddsize;
-  return sddsize(*this);
-}
+  SddSize sddsize;
+  sddsize(*this);
+  return sddsize.res;
+}
+
+/// Computes nbStates() and the other counts with an explicit stack. Counts are kept in side
+/// tables, the counts of the nodes that survive a garbage collection are kept, see sweep().
+/// The size of the sets on arcs may be an SDD count, so the lock is recursive.
+class SddCounts{
+  /// \name The counts : the value of terminals, and how an arc adds to the count of a node.
+  //@{
+  /// number of paths to one, weighted by the size of the sets on arcs
+  struct paths {
+    typedef long double value_t;
+    static value_t zero () { return 0; }
+    static value_t one () { return 1; }
+    static void add (value_t & sum, const DataSet & set, const value_t & son) { sum += set.set_size() * son; }
+  };
+  /// exact number of paths
+  struct exact_paths {
+    typedef d3::bigcount value_t;
+    static value_t zero () { return 0; }
+    static value_t one () { return 1; }
+    static void add (value_t & sum, const DataSet & set, const value_t & son) { sum += set.set_exact_size() * son; }
+  };
+  /// number of paths as a base 2 logarithm
+  struct log2_paths {
+    typedef double value_t;
+    static value_t zero () { return - std::numeric_limits<double>::infinity(); }
+    static value_t one () { return 0; }
+    static void add (value_t & sum, const DataSet & set, const value_t & son) { sum = d3::log2_add(sum, set.set_log2_size() + son); }
+  };
+  //@}
+
+  template <typename Count>
+  static std::unordered_map<GSDD, typename Count::value_t, d3::util::hash<GSDD> > & table () {
+    static std::unordered_map<GSDD, typename Count::value_t, d3::util::hash<GSDD> > t;
+    return t;
+  }
+#ifdef REENTRANT
+  static std::recursive_mutex & mutex () {
+    static std::recursive_mutex m;
+    return m;
+  }
+#endif
 
-class MySDDNbStates{
-private:
-  int val; // val=0 donne nbState , val=1 donne noSharedSize
-  typedef ext_hash_map<GSDD,long double> cache_type;
-  static cache_type cache;
-	
-long double nbStates(const GSDD& g)
-{
-	if(g==GSDD::one)
-		return 1;
-	else if(g==GSDD::top || g==GSDD::null)
-		return 0;
-	else
-	{
-	  cache_type::accessor access;  
-	  cache.find(access,g);
-	  if( access.empty() ) {
-	    long double res=0;
-	    for(GSDD::const_iterator gi=g.begin();gi!=g.end();++gi)
-	      res+=(gi->first->set_size())*nbStates(gi->second)+val;
-	    cache.insert(access,g);
-	    access->second = res;
-	    return res;
-	  } 
-		else 
-		{
-			return access->second;
-		}
-	}
-}
+  struct frame {
+    GSDD node;
+    GSDD::const_iterator it;
+    frame (const GSDD & g) : node(g), it(g.begin()) {}
+  };
+
+  /// The count of a node that is a terminal or has a count.
+  template <typename Count>
+  static bool find (const GSDD & g, typename Count::value_t & res) {
+    if (g == GSDD::one) {
+      res = Count::one();
+      return true;
+    } else if (g == GSDD::top || g == GSDD::null) {
+      res = Count::zero();
+      return true;
+    }
+    typename std::unordered_map<GSDD, typename Count::value_t, d3::util::hash<GSDD> >::const_iterator it = table<Count>().find(g);
+    if (it == table<Count>().end())
+      return false;
+    res = it->second;
+    return true;
+  }
+
+  template <typename Count>
+  static void sweep_table () {
+    typedef std::unordered_map<GSDD, typename Count::value_t, d3::util::hash<GSDD> > table_t;
+    table_t & t = table<Count>();
+    for (typename table_t::iterator it = t.begin() ; it != t.end() ; ) {
+      if (it->first.is_marked())
+	++it;
+      else
+	it = t.erase(it);
+    }
+  }
 
 public:
-  MySDDNbStates(int v):val(v){};
-  long double operator()(const GSDD& g){
-    long double res=nbStates(g);
-//    s.clear();
+  template <typename Count>
+  static typename Count::value_t count (const GSDD & g) {
+    typedef typename Count::value_t value_t;
+#ifdef REENTRANT
+    std::lock_guard<std::recursive_mutex> lock(mutex());
+#endif
+    value_t res = Count::zero();
+    if (find<Count>(g, res))
+      return res;
+    std::vector<frame> stack;
+    stack.push_back(frame(g));
+    while (! stack.empty()) {
+      frame & f = stack.back();
+      while (f.it != f.node.end() && find<Count>(f.it->second, res))
+	++f.it;
+      if (f.it != f.node.end()) {
+	GSDD son = f.it->second;
+	stack.push_back(frame(son));
+	continue;
+      }
+      // all sons have a count
+      value_t sum = Count::zero();
+      for(GSDD::const_iterator gi=f.node.begin();gi!=f.node.end();++gi) {
+	find<Count>(gi->second, res);
+	Count::add(sum, *gi->first, res);
+      }
+      table<Count>()[f.node] = sum;
+      stack.pop_back();
+    }
+    find<Count>(g, res);
     return res;
   }
 
-  static void clear () {
-    cache.clear();
+  static long double nbStates (const GSDD & g) {
+    return count<paths>(g);
   }
-};
 
-ext_hash_map<GSDD,long double> MySDDNbStates::cache = ext_hash_map<GSDD,long double> ();
+  static d3::bigcount exactNbStates (const GSDD & g) {
+    return count<exact_paths>(g);
+  }
+
+  static double log2NbStates (const GSDD & g) {
+    return count<log2_paths>(g);
+  }
+
+  /// Forget the counts of the nodes that die in the ongoing collection.
+  static void sweep () {
+#ifdef REENTRANT
+    std::lock_guard<std::recursive_mutex> lock(mutex());
+#endif
+    sweep_table<paths>();
+    sweep_table<exact_paths>();
+    sweep_table<log2_paths>();
+  }
+};
 
 long double GSDD::nbStates() const{
-  static MySDDNbStates myNbStates(0);
-  return myNbStates(*this);
+  return SddCounts::nbStates(*this);
+}
+
+d3::bigcount GSDD::exactNbStates() const{
+  return SddCounts::exactNbStates(*this);
+}
+
+double GSDD::log2NbStates() const{
+  return SddCounts::log2NbStates(*this);
 }
 
 
+bool GSDD::is_marked()const{
+  return concret->is_marked();
+}
+
 void GSDD::garbage(){
-  if (canonical.size() > Max_SDD) 
-    Max_SDD=canonical.size();  
+  mark_roots();
+  sweep();
+}
 
-  MySDDNbStates::clear();
-  // mark phase
+void GSDD::mark_roots(){
   for(UniqueTable<_GSDD>::Table::iterator di=canonical.table.begin();di!=canonical.table.end();++di){
     (*di)->mark_if_refd();
   }
+}
 
-  
-
-  // sweep phase  
+void GSDD::sweep(){
+  SddCounts::sweep();
+#ifdef PARALLEL_DD
+  sweep_epoch.fetch_add(1, std::memory_order_release);
+#endif
   for(UniqueTable<_GSDD>::Table::iterator di=canonical.table.begin();di!=canonical.table.end();){
     if(! (*di)->is_marked()){
       UniqueTable<_GSDD>::Table::iterator ci=di;
       ++di;
       const _GSDD *g=(*ci);
-      canonical.table.erase(ci);
+      canonical.erase(ci);
       delete g;
     }
     else{
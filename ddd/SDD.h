@@ -28,6 +28,8 @@
 #include <string>
 
 #include "ddd/UniqueTable.h"
+
+namespace d3 { struct memory_snapshot_t; }
 #include "ddd/DataSet.h"
 
 
@@ -175,6 +177,11 @@ public:
   size_t nbsons () const;
   /// Returns the number of states or paths represented by a given node.
   long double nbStates() const;
+  /// Returns the exact number of states, long double loses precision above 2^64 states.
+  /// The size of the sets on arcs is given by DataSet::set_exact_size().
+  d3::bigcount exactNbStates() const;
+  /// Returns the base 2 logarithm of the number of states, -infinity for GSDD::null.
+  double log2NbStates() const;
 #ifdef HEIGHTSDD
   /// Returns the height of the SDD node = max(son.height()) + 1
   /// Terminals 0,1,T have height 0 by definition
@@ -207,10 +214,18 @@ public:
   /// For garbage collection, do not call this directly, use MemoryManager::garbage() instead.
   /// \todo describe garbage collection algorithm(s) + mark usage homogeneously in one place.
   static void garbage();
+  /// The two phases of garbage(), caches may be swept in between using is_marked().
+  static void mark_roots();
+  static void sweep();
+  /// For garbage collection internals. Whether a GSDD survives the ongoing collection,
+  /// only meaningful between mark_roots() and sweep().
+  bool is_marked() const;
   /// Prints some statistics to std::cout. Mostly used in debug and development phase.
   /// See also MemoryManager::pstats().
   /// \todo allow output in other place than cout. Clean up output.
   static void pstats(bool reinit=true);
+  /// Adds the unicity table to a snapshot of the memory, see MemoryManager::snapshot().
+  static void snapshot(d3::memory_snapshot_t & snap);
   /// Returns the peak size of the DDD unicity table. This value is maintained up to date upon GarbageCollection.
   static size_t peak();
 
@@ -243,6 +258,10 @@ public:
   bool set_less_than (const DataSet & b) const ;
   /// Compares to DataSet for equality.
   long double set_size() const;
+  /// Exact size of the SDD, see exactNbStates().
+  d3::bigcount set_exact_size() const { return exactNbStates(); }
+  /// Size of the SDD as a base 2 logarithm, see log2NbStates().
+  double set_log2_size() const { return log2NbStates(); }
   /// Returns a hash key for the SDD.
   size_t set_hash() const;
   /// Textual (human readable) output of a SDD.
@@ -320,6 +339,19 @@ public:
 
 };
 
+/// \name Binary serialization.
+//@{
+/// Save a set of SDD to a binary stream, see Serialization.h. Each SDD node, and each DDD or SDD
+/// found on arcs at any level of the hierarchy, is written once. Other DataSet on arcs are
+/// written by the codec registered for their type in DataSetRegistry.
+/// Throws std::invalid_argument if no codec handles a DataSet on an arc.
+void saveSDDBinary(std::ostream&, const std::vector<SDD>&);
+/// Load a set of SDD saved by saveSDDBinary, list is resized to the number of saved SDD.
+/// Throws std::runtime_error if the stream is not in this format, is corrupted, or
+/// names a codec that is not registered.
+void loadSDDBinary(std::istream&, std::vector<SDD>&);
+//@}
+
 /// Namespace declared to hide these functions. 
 /// It is not very nice to access unicity table directly, these functions were exposed to allow graphical dot export of the unicity table contents.
 namespace SDDutil {
@@ -23,6 +23,9 @@
 /* -*- C++ -*- */
 #include <set>
 #include <map>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
 #include <typeinfo>
 #include <cassert>
 #include <iostream>
@@ -34,10 +37,12 @@
 #include "ddd/SDED.h"
 #include "ddd/SHom.h"
 
-#include "ddd/UniqueTable.h"
+#include "ddd/util/sharded_table.hh"
+#include "ddd/util/cache_policy.hh"
+#include "ddd/util/op_stats.hh"
 
 #ifdef REENTRANT
-# include "tbb/atomic.h"
+# include <atomic>
 #endif
 
 /******************************************************************************/
@@ -52,51 +57,42 @@ public:
   virtual size_t hash() const =0;
   virtual bool operator==(const _SDED &) const=0;
   virtual _SDED * clone () const =0;
+  /* Memory Manager : true if the operands and the result survive the ongoing garbage collection */
+  virtual bool is_live() const =0;
+  /* Stats : the kind of operation, to count cache hits per kind */
+  virtual SDED::op_kind kind() const =0;
   /* Transform */
   virtual GSDD eval() const  = 0; 
 
 };
 
-typedef UniqueTable<_SDED> SDEDtable;
+typedef d3::util::sharded_table<_SDED> SDEDtable;
 
 static SDEDtable uniqueSDED;
 
 
 namespace namespace_SDED {
     
-#ifdef REENTRANT
-
-  static tbb::atomic<int> Hits;
-  static tbb::atomic<int> Misses;
-  static tbb::atomic<size_t> Max_SDED;
-  
-  class SDED_parallel_init
-  {
-  public:
-    
-    SDED_parallel_init()
-    {
-      Hits = 0;
-      Misses = 0;
-      Max_SDED = 0;
-    }
-    
-  };
-  static SDED_parallel_init SDED_init;
-  
-#else
-  
-static int Hits=0;
-static int Misses=0;
-static size_t Max_SDED=0;
+  /// per kind counters of the operation cache
+  struct SDED_counters_tag {};
+  static d3::op_counters<SDED_counters_tag, SDED::NB_OP_KINDS> counters;
+  static const char * const op_kind_names [SDED::NB_OP_KINDS] = { "Add", "Mult", "Minus", "Concat" };
 
-
-#endif
+  /// peak size of the table, recorded before it shrinks
+  static d3::stat_counter_t Max_SDED (0);
 
 } //namespace namespace_SDED 
 
 static GSDD compute (const _SDED & op) {
-  return uniqueSDED(op)->result;  
+  bool found;
+  const _SDED * res = uniqueSDED(op, found);
+  if (found) {
+    namespace_SDED::counters.hit(op.kind());
+  } else {
+    namespace_SDED::counters.miss(op.kind());
+    namespace_SDED::counters.insertion(op.kind());
+  }
+  return res->result;  
 }
 
 /******************** BASIS FOR CANONIZATION OPERATIONS **********************/
@@ -161,6 +157,13 @@ public:
   size_t hash() const;
   bool operator==(const _SDED &e)const;
   _SDED * clone () const { auto res = new _SDED_Add(*this); res->result = res->eval() ; return res; }
+  SDED::op_kind kind() const { return SDED::OP_ADD; }
+  bool is_live() const {
+    for (std::vector<GSDD>::const_iterator it = parameters.begin() ; it != parameters.end() ; ++it)
+      if (! it->is_marked())
+	return false;
+    return result.is_marked();
+  }
 
   /* Transform */
   GSDD eval() const;
@@ -186,54 +189,164 @@ bool _SDED_Add::operator==(const _SDED &e)const{
 }
 
 /* Transform */
+namespace {
+
+/// The DataSets met during one square union, hash-consed so that equal sets share an index and
+/// set equality is an integer compare. Labels of the operands are borrowed, the sets computed
+/// here are owned, and intersections, differences and unions are memoized by pairs of indexes.
+class dataset_arena {
+  std::vector<const DataSet *> sets_;
+  std::vector<bool> owned_;
+  std::unordered_multimap<size_t,int> by_hash_;
+  typedef std::unordered_map<uint64_t,int> memo_t;
+  memo_t inter_, minus_, union_;
+
+  static uint64_t key (int a, int b) { return ((uint64_t) (uint32_t) a << 32) | (uint32_t) b; }
+
+  dataset_arena (const dataset_arena &);
+  dataset_arena & operator= (const dataset_arena &);
+public:
+  /// the index of the empty set, which is never stored
+  static const int EMPTY = -1;
+
+  dataset_arena () {}
+  ~dataset_arena () {
+    for (size_t i = 0 ; i < sets_.size() ; ++i)
+      if (owned_[i])
+	delete sets_[i];
+  }
+
+  /// The index of a set equal to d. If owned, d is either kept or deleted.
+  int intern (const DataSet * d, bool owned) {
+    if (d->empty()) {
+      if (owned)
+	delete d;
+      return EMPTY;
+    }
+    size_t h = d->set_hash();
+    std::pair<std::unordered_multimap<size_t,int>::const_iterator,std::unordered_multimap<size_t,int>::const_iterator> range = by_hash_.equal_range(h);
+    for ( ; range.first != range.second ; ++range.first) {
+      if (sets_[range.first->second]->set_equal(*d)) {
+	if (owned)
+	  delete d;
+	return range.first->second;
+      }
+    }
+    int id = sets_.size();
+    sets_.push_back(d);
+    owned_.push_back(owned);
+    by_hash_.insert(std::make_pair(h,id));
+    return id;
+  }
+
+  int intersect (int a, int b) {
+    if (a == b || a == EMPTY || b == EMPTY)
+      return a == b ? a : EMPTY;
+    uint64_t k = a < b ? key(a,b) : key(b,a);
+    memo_t::const_iterator it = inter_.find(k);
+    if (it != inter_.end())
+      return it->second;
+    return inter_[k] = intern(sets_[a]->set_intersect(*sets_[b]), true);
+  }
+
+  int minus (int a, int b) {
+    if (a == b || a == EMPTY)
+      return EMPTY;
+    if (b == EMPTY)
+      return a;
+    uint64_t k = key(a,b);
+    memo_t::const_iterator it = minus_.find(k);
+    if (it != minus_.end())
+      return it->second;
+    return minus_[k] = intern(sets_[a]->set_minus(*sets_[b]), true);
+  }
+
+  int unite (int a, int b) {
+    if (a == b || b == EMPTY)
+      return a;
+    if (a == EMPTY)
+      return b;
+    uint64_t k = a < b ? key(a,b) : key(b,a);
+    memo_t::const_iterator it = union_.find(k);
+    if (it != union_.end())
+      return it->second;
+    return union_[k] = intern(sets_[a]->set_union(*sets_[b]), true);
+  }
+
+  const DataSet & operator[] (int id) const { return *sets_[id]; }
+
+  /// Hands a set over to the caller, e.g. to label an arc of a new node.
+  DataSet * release (int id) {
+    if (owned_[id]) {
+      owned_[id] = false;
+      return const_cast<DataSet *> (sets_[id]);
+    }
+    return sets_[id]->newcopy();
+  }
+};
+
+/// successor -> index of its label in a dataset_arena
+typedef std::unordered_map<GSDD,int,d3::util::hash<GSDD> > square_t;
+
+void square_union (square_t & res, dataset_arena & sets, const GSDD & s, int d) {
+  square_t::iterator kt = res.find(s);
+  if (kt != res.end()) {
+    /* found it in res compute union */
+    kt->second = sets.unite(kt->second, d);
+  } else {
+    /* not yet in res, add it */
+    res.insert(std::make_pair(s,d));
+  }
+}
+
+}
+
 GSDD _SDED_Add::eval() const{
   assert(parameters.size() > 1);
   int variable=parameters.begin()->variable();
-  // To compute the result 
-  std::map<GSDD,DataSet *> res;
-
-  // for memory collection
-  DataSet * tofree;
+  // the labels of all operands and intermediate results
+  dataset_arena sets;
+  // To compute the result, at most one arc per successor
+  square_t res;
 
   // The current operand
   parameters_it opit =  parameters.begin();
 
-  // Initialize with copy of first operand
+  // Initialize with the first operand, its labels are borrowed
   for (GSDD::Valuation::const_iterator it = opit->begin();it != opit->end() ; ++it) 
-    res[it->second]=it->first->newcopy();
+    res[it->second]=sets.intern(it->first, false);
+
+  // To store non empty intersection results and remainders;
+  std::vector< std::pair <GSDD,int> > sums;
+  std::vector< std::pair <GSDD,int> > rems;
 
   // main loop
   // Foreach  opit in (operands)
   for (++opit ; opit != parameters.end() ; ++opit) {
-    // To store non empty intersection results and remainders;
-    std::vector< std::pair <GSDD,DataSet *> > sums;
-    std::vector< std::pair <GSDD,DataSet *> > rems;
+    sums.clear();
+    rems.clear();
     
     // Foreach arc in current operand  : e-a->A
     for (GSDD::Valuation::const_iterator arc = opit->begin() ; arc != opit->end() ; ++arc ) {
-      DataSet * a = arc->first->newcopy();
+      int a = sets.intern(arc->first, false);
       // foreach value already in result : e-b->B
-      for (std::map<GSDD,DataSet *>::iterator resit = res.begin() ; resit != res.end() ;  ) {
-	DataSet *b = resit->second;
+      for (square_t::iterator resit = res.begin() ; resit != res.end() ;  ) {
+	int b = resit->second;
 	 // test for equality first, fastest test
-	if ( a->set_equal(*b) ) {
+	if ( a == b ) {
 	  // will be reinserted in the result for testing against the next operand of union
 	  sums.push_back( std::make_pair(resit->first + arc->second , a) );
 	  // no more need to test against this element
-	  std::map<GSDD,DataSet *>::iterator jt = resit;
-	  ++resit;
-	  delete jt->second;
-	  res.erase(jt);
+	  resit = res.erase(resit);
 	  //  break to next arc of this operand, a has been emptied
-	  a = a->empty_set();
+	  a = dataset_arena::EMPTY;
 	  break;
 	}
 
-	// compute a*b
-	DataSet *ainterb = arc->first->set_intersect(*resit->second);
+	// compute a*b, the labels in res are disjoint so the part of a already sieved does not matter
+	int ainterb = sets.intersect(a, b);
 	// if a*b = 0, skip
-	if (ainterb->empty()) {
-	  delete ainterb;
+	if (ainterb == dataset_arena::EMPTY) {
 	  ++resit;
 	  // skip to next arc of res
 	  continue;
@@ -244,28 +357,21 @@ GSDD _SDED_Add::eval() const{
 	sums.push_back( std::make_pair(resit->first + arc->second , ainterb) );
 	
 	// Test containment case
-	if ( b->set_equal(*ainterb) ) {
+	if ( b == ainterb ) {
 	  // a contains b (STRICTLY, equality tested above)
 	  // remove the b mapping from the test set
-	  std::map<GSDD,DataSet *>::iterator jt = resit;
-	  resit++;
-	  delete jt->second;
-	  res.erase(jt);	  
+	  resit = res.erase(resit);
 	} else {
 	  // update result : res[cur] -= ainterb :  e- b \ a -> B
-	  tofree = resit->second;
-	  resit->second = resit->second->set_minus(*ainterb);
-	  delete tofree;
-	  resit++;
+	  resit->second = sets.minus(b, ainterb);
+	  ++resit;
 	}
 
 	// update a (sieve b values) 
-	tofree = a ;
-	a = a->set_minus(*ainterb);
-	delete tofree;
+	a = sets.minus(a, ainterb);
 
 	// test terminal containment case
-	if (a->empty()) {
+	if (a == dataset_arena::EMPTY) {
 	  // we can stop, a is fully treated, break to next arc
 	  break;
 	}      
@@ -273,69 +379,47 @@ GSDD _SDED_Add::eval() const{
       } // end foreach resit in result
       
       // if there is a remainder, store it
-      if (! a->empty()) {
+      if (a != dataset_arena::EMPTY) {
 	// traversed sieve without emptying a
 	rems.push_back(std::make_pair(arc->second,a));
-      } else 
-	delete a;
+      }
     } // end foreach arc in operand
     
     // Now process remainders and sums
-    for (std::vector< std::pair <GSDD,DataSet *> >::iterator it=sums.begin(); it != sums.end(); ++it ) {
-      square_union(res,it->first,it->second);
-      delete it->second;
+    for (std::vector< std::pair <GSDD,int> >::const_iterator it=sums.begin(); it != sums.end(); ++it ) {
+      square_union(res,sets,it->first,it->second);
     }
-    for (std::vector< std::pair <GSDD,DataSet *> >::iterator it=rems.begin(); it != rems.end(); ++it ) {
-      square_union(res,it->first,it->second);
-      delete it->second;
+    for (std::vector< std::pair <GSDD,int> >::const_iterator it=rems.begin(); it != rems.end(); ++it ) {
+      square_union(res,sets,it->first,it->second);
     }
-
-//     if ( ! opit->isSon() && ! opit->refCounter() )
-//       opit->clearNode();
   } // end foreach operand
 
   GSDD::Valuation value;
 
 #ifdef EVDDD
   // foreach value already in result : e-b->B
-  for (std::map<GSDD,DataSet *>::iterator resit = res.begin() ; resit != res.end() ;  ) {
+  std::vector< std::pair <GSDD,int> > moved;
+  for (square_t::iterator resit = res.begin() ; resit != res.end() ;  ) {
     int mindist = resit->first.getMinDistance();
     if (mindist>0) {
-      std::map<GSDD,DataSet *>::iterator jt = resit;
-      resit++;
-//      square_union(res, jt->first.normalizeDistance(-mindist), jt->second->normalizeDistance(mindist));
-//       std::cerr << "got positive mindist = " << mindist <<std::endl;
-//       std::cerr << "apply -mindist to = " <<jt->first << "gives \n" << jt->first.normalizeDistance(-mindist) <<std::endl;
-//       std::cerr << "apply +mindist to = " ;
-//       jt->second->set_print(std::cerr);
-//       std::cerr << "gives \n" ; 
-//       jt->second->normalizeDistance(mindist)->set_print(std::cerr);
-//       std::cerr  <<std::endl;
-      res[jt->first.normalizeDistance(-mindist)] = jt->second->normalizeDistance(mindist);
-      delete jt->second;
-      res.erase(jt);
+      moved.push_back(std::make_pair(resit->first.normalizeDistance(-mindist), sets.intern(sets[resit->second].normalizeDistance(mindist), true)));
+      resit = res.erase(resit);
     } else {
       ++resit;
     }
   }
+  for (std::vector< std::pair <GSDD,int> >::const_iterator it=moved.begin(); it != moved.end(); ++it ) {
+    res[it->first] = it->second;
+  }
 #endif
 
+  // the node constructor sorts the arcs and takes ownership of the labels
   value.reserve(res.size());  
-  for (std::map<GSDD,DataSet *>::iterator it =res.begin() ;it!= res.end();++it) {
-    assert ( ! it->second->empty() && it->first != GSDD::null);
-      value.push_back(std::make_pair(it->second,it->first));
+  for (square_t::const_iterator it =res.begin() ;it!= res.end();++it) {
+    assert ( it->second != dataset_arena::EMPTY && it->first != GSDD::null);
+    value.push_back(std::make_pair(sets.release(it->second),it->first));
   }
 
-//   int id=0;
-//   std::cerr << "operating over parameters : " <<std::endl ;
-//   for (d3::set<GSDD>::type::const_iterator it = parameters.begin() ; it != parameters.end() ; it++ ) {
-//     std::cerr << "PARAM "<< id++ << "  "<< *it << std::endl ;
-//   }
-  // GSDD ret(variable,value);
-//   std::cerr << "produced node : " << ret << std::endl ;
-  // return ret;
-
-
   return GSDD(variable,value);
 };
 
@@ -399,6 +483,8 @@ public:
   size_t hash() const;
   bool operator==(const _SDED &e)const;
   _SDED * clone () const { auto res = new _SDED_Mult(*this); res->result = res->eval() ; return res; }
+  SDED::op_kind kind() const { return SDED::OP_MULT; }
+  bool is_live() const { return parameter1.is_marked() && parameter2.is_marked() && result.is_marked(); }
 
   /* Transform */
   GSDD eval() const;
@@ -500,6 +586,8 @@ public:
   size_t hash() const;
   bool operator==(const _SDED &e)const;
   _SDED * clone () const { auto res = new _SDED_Minus(*this);  res->result = res->eval() ; return res;}
+  SDED::op_kind kind() const { return SDED::OP_MINUS; }
+  bool is_live() const { return parameter1.is_marked() && parameter2.is_marked() && result.is_marked(); }
   /* Transform */
   GSDD eval() const;
 
@@ -604,6 +692,8 @@ public:
   size_t hash() const;
   bool operator==(const _SDED &e)const;
   _SDED * clone () const { auto res = new _SDED_Concat(*this);  res->result = res->eval() ; return res;}
+  SDED::op_kind kind() const { return SDED::OP_CONCAT; }
+  bool is_live() const { return parameter1.is_marked() && parameter2.is_marked() && result.is_marked(); }
   /* Transform */
   GSDD eval() const;
 
@@ -672,34 +762,58 @@ unsigned int SDED::statistics() {
 
 void SDED::pstats(bool reinit)
 {
-  std::cout << "*\nCache Stats : size=" << statistics() << "   --- Peak size=" <<  namespace_SDED::Max_SDED << std::endl;
+  std::cout << "*\nCache Stats : size=" << statistics() << "   --- Peak size=" <<  peak() << std::endl;
   
   
-  std::cout << "Cache hit ratio : " << double (namespace_SDED::Hits*100) / double(namespace_SDED::Misses+1+namespace_SDED::Hits) << "% ("<< namespace_SDED::Hits << "/" <<namespace_SDED::Misses << ")" << std::endl;
-  // long hitr=(Hits*100) / (Misses+1+Hits) ;
+  stats().print(std::cout);
+  if (uniqueSDED.waits() + uniqueSDED.bypasses() != 0) {
+    std::cout << "In flight : " << uniqueSDED.waits() << " waits for another thread, "
+	      << uniqueSDED.bypasses() << " computed again (" << uniqueSDED.timeouts() << " after waiting "
+	      << d3::parallel::max_wait() << " ms)" << std::endl;
+  }
   if (reinit){
-    namespace_SDED::Hits =0;
-    namespace_SDED::Misses =0;  
+    namespace_SDED::counters.reset();
   }  
 
 }
 
 
 size_t SDED::peak() {
-  if (uniqueSDED.size() > namespace_SDED::Max_SDED)
-    namespace_SDED::Max_SDED = uniqueSDED.size();
-  return namespace_SDED::Max_SDED;
+  return std::max(namespace_SDED::Max_SDED.load(std::memory_order_relaxed), uniqueSDED.size());
+}
+
+d3::op_cache_stats_t SDED::stats() {
+  d3::op_cache_stats_t res;
+  res.size = uniqueSDED.size();
+  res.peak = peak();
+  // sizeof the base class only, a lower bound
+  res.bytes = res.size * sizeof(_SDED);
+  namespace_SDED::counters.fill(res, namespace_SDED::op_kind_names);
+  return res;
 }
 
 void SDED::garbage(){
-  if (uniqueSDED.size() > namespace_SDED::Max_SDED)
-    {
-      namespace_SDED::Max_SDED= uniqueSDED.size();
-    }
-  for (auto ded : uniqueSDED.table ){
-    delete ded;
+  d3::stat_max(namespace_SDED::Max_SDED, uniqueSDED.size());
+  const d3::cache_policy & policy = d3::cache_policy::current();
+  if (policy.mode == d3::FULL_CLEAR) {
+    uniqueSDED.sweep([] (const _SDED * ded) {
+	namespace_SDED::counters.eviction(ded->kind());
+	return true;
+      });
+    namespace_SDED::counters.gc();
+    return;
   }
-  uniqueSDED.table.clear();
+  // keep the entries that are still live, operands and result are marked by now
+  size_t kept = 0;
+  uniqueSDED.sweep([&policy, &kept] (const _SDED * ded) {
+      if (policy.keep(ded->is_live(), kept)) {
+	++kept;
+	return false;
+      }
+      namespace_SDED::counters.eviction(ded->kind());
+      return true;
+    });
+  namespace_SDED::counters.gc();
 }; 
 
 /* binary operators */
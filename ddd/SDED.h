@@ -29,6 +29,7 @@
 
 #include "ddd/DataSet.h"
 #include "ddd/util/hash_support.hh"
+#include "ddd/util/op_stats.hh"
 
 class GSDD;
         
@@ -36,8 +37,13 @@ class GSDD;
 namespace SDED{
   GSDD add(const d3::set<GSDD>::type &);
 
+  /// The kinds of operations stored in the cache.
+  enum op_kind { OP_ADD, OP_MULT, OP_MINUS, OP_CONCAT, NB_OP_KINDS };
+
   /* Memory Manager */
   unsigned int statistics();
+  /// Size of the cache, and hits, misses, insertions and evictions per kind of operation.
+  d3::op_cache_stats_t stats();
   void pstats(bool reinit=true);
   size_t peak();
   void garbage(); 
@@ -33,11 +33,7 @@
 
 #include "ddd/FixObserver.hh"
 
-#ifdef PARALLEL_DD
-#include <tbb/blocked_range.h>
-#include <tbb/parallel_for.h>
-#include <tbb/concurrent_vector.h>
-#endif
+#include "ddd/Parallel.h"
 
 #define trace while(0) std::cerr
 // #define trace std::cerr
@@ -2298,51 +2294,8 @@ public:
 } // end namespace H_Homomorphism
 
 #ifdef PARALLEL_DD
-
-typedef tbb::blocked_range<int> varval_range;
-
-
-class hom_for
-{
-private:
-
-  const GShom& gshom_;
-  std::vector<GSDD> & val_;
-    
-  int* to_solve_;
-
-public:
-
-  hom_for( const GShom& ghsom
-	   , std::vector<GSDD>& val
-	   , int* to_solve
-	   )
-
-    : gshom_(ghsom)
-    , val_(val)
-    , to_solve_(to_solve)
-  {
-  }
-	
-  void operator()(const varval_range& range)
-    const
-  {
-    std::vector<GSDD>& val = this->val_;
-    int* to_solve = this->to_solve_;
-
-    for( int i = range.begin(); i != range.end(); ++i)
-      {
-	// GSDD result = gshom_( val[to_solve[i]]) ;
-	// sns::cache.insert( gshom_, val[to_solve[i]], result);
-	// val[to_solve[i]] = result;
-	val[to_solve[i]] = gshom_( val[to_solve[i]]) ;
-      }
-
-  }
-
-};
-
-#endif // PARALLEL_DD
+static GSDD eval_skip_parallel (const GShom & h, const GSDD & d);
+#endif
 
 GSDD _GShom::has_image(const GSDD &d) const {
 	// default to actually computing the solutions, which is always correct
@@ -2395,98 +2348,10 @@ GSDD _GShom::eval_skip(const GSDD &d) const {
 		GSDD_DataSet_map res;
 
 #ifdef PARALLEL_DD
-      
-      // filter pathological single son case
-      // fallback to default except if parallel conditions met
-      if (d.nbsons() > 1  && (typeid(*this) == typeid(const sns::Fixpoint))) 
-	{
-
-          // std::cout << "PARALLEL" << std::endl;
-
-	  // To hold the arcs of the node we are constructing
-	  // For each arc <vl,son> of the node d we build an arc
-	  // <vl, h(son)>. 
-	  // Then we use square union to ensure canonicity of this arc set.
-      
-	  // The node structure is preserved by application of h, since skip_var is true
-	  std::vector<GSDD> son_result;
-	  son_result.reserve(d.nbsons());
-      
-	  // Parallel computation of h(son) is possible.
-	  // However using a task to get a cache hit is counter productive, 
-	  // so we first get h(son) from cache where possible and update tmp_result
-	  // for cache misses we build tosolve, that contains the index of uncomputed h(son) arcs in tmp_result.
-	  // We then use a parallel loop to resolve the remaining computations pointed to in tosolve using tasks.
-      
-	  // to hold index of entries not found in cache. size at most full node size.
-	  int to_solve[d.nbsons()];
-	  int to_solve_size = 0;
-      
-	  // one loop to pick up cached results
-      
-	  // current index in tmp_result
-	  int i =0;
-	  for(  GSDD::const_iterator it = d.begin();
-		it != d.end() ;
-		++it,i++) {
-	    if (immediat()) {
-	      // right concatenating a constant ? ah : Can this happen ?
-	      // if this assert is raised, remove it !
-              son_result.push_back(eval(it->second));
-              assert(false);
-	    } else {
-	      //  std::pair<bool,GSDD> local_res = sns::cache.contains(gshom,it->second);
-	      //  if (local_res.first) {
-	      if (false) {
-		// cache hit
-		//                  son_result.push_back(local_res.second);
-	      } else {
-		// cache miss : add index i to tosolve list
-		to_solve[to_solve_size++] = i;
-		// set current value in son_result to son
-		son_result.push_back(it->second);
-	      }
-	    }
-	  }
-            
-	  // the actual parrallel computation
-	  //          for i in range given by varval_range : 0 < i < tosolvesize
-	  // third parameter in range constructor is grain of parallelism : 1 => 1 task per arc created
-	  tbb::parallel_for( varval_range( 0, to_solve_size, 1)
-			     // for task body computes  : sonresult[tosolve[i] = gshom(sonresult[tosolve[i]]) 
-			     , hom_for(gshom, son_result, to_solve));
-
-      
-	  // for( int j = 0; j != to_solve_size; ++j)
-	  // {
-	  //     GSDD arg = son_result[to_solve[j]];
-	  //     GSDD result = gshom( arg) ;
-	  //     // sns::cache.insert( gshom, arg, result);
-	  //     son_result[to_solve[j]] = result;
-	  // }
-
-
-	  i=0;
-	  for( GSDD::const_iterator it = d.begin()
-		 ; it != d.end()
-		 ; ++it,++i )
-	    {
-	      // arcs to null are pruned
-	      if ( son_result[i] != GSDD::null && !(it->first->empty()))
-		{
-		  assert( son_result[i].variable() != d.variable() );
-		  // use arc value from node d and new son from son_result
-		  // note that arc values are copied into res, so d is const always
-		  square_union( res, son_result[i] , it->first);
+		if (d.nbsons() > 1 && d3::parallel::threads() > 1) {
+			return eval_skip_parallel(gshom, d);
 		}
-	    }
-      
-	} else {
-	// parallel conditions not enabled
-	// std::cout << "SEQUENTIAL" << std::endl;
-
 #endif
-		// #else // NOT PARALLEL_DD
 
 		for (GSDD::const_iterator it = d.begin(); it != d.end(); ++it) {
 			GSDD son = gshom(it->second);
@@ -2495,11 +2360,6 @@ GSDD _GShom::eval_skip(const GSDD &d) const {
 			}
 		}
 
-		// #endif // PARALLEL_DD
-#ifdef PARALLEL_DD
-      } // close else condition : no parallel
-#endif      
-
 		GSDD::Valuation valuation;
 		valuation.reserve(res.size());
 		for (GSDD_DataSet_map::const_iterator it = res.begin(); it != res.end();
@@ -2647,6 +2507,58 @@ namespace sns {
 static ImgShomCache imgcache;
 }
 
+#ifdef PARALLEL_DD
+/// _GShom::eval_skip with the sons forked as tasks. The cache hits are picked up first,
+/// the remaining sons are weighted by their number of arcs.
+static GSDD eval_skip_parallel (const GShom & h, const GSDD & d) {
+	size_t n = d.nbsons();
+	std::vector<GSDD> sons;
+	sons.reserve(n);
+	std::vector<size_t> todo, weights;
+	size_t total = 0;
+	for (GSDD::const_iterator it = d.begin(); it != d.end(); ++it) {
+		GSDD res;
+		if (sns::cache.contains(h, it->second, res)) {
+			sons.push_back(res);
+		} else {
+			todo.push_back(sons.size());
+			weights.push_back(it->second.nbsons() + 1);
+			total += weights.back();
+			sons.push_back(it->second);
+		}
+	}
+	if (d3::parallel::worth_forking(total)) {
+		size_t misses = sns::cache.counters().misses();
+		d3::parallel::for_each(todo.size(), &weights[0], [&] (size_t k) {
+			sons[todo[k]] = h(sons[todo[k]]);
+		});
+		d3::parallel::record(todo.size(), sns::cache.counters().misses() - misses);
+	} else {
+		for (size_t k = 0; k < todo.size(); ++k)
+			sons[todo[k]] = h(sons[todo[k]]);
+	}
+	// for square union
+	GSDD_DataSet_map res;
+	size_t i = 0;
+	for (GSDD::const_iterator it = d.begin(); it != d.end(); ++it, ++i) {
+		// arcs to null are pruned, arc values are copied into res
+		if (sons[i] != GSDD::null && !(it->first->empty())) {
+			square_union(res, sons[i], it->first);
+		}
+	}
+	GSDD::Valuation valuation;
+	valuation.reserve(res.size());
+	for (GSDD_DataSet_map::const_iterator it = res.begin(); it != res.end(); ++it) {
+		valuation.push_back(std::make_pair(it->second, it->first));
+	}
+	if (valuation.empty()) {
+		return GSDD::null;
+	} else {
+		return GSDD(d.variable(), valuation);
+	}
+}
+#endif
+
 /* Eval */
 GSDD GShom::operator()(const GSDD &d) const {
 	if (concret->immediat()) {
@@ -2713,24 +2625,54 @@ void GShom::mark() const {
 // used to reduce Shom::add creation complexity in recursive cases
 typedef ext_hash_map<d3::set<GShom>::type, const _GShom*>::internal_hash_map addCache_t;
 static addCache_t addCache;
+void GShom::setCacheSlots (size_t nb_slots) {
+	sns::cache.set_slots(nb_slots);
+}
+
+void GShom::setImageCacheSlots (size_t nb_slots) {
+	sns::imgcache.set_slots(nb_slots);
+}
+
+d3::op_cache_stats_t GShom::cacheStats () {
+	return sns::cache.stats();
+}
+
+d3::op_cache_stats_t GShom::imageCacheStats () {
+	return sns::imgcache.stats();
+}
+
+bool GShom::is_marked() const {
+	return concret->is_marked();
+}
+
 void GShom::garbage() {
-	addCache.clear();
-	sns::cache.clear();
-	sns::imgcache.clear();
+	mark_roots();
+	sweep_caches();
+	sweep();
+}
 
-	// mark phase
+void GShom::mark_roots() {
 	for (UniqueTable<_GShom>::Table::iterator di = canonical.table.begin();
 			di != canonical.table.end(); ++di) {
 		(*di)->mark_if_refd();
 	}
-	// sweep phase
+}
+
+void GShom::sweep_caches() {
+	const d3::cache_policy & policy = d3::cache_policy::current();
+	addCache.clear();
+	sns::cache.sweep(policy);
+	sns::imgcache.sweep(policy);
+}
+
+void GShom::sweep() {
 	for (UniqueTable<_GShom>::Table::iterator di = canonical.table.begin();
 			di != canonical.table.end();) {
 		if (!(*di)->is_marked()) {
 			UniqueTable<_GShom>::Table::iterator ci = di;
 			++di;
 			const _GShom *g = *ci;
-			canonical.table.erase(ci);
+			canonical.erase(ci);
 			delete g;
 		} else {
 			(*di)->set_mark(false);
@@ -3333,9 +3275,22 @@ GShom operator*(const GShom &h, const GShom &cond) {
 	return sns::Inter(h, cond);
 }
 
+size_t GShom::peak() {
+	return canonical.peak();
+}
+
+void GShom::snapshot(d3::memory_snapshot_t & snap) {
+	// lower bound : the fields of each kind of homomorphism are not counted
+	snap.tables.push_back(d3::memory_snapshot_t::table_t("Shom", statistics(), peak(), statistics() * sizeof(_GShom)));
+	snap.caches.push_back(std::make_pair(std::string("Shom"), sns::cache.stats()));
+	snap.caches.push_back(std::make_pair(std::string("ShomImage"), sns::imgcache.stats()));
+}
+
 void GShom::pstats(bool) {
 	std::cout << "*\nGSHom Stats : size unicity table = " << canonical.size()
 			<< std::endl;
+	sns::cache.print_stats(std::cout, "GShom cache");
+	sns::imgcache.print_stats(std::cout, "GShom image cache");
 
 	std::cout << "sizeof(_GShom):" << sizeof(_GShom) << std::endl;
 	std::cout << "sizeof(SIdentity):" << sizeof(sns::Identity) << std::endl;
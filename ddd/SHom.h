@@ -185,6 +185,8 @@ public:
   //@{
   /// Return the current size of the unicity table for GShom.
   static  unsigned int statistics();
+  /// Return the peak size of the unicity table for GShom.
+  static size_t peak();
   /// Return the current size of the cache for GShom.
   static size_t cache_size();
 	/// Return the peak size of the cache for GShom.
@@ -193,6 +195,8 @@ public:
   /// Print some usage statistics on Shom. Mostly used for development and debug.
   /// \todo Allow output not in std::cout.
   static void pstats(bool reinit=true);
+  /// Adds the unicity table and the operation caches to a snapshot of the memory, see MemoryManager::snapshot().
+  static void snapshot(d3::memory_snapshot_t & snap);
   /// Mark a concrete data as in use (forbids garbage collection of the data).
   void mark() const;
   /// For storage in a hash table
@@ -203,6 +207,20 @@ public:
   /// MemoryManager::garbage() as order of calls (among GSDD::garbage(), GShom::garbage(), 
   /// SDED::garbage()) is important.
   static void garbage();
+  /// The phases of garbage(). Operation caches are swept after every GShom and GSDD was marked,
+  /// and keep the entries that are still live according to MemoryManager::setCachePolicy().
+  static void mark_roots();
+  static void sweep_caches();
+  static void sweep();
+  /// For garbage collection internals. Whether a GShom survives the ongoing collection.
+  bool is_marked() const;
+  /// Bound the operation cache (resp. the has_image cache) to a direct mapped table of nb_slots
+  /// entries, that never grows nor rehashes, see Cache::set_slots(). Zero (the default) means unbounded.
+  static void setCacheSlots (size_t nb_slots);
+  static void setImageCacheSlots (size_t nb_slots);
+  /// Size and hit, miss, insertion and eviction counts of the operation cache (resp. the has_image cache).
+  static d3::op_cache_stats_t cacheStats ();
+  static d3::op_cache_stats_t imageCacheStats ();
   //@}
 
   // strategies for fixpoint evaluation insaturation context
@@ -0,0 +1,478 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <typeinfo>
+#include <iostream>
+
+#include "ddd/Serialization.h"
+#include "ddd/IntDataSet.h"
+#include "ddd/util/varint.hh"
+
+namespace {
+
+/// The header : a magic string and a version.
+namespace binary_format {
+  const char magic [4] = { 'D', 'D', 'D', 'B' };
+  const uint64_t version = 1;
+  enum record_t { END = 0, DDD_NODE = 1, SDD_NODE = 2, CODEC = 3 };
+}
+
+/// A DDD arc, the index of the DDD.
+class ddd_codec : public DataSetCodec
+{
+public:
+  std::string name () const { return "DDD"; }
+  bool handles (const DataSet & set) const {
+    return typeid(set) == typeid(DDD);
+  }
+  void prepare (BinaryWriter & out, const DataSet & set) const {
+    out.write(static_cast<const DDD &>(set));
+  }
+  void save (BinaryWriter & out, const DataSet & set) const {
+    out.write_varint(out.index(static_cast<const DDD &>(set)));
+  }
+  DataSet * load (BinaryReader & in) const {
+    return new DDD(in.ddd(in.read_varint()));
+  }
+};
+
+/// An SDD arc of a hierarchical SDD, the index of the SDD.
+class sdd_codec : public DataSetCodec
+{
+public:
+  std::string name () const { return "SDD"; }
+  bool handles (const DataSet & set) const {
+    return typeid(set) == typeid(GSDD) || typeid(set) == typeid(SDD);
+  }
+  void prepare (BinaryWriter & out, const DataSet & set) const {
+    out.write(static_cast<const GSDD &>(set));
+  }
+  void save (BinaryWriter & out, const DataSet & set) const {
+    out.write_varint(out.index(static_cast<const GSDD &>(set)));
+  }
+  DataSet * load (BinaryReader & in) const {
+    return new GSDD(in.sdd(in.read_varint()));
+  }
+};
+
+/// An IntDataSet arc, the number of values then the sorted values, each relative to the previous one.
+class int_codec : public DataSetCodec
+{
+public:
+  std::string name () const { return "IntDataSet"; }
+  bool handles (const DataSet & set) const {
+    return typeid(set) == typeid(IntDataSet);
+  }
+  void save (BinaryWriter & out, const DataSet & set) const {
+    const IntDataSet & s = static_cast<const IntDataSet &>(set);
+    out.write_varint(s.end() - s.begin());
+    int64_t prev = 0;
+    for (IntDataSet::const_iterator it = s.begin() ; it != s.end() ; ++it) {
+      if (it == s.begin()) {
+	out.write_svarint(*it);
+      } else {
+	out.write_varint(*it - prev);
+      }
+      prev = *it;
+    }
+  }
+  DataSet * load (BinaryReader & in) const {
+    uint64_t size = in.read_varint();
+    std::vector<int> values;
+    int64_t v = 0;
+    for (uint64_t i = 0 ; i < size ; ++i) {
+      if (i == 0) {
+	v = in.read_svarint();
+      } else {
+	// v is in range of int here, a larger step would overflow
+	uint64_t step = in.read_varint();
+	if (step > (uint64_t) (std::numeric_limits<int>::max() - v)) {
+	  throw std::runtime_error("BinaryReader : value out of range of IntDataSet");
+	}
+	v += step;
+      }
+      if (v < std::numeric_limits<int>::min() || v > std::numeric_limits<int>::max()) {
+	throw std::runtime_error("BinaryReader : value out of range of IntDataSet");
+      }
+      values.push_back(v);
+    }
+    return new IntDataSet(values);
+  }
+};
+
+typedef std::vector<std::unique_ptr<DataSetCodec> > codecs_t;
+
+codecs_t builtin_codecs () {
+  codecs_t res;
+  res.emplace_back(new ddd_codec());
+  res.emplace_back(new sdd_codec());
+  res.emplace_back(new int_codec());
+  return res;
+}
+
+/// The registered codecs, built in ones first.
+codecs_t & codecs () {
+  static codecs_t codecs = builtin_codecs();
+  return codecs;
+}
+
+} // anonymous namespace
+
+
+void DataSetRegistry::add (DataSetCodec * codec) {
+  std::unique_ptr<DataSetCodec> owned (codec);
+  if (find(codec->name()) != NULL) {
+    throw std::invalid_argument("DataSetRegistry : a codec is already registered as " + codec->name());
+  }
+  codecs().push_back(std::move(owned));
+}
+
+const DataSetCodec * DataSetRegistry::find (const DataSet & set) {
+  const codecs_t & all = codecs();
+  for (codecs_t::const_reverse_iterator it = all.rbegin() ; it != all.rend() ; ++it) {
+    if ((*it)->handles(set))
+      return it->get();
+  }
+  return NULL;
+}
+
+const DataSetCodec * DataSetRegistry::find (const std::string & name) {
+  const codecs_t & all = codecs();
+  for (codecs_t::const_iterator it = all.begin() ; it != all.end() ; ++it) {
+    if ((*it)->name() == name)
+      return it->get();
+  }
+  return NULL;
+}
+
+
+/// Writes each DDD node as it is numbered : the variable, the number of arcs, then per arc
+/// the value (relative to the previous one) and the distance from the index of the node to
+/// the index of the son.
+struct BinaryWriter::ddd_visitor
+{
+  BinaryWriter & out;
+  ddd_visitor (BinaryWriter & o) : out(o) {}
+
+  void prepare (const GDDD &) {}
+
+  void operator() (const GDDD & node, uint64_t index) {
+    out.write_varint(binary_format::DDD_NODE);
+    out.write_svarint(node.variable());
+    out.write_varint(node.nbsons());
+    int64_t prev = 0;
+    GDDD::const_iterator end = node.end();
+    for (GDDD::const_iterator it = node.begin() ; it != end ; ++it) {
+      // values increase along the arcs, the first one is relative to 0
+      int64_t v = it.value();
+      if (it == node.begin()) {
+	out.write_svarint(v);
+      } else {
+	out.write_varint(v - prev);
+      }
+      prev = v;
+      // sons are numbered before their father
+      out.write_varint(index - out.ddd_.index(it.son()));
+    }
+  }
+};
+
+/// Writes each SDD node as it is numbered : the variable, the number of arcs, then per arc
+/// the codec of the value, the value, and the distance from the index of the node to the
+/// index of the son. The DDD and SDD on the arcs are written before the node.
+struct BinaryWriter::sdd_visitor
+{
+  BinaryWriter & out;
+  std::vector<const DataSetCodec *> arcs;
+  sdd_visitor (BinaryWriter & o) : out(o) {}
+
+  void prepare (const GSDD & node) {
+    arcs.clear();
+    for (GSDD::const_iterator it = node.begin() ; it != node.end() ; ++it) {
+      const DataSetCodec * c = DataSetRegistry::find(*it->first);
+      if (c == NULL) {
+	throw std::invalid_argument(std::string("BinaryWriter : no codec registered for ") + typeid(*it->first).name());
+      }
+      c->prepare(out, *it->first);
+      out.codec(c);
+      arcs.push_back(c);
+    }
+  }
+
+  void operator() (const GSDD & node, uint64_t index) {
+    out.write_varint(binary_format::SDD_NODE);
+    out.write_svarint(node.variable());
+    out.write_varint(node.nbsons());
+    std::vector<const DataSetCodec *>::const_iterator c = arcs.begin();
+    for (GSDD::const_iterator it = node.begin() ; it != node.end() ; ++it, ++c) {
+      out.write_varint(out.codecs_.find(*c)->second);
+      (*c)->save(out, *it->first);
+      out.write_varint(index - out.sdd_.index(it->second));
+    }
+  }
+};
+
+BinaryWriter::BinaryWriter (std::ostream & os) : os_(os) {
+  os_.write(binary_format::magic, 4);
+  write_varint(binary_format::version);
+  // terminals have implicit indexes 0, 1 and 2
+  ddd_.assign(GDDD::null);
+  ddd_.assign(GDDD::one);
+  ddd_.assign(GDDD::top);
+  sdd_.assign(GSDD::null);
+  sdd_.assign(GSDD::one);
+  sdd_.assign(GSDD::top);
+}
+
+uint64_t BinaryWriter::codec (const DataSetCodec * c) {
+  std::unordered_map<const DataSetCodec *, uint64_t>::const_iterator it = codecs_.find(c);
+  if (it != codecs_.end())
+    return it->second;
+  // declared on first use, codecs are numbered in declaration order
+  uint64_t id = codecs_.size();
+  codecs_[c] = id;
+  std::string name = c->name();
+  write_varint(binary_format::CODEC);
+  write_varint(name.size());
+  os_.write(name.data(), name.size());
+  return id;
+}
+
+uint64_t BinaryWriter::write (const GDDD & d) {
+  ddd_visitor visit (*this);
+  ddd_.number(d, visit);
+  return ddd_.index(d);
+}
+
+uint64_t BinaryWriter::write (const GSDD & s) {
+  sdd_visitor visit (*this);
+  sdd_.number(s, visit);
+  return sdd_.index(s);
+}
+
+void BinaryWriter::finish (const std::vector<uint64_t> & roots) {
+  write_varint(binary_format::END);
+  write_varint(roots.size());
+  for (size_t i = 0 ; i < roots.size() ; ++i) {
+    write_varint(roots[i]);
+  }
+}
+
+void BinaryWriter::write_varint (uint64_t v) {
+  d3::write_varint(os_, v);
+}
+
+void BinaryWriter::write_svarint (int64_t v) {
+  d3::write_svarint(os_, v);
+}
+
+
+BinaryReader::BinaryReader (std::istream & is) : is_(is) {
+  char magic [4];
+  if (! is_.read(magic, 4) || std::memcmp(magic, binary_format::magic, 4) != 0) {
+    throw std::runtime_error("BinaryReader : not a binary DDD stream");
+  }
+  uint64_t version = read_varint();
+  if (version != binary_format::version) {
+    throw std::runtime_error("BinaryReader : unsupported format version");
+  }
+  ddd_.push_back(GDDD::null);
+  ddd_.push_back(GDDD::one);
+  ddd_.push_back(GDDD::top);
+  sdd_.push_back(GSDD::null);
+  sdd_.push_back(GSDD::one);
+  sdd_.push_back(GSDD::top);
+}
+
+void BinaryReader::read_ddd () {
+  int64_t var = read_svarint();
+  if (var < std::numeric_limits<int>::min() || var > std::numeric_limits<int>::max()) {
+    throw std::runtime_error("BinaryReader : variable out of range of int");
+  }
+  uint64_t nbsons = read_varint();
+  int64_t v = 0;
+  GDDD::Valuation valuation;
+  for (uint64_t i = 0 ; i < nbsons ; ++i) {
+    if (i == 0) {
+      v = read_svarint();
+    } else {
+      // values strictly increase along the arcs, and v is in range of val_t here
+      uint64_t step = read_varint();
+      if (step == 0) {
+	throw std::runtime_error("BinaryReader : values not increasing");
+      }
+      if (step > (uint64_t) (std::numeric_limits<GDDD::val_t>::max() - v)) {
+	throw std::runtime_error("BinaryReader : value out of range of DDD::val_t");
+      }
+      v += step;
+    }
+    uint64_t delta = read_varint();
+    if (v < std::numeric_limits<GDDD::val_t>::min() || v > std::numeric_limits<GDDD::val_t>::max()) {
+      throw std::runtime_error("BinaryReader : value out of range of DDD::val_t");
+    }
+    // index 0 is GDDD::null, which is never the successor of an arc
+    if (delta == 0 || delta >= ddd_.size()) {
+      throw std::runtime_error("BinaryReader : invalid successor");
+    }
+    valuation.push_back(GDDD::edge_t(v, ddd_[ddd_.size() - delta]));
+  }
+  ddd_.push_back(GDDD((int) var, valuation));
+}
+
+void BinaryReader::read_sdd () {
+  int64_t var = read_svarint();
+  if (var < std::numeric_limits<int>::min() || var > std::numeric_limits<int>::max()) {
+    throw std::runtime_error("BinaryReader : variable out of range of int");
+  }
+  uint64_t nbsons = read_varint();
+  GSDD::Valuation valuation;
+  try {
+    for (uint64_t i = 0 ; i < nbsons ; ++i) {
+      uint64_t c = read_varint();
+      if (c >= codecs_.size()) {
+	throw std::runtime_error("BinaryReader : undeclared codec");
+      }
+      DataSet * value = codecs_[c]->load(*this);
+      valuation.push_back(std::make_pair(value, GSDD::null));
+      if (value->empty()) {
+	throw std::runtime_error("BinaryReader : empty arc label");
+      }
+      uint64_t delta = read_varint();
+      // index 0 is GSDD::null, which is never the successor of an arc
+      if (delta == 0 || delta >= sdd_.size()) {
+	throw std::runtime_error("BinaryReader : invalid successor");
+      }
+      valuation.back().second = sdd_[sdd_.size() - delta];
+    }
+  } catch (...) {
+    for (GSDD::Valuation::iterator it = valuation.begin() ; it != valuation.end() ; ++it) {
+      delete it->first;
+    }
+    throw;
+  }
+  // the node takes ownership of the values
+  sdd_.push_back(GSDD((int) var, valuation));
+}
+
+void BinaryReader::read_codec () {
+  uint64_t size = read_varint();
+  if (size > 1024) {
+    throw std::runtime_error("BinaryReader : invalid codec name");
+  }
+  std::string name (size, '\0');
+  if (! is_.read(&name[0], size)) {
+    throw std::runtime_error("BinaryReader : truncated stream");
+  }
+  const DataSetCodec * c = DataSetRegistry::find(name);
+  if (c == NULL) {
+    throw std::runtime_error("BinaryReader : no codec registered for " + name);
+  }
+  codecs_.push_back(c);
+}
+
+std::vector<uint64_t> BinaryReader::read () {
+  for (uint64_t tag = read_varint() ; tag != binary_format::END ; tag = read_varint()) {
+    switch (tag) {
+    case binary_format::DDD_NODE :
+      read_ddd();
+      break;
+    case binary_format::SDD_NODE :
+      read_sdd();
+      break;
+    case binary_format::CODEC :
+      read_codec();
+      break;
+    default :
+      throw std::runtime_error("BinaryReader : unknown record");
+    }
+  }
+  uint64_t nbroots = read_varint();
+  std::vector<uint64_t> roots;
+  for (uint64_t i = 0 ; i < nbroots ; ++i) {
+    roots.push_back(read_varint());
+  }
+  return roots;
+}
+
+const GDDD & BinaryReader::ddd (uint64_t index) const {
+  if (index >= ddd_.size()) {
+    throw std::runtime_error("BinaryReader : invalid DDD index");
+  }
+  return ddd_[index];
+}
+
+const GSDD & BinaryReader::sdd (uint64_t index) const {
+  if (index >= sdd_.size()) {
+    throw std::runtime_error("BinaryReader : invalid SDD index");
+  }
+  return sdd_[index];
+}
+
+uint64_t BinaryReader::read_varint () {
+  return d3::read_varint(is_);
+}
+
+int64_t BinaryReader::read_svarint () {
+  return d3::read_svarint(is_);
+}
+
+
+void saveDDDBinary(std::ostream& os, const std::vector<DDD>& list) {
+  BinaryWriter out (os);
+  std::vector<uint64_t> roots;
+  for (size_t i = 0 ; i < list.size() ; ++i) {
+    roots.push_back(out.write(list[i]));
+  }
+  out.finish(roots);
+}
+
+void loadDDDBinary(std::istream& is, std::vector<DDD>& list) {
+  BinaryReader in (is);
+  std::vector<uint64_t> roots = in.read();
+  list.resize(roots.size());
+  for (size_t i = 0 ; i < roots.size() ; ++i) {
+    list[i] = in.ddd(roots[i]);
+  }
+}
+
+void saveSDDBinary(std::ostream& os, const std::vector<SDD>& list) {
+  BinaryWriter out (os);
+  std::vector<uint64_t> roots;
+  for (size_t i = 0 ; i < list.size() ; ++i) {
+    roots.push_back(out.write(list[i]));
+  }
+  out.finish(roots);
+}
+
+void loadSDDBinary(std::istream& is, std::vector<SDD>& list) {
+  BinaryReader in (is);
+  std::vector<uint64_t> roots = in.read();
+  list.resize(roots.size());
+  for (size_t i = 0 ; i < roots.size() ; ++i) {
+    list[i] = in.sdd(roots[i]);
+  }
+}
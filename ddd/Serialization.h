@@ -0,0 +1,229 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+#ifndef __SERIALIZATION_H__
+#define __SERIALIZATION_H__
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "ddd/DDD.h"
+#include "ddd/SDD.h"
+#include "ddd/util/hash_support.hh"
+
+/// \file Serialization.h
+/// The binary format of DDD and SDD, and the DataSet codecs that let SDD arcs be saved.
+///
+/// A stream holds a versioned header, then records written sons first : DDD nodes, SDD nodes,
+/// and the declaration of the codecs used by SDD arcs. A DDD or SDD reached several times, 
+/// from several roots or from several levels of a hierarchy, is written once. Nodes are then
+/// referred to by their index, DDD and SDD are numbered separately, terminals null, one and top
+/// have indexes 0, 1 and 2. The stream ends with an END record and the indexes of the roots.
+
+namespace d3 {
+
+/// The son on an arc, to walk DDD and SDD with the same code.
+inline GDDD son_of (const GDDD::const_iterator & it) { return it.son(); }
+inline const GSDD & son_of (const GSDD::const_iterator & it) { return it->second; }
+
+/// Numbers the nodes reachable from a set of roots, sons before their father, so that
+/// a node can always be rebuilt from nodes numbered before it. Linear in the number of nodes.
+/// Node is GDDD or GSDD.
+template <typename Node>
+class node_numbering
+{
+  typedef std::unordered_map<Node, uint64_t, d3::util::hash<Node> > index_t;
+  index_t index_;
+  uint64_t next_;
+
+  struct frame
+  {
+    Node node;
+    typename Node::const_iterator it;
+    typename Node::const_iterator end;
+    frame (const Node & n) : node(n), it(n.begin()), end(n.end()) {}
+  };
+
+public:
+  node_numbering () : next_(0) {}
+
+  /// Number a node without visiting it, e.g. terminals that have an implicit index.
+  void assign (const Node & node) {
+    index_[node] = next_++;
+  }
+
+  /// True if the node is numbered.
+  bool contains (const Node & node) const {
+    return index_.count(node) != 0;
+  }
+
+  /// The index of a numbered node.
+  uint64_t index (const Node & node) const {
+    return index_.find(node)->second;
+  }
+
+  /// The number of numbered nodes.
+  uint64_t size () const {
+    return next_;
+  }
+
+  /// Numbers the nodes reachable from root that were not numbered yet,
+  /// calling visit(node, index) on each of them once its sons are numbered.
+  /// The traversal uses an explicit stack, its depth is the number of variables.
+  /// visit may number other nodes itself, e.g. the SDD on the arcs of an SDD node.
+  template <typename Visitor>
+  void number (const Node & root, Visitor & visit) {
+    if (index_.count(root))
+      return;
+    std::vector<frame> stack;
+    stack.push_back(frame(root));
+    while (! stack.empty()) {
+      frame & f = stack.back();
+      while (f.it != f.end && index_.count(son_of(f.it)))
+	++f.it;
+      if (f.it != f.end) {
+	Node son = son_of(f.it);
+	stack.push_back(frame(son));
+	continue;
+      }
+      // a visit may have numbered this node while its sons were visited
+      if (! index_.count(f.node)) {
+	Node node = f.node;
+	visit.prepare(node);
+	uint64_t i = next_++;
+	index_[node] = i;
+	visit(node, i);
+      }
+      stack.pop_back();
+    }
+  }
+};
+
+} // namespace d3
+
+class BinaryWriter;
+class BinaryReader;
+
+/// Saves and loads one kind of DataSet found on SDD arcs. A codec is registered in
+/// the DataSetRegistry under a name, which is written in the stream the first time the
+/// codec is used, so that the reader finds the same codec whatever the registration order.
+///
+/// Codecs for DDD, SDD and IntDataSet are built in. A custom DataSet subclass plugs in its
+/// own codec with DataSetRegistry::add().
+class DataSetCodec
+{
+public:
+  virtual ~DataSetCodec() {}
+  /// The name of the codec in streams, unique among registered codecs.
+  virtual std::string name () const = 0;
+  /// Returns true if this codec can save set, usually a test on typeid(set).
+  virtual bool handles (const DataSet & set) const = 0;
+  /// Writes the DDD and SDD that set refers to, with BinaryWriter::write(), before the
+  /// node that holds set is written. Does nothing by default.
+  virtual void prepare (BinaryWriter &, const DataSet &) const {}
+  /// Writes set. DDD and SDD are written as their index BinaryWriter::index().
+  virtual void save (BinaryWriter & out, const DataSet & set) const = 0;
+  /// Reads a set written by save(), returns a new instance owned by the caller.
+  virtual DataSet * load (BinaryReader & in) const = 0;
+};
+
+/// The registered DataSet codecs, a static class.
+class DataSetRegistry
+{
+public:
+  /// Registers a codec, the registry takes ownership of it. Codecs are tried from the
+  /// most recently added one, so a codec for a subclass of a built in type takes precedence.
+  /// Throws std::invalid_argument if a codec with the same name is registered.
+  static void add (DataSetCodec * codec);
+  /// Returns the codec that handles set, or NULL.
+  static const DataSetCodec * find (const DataSet & set);
+  /// Returns the codec with this name, or NULL.
+  static const DataSetCodec * find (const std::string & name);
+};
+
+/// Writes DDD and SDD in the binary format, each node once over the life of the writer.
+class BinaryWriter
+{
+  std::ostream & os_;
+  d3::node_numbering<GDDD> ddd_;
+  d3::node_numbering<GSDD> sdd_;
+  std::unordered_map<const DataSetCodec *, uint64_t> codecs_;
+
+  struct ddd_visitor;
+  struct sdd_visitor;
+  uint64_t codec (const DataSetCodec * c);
+public:
+  /// Writes the header.
+  BinaryWriter (std::ostream & os);
+
+  /// Writes the nodes of d that were not written yet, returns the index of d.
+  uint64_t write (const GDDD & d);
+  /// Writes the nodes of s that were not written yet, and the DataSet on their arcs,
+  /// returns the index of s. Throws std::invalid_argument if no codec handles an arc.
+  uint64_t write (const GSDD & s);
+  /// The index of a written DDD.
+  uint64_t index (const GDDD & d) const { return ddd_.index(d); }
+  /// The index of a written SDD.
+  uint64_t index (const GSDD & s) const { return sdd_.index(s); }
+  /// Ends the records and writes the indexes of the roots.
+  void finish (const std::vector<uint64_t> & roots);
+
+  /// For codecs.
+  void write_varint (uint64_t v);
+  void write_svarint (int64_t v);
+  std::ostream & stream () { return os_; }
+};
+
+/// Reads a stream written by a BinaryWriter. Throws std::runtime_error if the stream
+/// is not in this format, or is corrupted.
+class BinaryReader
+{
+  std::istream & is_;
+  std::vector<GDDD> ddd_;
+  std::vector<GSDD> sdd_;
+  std::vector<const DataSetCodec *> codecs_;
+
+  void read_ddd ();
+  void read_sdd ();
+  void read_codec ();
+public:
+  /// Reads and checks the header.
+  BinaryReader (std::istream & is);
+
+  /// Reads the records up to END, then the indexes of the roots.
+  std::vector<uint64_t> read ();
+  /// The DDD of a given index, among the ones read so far.
+  const GDDD & ddd (uint64_t index) const;
+  /// The SDD of a given index, among the ones read so far.
+  const GSDD & sdd (uint64_t index) const;
+
+  /// For codecs.
+  uint64_t read_varint ();
+  int64_t read_svarint ();
+  std::istream & stream () { return is_; }
+};
+
+#endif
@@ -24,15 +24,17 @@
 #ifndef UNIQUETABLE_H
 #define UNIQUETABLE_H
 
+#include <algorithm>
 #include <cassert>
 #include <vector>
 #include "ddd/util/hash_support.hh"
 #include "ddd/util/hash_set.hh"
+#include "ddd/util/configuration.hh"
+#include "ddd/util/op_stats.hh"
 
 
 #ifdef REENTRANT
-#include "tbb/queuing_mutex.h"
-#include "tbb/mutex.h"
+#include <mutex>
 #endif
 
 
@@ -45,23 +47,24 @@ class UniqueTable{
 private:
 	
 #ifdef REENTRANT
-  // typedef tbb::queuing_mutex table_mutex_t;
-  typedef tbb::mutex table_mutex_t;
+  // recursive : a clone may build other objects of the same table
+  typedef std::recursive_mutex table_mutex_t;
   table_mutex_t table_mutex_;
 #endif
+  /// size and peak of the table, that other threads may read, see size() and peak()
+  d3::stat_counter_t size_;
+  d3::stat_counter_t peak_;
 
 public:
   /// Constructor, builds a default table.
-  UniqueTable()
+  UniqueTable() :
 #ifdef REENTRANT
-    :
-    table_mutex_()
+    table_mutex_(),
 #endif
+    size_(0), peak_(0)
   {
-#ifndef REENTRANT
 #ifndef USE_STD_HASH
     table.set_deleted_key(NULL);
-#endif
 #endif
   }
 
@@ -69,18 +72,17 @@ public:
 #ifdef REENTRANT
     table_mutex_(),
 #endif
-  table (s)
+  size_(0), peak_(0), table (s)
   {
-#ifndef REENTRANT
 #ifndef USE_STD_HASH
     table.set_deleted_key(NULL);
-#endif
 #endif
   }
 
   /// Typedef helps hide implementation type (currently gnu gcc's hash_set).
     typedef typename d3::hash_set<const T*>::type  Table;
   /// The actual table, operations on the UniqueTable are delegated on this.
+  /// Objects are removed with erase(), that keeps size() up to date.
   Table table; // Unique table of GDDD
 
 /* Canonical */
@@ -91,27 +93,53 @@ public:
   const T*
     operator()(const T &_g)
   {
+    bool found;
+    return (*this)(_g, found);
+  }
+
+  /// As above, also tells whether the value was already in the table.
+  /// \param found set to true if the value was found, false if it was inserted.
+  const T*
+    operator()(const T &_g, bool & found)
+  {
 #ifdef REENTRANT
-    table_mutex_t::scoped_lock lock(table_mutex_);
+    std::lock_guard<table_mutex_t> lock(table_mutex_);
 #endif
 
     typename Table::const_iterator it = table.find(&_g); 
-    if (it != table.end() ) {
+    found = (it != table.end());
+    if (found) {
       return *it;
     } else {
       T * clone = unique::clone<T>() (_g);
       std::pair<typename Table::iterator, bool> ref=table.insert(clone); 
       assert(ref.second);
       ((void)ref);   
+      d3::stat_add(size_, 1);
       return clone;
     }
   }
 
+  /// Removes an object from the table, the caller deletes it. For garbage collection.
+  void erase (typename Table::iterator it) {
+    d3::stat_max(peak_, size());
+    table.erase(it);
+    d3::stat_sub(size_, 1);
+  }
+
   /// Returns the current number of filled entries in the table.
+  /// It may be called while other threads use the table.
   size_t
   size() const
   {
-    return table.size();
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  /// Returns the largest size() of the table so far, it may be called while other threads use the table.
+  size_t
+  peak() const
+  {
+    return std::max(peak_.load(std::memory_order_relaxed), size());
   }
   
 #ifdef HASH_STAT
@@ -26,17 +26,36 @@
 
 #include <cassert>
 #include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <stdint.h>
 #include "ddd/util/configuration.hh"
 #include "ddd/util/hash_support.hh"
-#include "ddd/util/hash_set.hh"
+#include "ddd/util/op_stats.hh"
+#include "ddd/util/slab_allocator.hh"
+#include "ddd/google/sparsetable"
+#include "ddd/Parallel.h"
+
+#ifdef REENTRANT
+#include <mutex>
+#endif
+
+#ifdef HASH_STAT
+#include <map>
+#include <string>
+#include <typeinfo>
+#endif
 
 // the clone contract
 
-/// Requirements on the contained type are to be cloneable, 
-/// hashable and equality comparable. 
-/// For memory recollection, it should be markable, 
-/// i.e. able 
-///  
+/// Requirements on the contained type are to be cloneable,
+/// hashable and equality comparable.
+/// For memory recollection, it should be markable,
+/// i.e. able
+///
 ///  template interface T {
 ///      T* clone () const ;
 ///      bool operator==(const T&) const;
@@ -44,7 +63,7 @@
 ///  }
 
 /// These are the comparators/hash of d3:: namespace.
-///  member hash and operator== are enough thanks to template instanciations. 
+///  member hash and operator== are enough thanks to template instanciations.
 // Additional contract requirements for the stored type T :
 // it should be cloneable. Implement clone in class C by :
 // return new C(*this);
@@ -52,140 +71,564 @@
 
 
 /// This class implements a unique table mechanism, based on a hash.
+///
+/// Objects are designated by an integer id, resolved through an index.
+/// The table is safe for concurrent lookups and insertions :
+///  - the index is segmented, segment k holds twice as many entries as segment k-1.
+///    Segments are never reallocated, so that resolve() is wait-free and
+///    a pointer into the index stays valid while other threads create nodes.
+///  - the hash table uses open addressing (linear probing) over id slots,
+///    an empty slot is claimed with a CAS. A lookup never takes a lock.
+///  - growth of the hash table freezes each slot of the old table with a CAS
+///    before rehashing it into the new one, so that no insertion can be lost or duplicated.
+///    Threads that run into a frozen slot wait for the migration to complete.
+/// Garbage collection (garbage()) is NOT concurrent, it should be called when no other
+/// thread is using the table. In a PARALLEL_DD build it runs on every thread itself : marking
+/// starts from a frontier of ids reachable from the roots, each thread with its own mark
+/// stack, and the sweep sorts and destroys ranges of ids in parallel.
+/// Also with PARALLEL_DD, each thread can have a buffer (see d3::parallel::node_buffers()) :
+/// it looks objects up in a small cache of its own before the shared table, and reserves ids
+/// in batches. Objects are still inserted in the shared table and counted in its size right
+/// away, so an id is canonical as soon as it is returned and the table grows in time.
+///
+/// Garbage collection is generational. It relies on objects only referring (through mark())
+/// to objects that were created before them, which is the case of DDD nodes and their successors.
+/// Objects that survived promote_age collections are old, and an old object only refers
+/// to old objects. So a minor collection only marks and sweeps young objects : marking stops
+/// on old objects, and they are all kept. Every major_period collections, a major collection
+/// marks and sweeps every object.
+/// Dead entries are removed from the hash table in place, the table is only rebuilt
+/// when most of its entries die.
 template<typename T, typename ID>
 class UniqueTableId {
   typedef ID id_t;
 
-  // To hash compare id's. id 0 is used as temporary id for comparisons.
-  // hash value is given by the contents of unique object.
-  // Unique objects T must implement : size_t hash () const;
-  struct id_hash {
-    size_t operator()(const id_t & id) const{      
-      if (!id) return 0;
-      return UniqueTableId::instance().resolve(id)->hash();
-    }
-  };
+  /// \name Segmented index of the unique objects.
+  //@{
+  /// Number of entries of the first segment, as a power of two.
+  static const unsigned first_seg_bits = 12;
+  /// Ids use at most 31 bits, the high bit of a slot is used to freeze it during a migration.
+  static const unsigned nb_segments = 32 - first_seg_bits;
+  /// Segment k holds entries [2^(first_seg_bits+k-1), 2^(first_seg_bits+k) ), segment 0 holds [0,2^first_seg_bits).
+  static unsigned seg_of (id_t id) {
+    if (id < (1u << first_seg_bits))
+      return 0;
+    return (31 - __builtin_clz(id)) - first_seg_bits + 1;
+  }
+  /// The size of a segment is also the first id it holds (except for segment 0).
+  static size_t seg_size (unsigned seg) {
+    return seg == 0 ? (1u << first_seg_bits) : (1u << (first_seg_bits + seg - 1));
+  }
+  static size_t seg_base (unsigned seg) {
+    return seg == 0 ? 0 : seg_size(seg);
+  }
+  //@}
 
-  // To compare id's. id 0 is used as temporary id for comparisons.
-  // compare value is given by the contents of unique object.
-  // Unique objects T must implement : bool operator == (const T & other) const;
-  struct id_compare {
-    bool operator()(const id_t & id1,const id_t & id2) const{
-      if (id1==0 || id2 == 0) {
-	// deleted key
-	return false;
+  /// \name Open addressing hash table of ids.
+  //@{
+  /// A slot is 0 when empty, holds the id of a unique object, or has its frozen bit set.
+  static const id_t frozen_bit = ((id_t) 1) << 31;
+
+  struct table_t {
+    /// capacity - 1, capacity is a power of two
+    size_t mask;
+    std::atomic<id_t> * slots;
+    /// set when a thread starts migrating this table to a larger one.
+    std::atomic<table_t *> next;
+    /// set when all entries are available in next.
+    std::atomic<bool> migrated;
+
+    table_t (size_t capacity) : mask(capacity-1), slots(new std::atomic<id_t> [capacity]), next(NULL), migrated(false) {
+      for (size_t i=0; i < capacity ; ++i) {
+	slots[i].store(0, std::memory_order_relaxed);
       }
-      return * UniqueTableId::instance().resolve(id1) == * UniqueTableId::instance().resolve(id2);
     }
+    ~table_t () { delete [] slots; }
+    size_t capacity () const { return mask + 1; }
   };
+  //@}
 
+  /// The index segments, resolution of object from Id is done with this.
+  std::atomic<const T **> segments [nb_segments];
+  /// The current hash table, holds currently valid ids.
+  std::atomic<table_t *> table;
+  /// Tables that were replaced by a larger one. They may still be read by concurrent lookups,
+  /// so they are only reclaimed on garbage().
+  std::vector<table_t *> retired;
+#ifdef REENTRANT
+  std::mutex retired_mutex;
+#endif
+  /// Number of entries in the table.
+  std::atomic<size_t> size_;
+  /// The first id that was never allocated.
+  std::atomic<id_t> next_;
+  /// The free ids collected by the last garbage(), and the position of the next one to be reused.
+  std::vector<id_t> free_ids;
+  std::atomic<size_t> free_pos;
 
-  /// Typedef helps hide implementation type.
-  /// The table wil hold actual entries for hashed unique test,
-  /// These are the currently valid ids.
-  typedef typename d3::hash_set<id_t, id_hash, id_compare>::type  table_t;
-  /// The Indexes table stores the id to (unique) T*  map.
-  /// It also stores the free list in potential spare spaces.
-  typedef typename std::vector<const T*>  indexes_t;
+#ifndef REENTRANT
   /// a sparse table holding refcounts for ref'd objects.
   /// Hopefully, we don't have more refs than there are nodes, id_t should be long enough to hold refcounts.
   typedef typename google::sparsetable<id_t> refs_t;
-  /// A bitset to store marks on objects used for mark&sweep.
-  typedef std::vector<bool> marks_t;
-
-  /// The actual table, operations on the UniqueTable are delegated on this.
-  table_t table; // Unique table of unique objects
-  /// The actual index table, resolution of object from Id is done with this
-  indexes_t index; // Index table of unique objects
-  /// The free list is stored hidden in the free space of the index table.
-  /// It is sorted by reverse deallocation order, since we only
-  /// push or pop to head. Value 0 signifies no successor(it is also the deleted key marker).
-  id_t head;
+#endif
+  /// A bitset to store marks on objects used for mark&sweep. In a PARALLEL_DD build, threads
+  /// mark concurrently, so bits are set and cleared with atomic operations on their word.
+  class marks_t {
+#ifdef PARALLEL_DD
+    typedef std::atomic<uint64_t> word_t;
+    static uint64_t load (const word_t & w) { return w.load(std::memory_order_relaxed); }
+#else
+    typedef uint64_t word_t;
+    static uint64_t load (const word_t & w) { return w; }
+#endif
+    std::unique_ptr<word_t []> words_;
+    size_t nb_words_;
+
+    marks_t (const marks_t &);
+    marks_t & operator= (const marks_t &);
+  public:
+    marks_t () : nb_words_(0) {}
+
+    size_t size () const {
+      return nb_words_ * 64;
+    }
+
+    /// Grows the bitset to hold at least n bits, the new ones are clear.
+    /// Not to be called while other threads mark.
+    void resize (size_t n) {
+      size_t nb_words = (n + 63) / 64;
+      if (nb_words <= nb_words_)
+	return;
+      nb_words = std::max(nb_words, 2 * nb_words_);
+      std::unique_ptr<word_t []> words (new word_t [nb_words]);
+      for (size_t i = 0 ; i < nb_words ; ++i) {
+	words[i] = i < nb_words_ ? load(words_[i]) : 0;
+      }
+      words_.swap(words);
+      nb_words_ = nb_words;
+    }
+
+    bool operator[] (size_t i) const {
+      return (load(words_[i / 64]) >> (i % 64)) & 1;
+    }
+
+    /// Sets bit i, returns true if it was clear.
+    bool set (size_t i) {
+      uint64_t bit = ((uint64_t) 1) << (i % 64);
+      word_t & w = words_[i / 64];
+      if (load(w) & bit)
+	return false;
+#ifdef PARALLEL_DD
+      return ! (w.fetch_or(bit, std::memory_order_relaxed) & bit);
+#else
+      w |= bit;
+      return true;
+#endif
+    }
+
+    void reset (size_t i) {
+      uint64_t bit = ((uint64_t) 1) << (i % 64);
+#ifdef PARALLEL_DD
+      words_[i / 64].fetch_and(~bit, std::memory_order_relaxed);
+#else
+      words_[i / 64] &= ~bit;
+#endif
+    }
+  };
+
+  /// The ids a thread marked and has not marked the successors of yet. Marking goes through
+  /// this stack rather than recursion, and each thread has its own.
+  struct mark_stack {
+    std::vector<id_t> ids;
+    /// true while a caller down the stack of calls pops ids, so mark() only pushes
+    bool draining;
+    mark_stack () : draining(false) {}
+  };
+
+  static mark_stack & local_stack () {
+#ifdef PARALLEL_DD
+    static thread_local mark_stack stack;
+#else
+    static mark_stack stack;
+#endif
+    return stack;
+  }
+
+  /// Marks the successors of the ids on the stack, until it is empty.
+  void drain (mark_stack & stack) {
+    stack.draining = true;
+    while (! stack.ids.empty()) {
+      id_t id = stack.ids.back();
+      stack.ids.pop_back();
+      resolve(id)->mark();
+    }
+    stack.draining = false;
+  }
+
+  /// In the parallel mark phase, the roots are expanded breadth first until there are this
+  /// many ids per thread to mark from, then each thread marks from a share of them.
+  static const size_t frontier_per_thread = 256;
+  /// Sweeps of fewer candidate ids run on the calling thread only.
+  static const size_t min_parallel_sweep = 1 << 14;
+
+#ifdef REENTRANT
+  /// The reference counters, updated from any thread with atomic operations. They are segmented
+  /// like the index, a segment of counters is allocated when an id of the segment is first ref'd.
+  std::atomic<std::atomic<id_t> *> ref_segments [nb_segments];
+
+  std::atomic<id_t> & ref_count (const id_t & id) {
+    unsigned seg = seg_of(id);
+    std::atomic<id_t> * counts = ref_segments[seg].load(std::memory_order_acquire);
+    if (counts == NULL) {
+      std::atomic<id_t> * fresh = new std::atomic<id_t> [seg_size(seg)];
+      for (size_t i = 0 ; i < seg_size(seg) ; ++i) {
+	fresh[i].store(0, std::memory_order_relaxed);
+      }
+      if (ref_segments[seg].compare_exchange_strong(counts, fresh, std::memory_order_acq_rel)) {
+	counts = fresh;
+      } else {
+	// another thread won the race, counts holds its segment
+	delete [] fresh;
+      }
+    }
+    return counts[id - seg_base(seg)];
+  }
+#else
   /// The reference counters for ref'd nodes. It is a sparse table that only stores values for non-zero entries.
   refs_t refs;
+#endif
+
+  /// Calls f on every id whose reference count is not 0. Not to be called while refs change.
+  template <typename F>
+  void for_each_root (F f) {
+#ifdef REENTRANT
+    for (unsigned seg = 0 ; seg < nb_segments ; ++seg) {
+      const std::atomic<id_t> * counts = ref_segments[seg].load(std::memory_order_acquire);
+      if (counts == NULL)
+	continue;
+      for (size_t i = 0 ; i < seg_size(seg) ; ++i) {
+	if (counts[i].load(std::memory_order_relaxed) != 0)
+	  f(id_t(seg_base(seg) + i));
+      }
+    }
+#else
+    for (typename refs_t::nonempty_iterator it = refs.nonempty_begin() ; it != refs.nonempty_end() ; ++it ) {
+      f(refs.get_pos(it));
+    }
+#endif
+  }
   /// The marking entries, a bitset
   marks_t marks;
-  // basic stats counter
-  size_t peak_size_;
+#ifdef PARALLEL_DD
+  struct local_buffer;
+  /// The buffers of the threads, that garbage collection flushes.
+  std::vector<local_buffer *> buffers_;
+  std::mutex buffers_mutex_;
+#endif
+  // basic stats counter, recorded by peak_size()
+  d3::stat_counter_t peak_size_;
+  /// Storage for the objects, for types whose unique::destroy and allocation go through arena().
+  d3::slab_arena arena_;
+
+public:
+  /// Statistics on garbage collections, see gc_stats().
+  struct gc_stats_t {
+    size_t minor_collections;
+    size_t major_collections;
+    /// objects reclaimed by the last collection, and since creation
+    size_t last_reclaimed;
+    size_t total_reclaimed;
+    /// objects that are currently old
+    size_t old_objects;
+    /// duration of the last collection of this table, and cumulated, in seconds
+    double last_pause;
+    double total_pause;
+
+    gc_stats_t () : minor_collections(0), major_collections(0), last_reclaimed(0), total_reclaimed(0),
+		    old_objects(0), last_pause(0), total_pause(0) {}
+  };
+
+  /// \name Generations
+  //@{
+  /// number of collections an object survives before it is promoted to the old generation.
+  static const unsigned char promote_age = 2;
+  /// one collection out of major_period is a major one.
+  static const unsigned major_period = 8;
+  //@}
+
+private:
+  /// Number of collections survived by each id, ids past the end have age 0.
+  std::vector<unsigned char> ages;
+  /// Young ids that survived the last collection.
+  std::vector<id_t> survivors;
+  /// next_ at the end of the last collection, ids from there on were created since.
+  id_t gc_next;
+  /// Whether the next collection is minor. As marking depends on it, it is decided at the end of the previous collection.
+  bool minor;
+  unsigned minors_since_major;
+  gc_stats_t gc_stats_;
+  /// When the ongoing collection started, set by mark_roots().
+  std::chrono::steady_clock::time_point gc_start;
+#ifdef HASH_STAT
+  std::atomic<size_t> hits_;
+  std::atomic<size_t> misses_;
+  std::atomic<size_t> bounces_;
+#endif
 
-  /// add a node to free list
-  void push (const id_t & id) {
-    // std::cerr << "b4 push (" <<id << ")"; print_free_list(std::cerr);
-    // chain head behind id 
-    index[id] =((const T*) ((size_t)head));
-    // set head to id
-    head = id;
-    // std::cerr << "after push (" <<id << ")"; print_free_list(std::cerr);
+  /// Returns the address of the index entry for id, the segment should exist.
+  const T ** entry (const id_t & id) const {
+    unsigned seg = seg_of(id);
+    return segments[seg].load(std::memory_order_acquire) + (id - seg_base(seg));
   }
 
-  /// return the next free id, either collected from free_list or
-  /// the newly allocated last position of the index table
+  /// Allocates a segment if no other thread did it first.
+  void ensure_segment (unsigned seg) {
+    if (segments[seg].load(std::memory_order_acquire) == NULL) {
+      const T ** seg_entries = new const T * [seg_size(seg)]();
+      const T ** expected = NULL;
+      if (! segments[seg].compare_exchange_strong(expected, seg_entries, std::memory_order_acq_rel)) {
+	// another thread won the race
+	delete [] seg_entries;
+      }
+    }
+  }
+
+  /// return the next free id, either collected from free_ids or
+  /// a fresh position at the end of the index
   id_t next_id () {
-    if (head == 0) {
-      id_t ret = index.size();
-      index.push_back(NULL);
-      marks.push_back(false);
-      return ret;
-    } else {
-      id_t ret = head;
-      head = (size_t) index[head];
-      marks[ret] = false;
-      return ret;
+    size_t pos = free_pos.fetch_add(1, std::memory_order_relaxed);
+    if (pos < free_ids.size()) {
+      return free_ids[pos];
     }
+    id_t ret = next_.fetch_add(1, std::memory_order_relaxed);
+    assert(ret < frozen_bit);
+    ensure_segment(seg_of(ret));
+    return ret;
   }
 
-  void print_free_list(std::ostream & os) const {
-    id_t pos = head;
-    os << "free list  ";
-    while (pos != 0) {
-      os << pos << " "; 
-      pos = (size_t) index[pos];
-      if (pos != 0) {
-	os << "," ;
+#ifdef PARALLEL_DD
+  /// \name Per thread buffers, see d3::parallel::node_buffers().
+  //@{
+  /// Number of entries of the lookup cache of a thread.
+  static const size_t buffer_cache_size = 1024;
+  /// Number of ids a thread reserves at once.
+  static const size_t buffer_batch = 64;
+
+  /// What a thread keeps aside to create objects without touching shared counters every time :
+  /// a direct mapped cache of the ids it looked up or created recently, and ids it reserved.
+  /// Garbage collection flushes every buffer, as it frees ids.
+  struct local_buffer {
+    UniqueTableId & table;
+    size_t hashes [buffer_cache_size];
+    id_t cached [buffer_cache_size];
+    std::vector<id_t> ids;
+
+    local_buffer (UniqueTableId & t) : table(t) {
+      clear_cache();
+      std::lock_guard<std::mutex> lock (table.buffers_mutex_);
+      table.buffers_.push_back(this);
+    }
+    ~local_buffer () {
+      std::lock_guard<std::mutex> lock (table.buffers_mutex_);
+      flush();
+      table.buffers_.erase(std::find(table.buffers_.begin(), table.buffers_.end(), this));
+    }
+    void clear_cache () {
+      std::fill(cached, cached + buffer_cache_size, 0);
+    }
+    /// Drops the cache and the reserved ids.
+    void flush () {
+      clear_cache();
+      ids.clear();
+    }
+  };
+
+  /// The buffer of the calling thread, NULL if buffers are not used.
+  local_buffer * local () {
+    if (! d3::parallel::node_buffers())
+      return NULL;
+    static thread_local std::unique_ptr<local_buffer> buffer;
+    if (! buffer) {
+      buffer.reset(new local_buffer (*this));
+    }
+    return buffer.get();
+  }
+
+  /// Returns an id reserved by the thread, reserving a batch of them when there is none left.
+  id_t next_id (local_buffer & buffer) {
+    if (buffer.ids.empty()) {
+      size_t pos = free_pos.fetch_add(buffer_batch, std::memory_order_relaxed);
+      for (size_t i = std::min(pos + buffer_batch, free_ids.size()) ; i > pos ; --i) {
+	buffer.ids.push_back(free_ids[i-1]);
+      }
+      if (buffer.ids.empty()) {
+	id_t first = next_.fetch_add(buffer_batch, std::memory_order_relaxed);
+	assert(first + buffer_batch <= frozen_bit);
+	for (unsigned seg = seg_of(first) ; seg <= seg_of(first + buffer_batch - 1) ; ++seg) {
+	  ensure_segment(seg);
+	}
+	for (id_t id = first + buffer_batch ; id > first ; --id) {
+	  buffer.ids.push_back(id - 1);
+	}
       }
     }
-    os << std::endl;
+    id_t id = buffer.ids.back();
+    buffer.ids.pop_back();
+    return id;
   }
 
-  void print_table(std::ostream & os) const {
-    os << "table ";
-    for(table_it di=begin() ; di!= end(); /* in loop */){
-      id_t id = *di;
-      ++di;
-      os << id << " ";
-      if (di != end()) {
-	os << ",";
-      } else {
+  /// Flushes the buffers of every thread, they should not be in use.
+  void flush_buffers () {
+    std::lock_guard<std::mutex> lock (buffers_mutex_);
+    for (typename std::vector<local_buffer *>::iterator it = buffers_.begin() ; it != buffers_.end() ; ++it) {
+      (*it)->flush();
+    }
+  }
+  //@}
+#endif
+
+  /// Insert an id in a table that no other thread is using.
+  static void insert_private (table_t * t, id_t id, size_t h) {
+    size_t i = h & t->mask;
+    while (t->slots[i].load(std::memory_order_relaxed) != 0) {
+      i = (i+1) & t->mask;
+    }
+    t->slots[i].store(id, std::memory_order_relaxed);
+  }
+
+  /// Remove id from a table that no other thread is using.
+  /// The object of id and those of its cluster should still be resolvable.
+  void erase_private (table_t * t, id_t id) {
+    size_t i = slot_hash(*resolve(id)) & t->mask;
+    while (t->slots[i].load(std::memory_order_relaxed) != id) {
+      i = (i+1) & t->mask;
+    }
+    // backward shift deletion : entries of the cluster that would become unreachable from
+    // their home position are moved into the hole, no tombstone is needed.
+    size_t j = i;
+    for (;;) {
+      j = (j+1) & t->mask;
+      id_t s = t->slots[j].load(std::memory_order_relaxed);
+      if (s == 0)
 	break;
+      size_t k = slot_hash(*resolve(s)) & t->mask;
+      // s can move to i unless its home k lies cyclically in ]i,j]
+      if ( (i <= j) ? (k <= i || k > j) : (k <= i && k > j) ) {
+	t->slots[i].store(s, std::memory_order_relaxed);
+	i = j;
+      }
+    }
+    t->slots[i].store(0, std::memory_order_relaxed);
+  }
+
+  /// Free the tables replaced by a larger one, no other thread should be reading them.
+  void release_retired () {
+    for (typename std::vector<table_t *>::iterator it = retired.begin() ; it != retired.end() ; ++it) {
+      delete *it;
+    }
+    retired.clear();
+  }
+
+  template<typename K>
+  static size_t slot_hash (const K & k) {
+    return ddd::wang32_hash(k.hash());
+  }
+
+  /// The key used by operator()(const T&), a T is its own key.
+  struct object_key {
+    const T & obj;
+    object_key (const T & o) : obj(o) {}
+    size_t hash () const { return obj.hash(); }
+    bool operator== (const T & other) const { return other == obj; }
+    T * create () const { return unique::clone<T>() (obj); }
+  };
+
+  /// Move all entries of t into a larger table, then publish it.
+  /// Only one thread (the one that set t->next) executes this.
+  void migrate (table_t * t, table_t * n) {
+    for (size_t i = 0 ; i < t->capacity() ; ++i) {
+      id_t s = t->slots[i].load(std::memory_order_acquire);
+      // freeze the slot, so that no insertion can occur there anymore
+      while (! t->slots[i].compare_exchange_weak(s, s | frozen_bit, std::memory_order_acq_rel)) {}
+      if (s != 0) {
+	insert_private(n, s, slot_hash(*resolve(s)));
       }
     }
-    os << std::endl;
+    table.store(n, std::memory_order_release);
+    t->migrated.store(true, std::memory_order_release);
   }
 
-  void print_marked(std::ostream & os) const {
-    os << "marked : ";
-    for(size_t i = 0 ; i < index.size() ; i++) {
-      if (marks[i]) {
-	os << i << " ";
+  /// Grow the table if it is more than half full.
+  void maybe_grow (table_t * t) {
+    if (size_.load(std::memory_order_relaxed) * 2 > t->capacity()
+	&& t->next.load(std::memory_order_relaxed) == NULL) {
+      table_t * expected = NULL;
+      table_t * n = new table_t (t->capacity() * 2);
+      if (t->next.compare_exchange_strong(expected, n, std::memory_order_acq_rel)) {
+	migrate(t, n);
+#ifdef REENTRANT
+	std::lock_guard<std::mutex> lock(retired_mutex);
+#endif
+	retired.push_back(t);
+      } else {
+	// another thread is migrating this table
+	delete n;
       }
     }
-    os << std::endl;
   }
 
+  /// Wait for the end of the migration of t, then return the new table.
+  table_t * wait_migration (table_t * t) {
+    while (! t->migrated.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    return t->next.load(std::memory_order_acquire);
+  }
+
+  /// Rebuild a table from scratch holding all the live ids of the index.
+  void rebuild () {
+    size_t capacity = 1u << first_seg_bits;
+    while (capacity < 2 * size_.load()) {
+      capacity *= 2;
+    }
+    table_t * n = new table_t (capacity);
+    for (id_t id = 1 ; id < next_.load() ; ++id) {
+      const T * obj = *entry(id);
+      if (obj != NULL) {
+	insert_private(n, id, slot_hash(*obj));
+      }
+    }
+    delete table.load();
+    release_retired();
+    table.store(n);
+  }
 
 public:
 
   // mark an entry to be kept
   void mark (const id_t & id) {
-    if (! marks[id]) {
-      marks[id] = true;
-      resolve(id)->mark();
+    if (minor && is_old(id)) {
+      // old objects are kept by a minor collection, and only refer to old objects.
+      return;
+    }
+    if (marks.size() <= id) {
+      marks.resize(next_.load());
+    }
+    if (marks.set(id)) {
+      mark_stack & stack = local_stack();
+      stack.ids.push_back(id);
+      if (! stack.draining) {
+	drain(stack);
+      }
     }
   }
 
   // reference a unique object.
   // refs are used as heads for mark & sweep
   void ref (const id_t & id) {
+#ifdef REENTRANT
+    ref_count(id).fetch_add(1, std::memory_order_relaxed);
+#else
     // make sure sparse table is large enough
     if (refs.size() <= id) {
       // exponential may be a bit too much
@@ -202,12 +645,18 @@ public:
       // set to 1
       refs.set(id,1);
     }
+#endif
   }
-  
+
   // dereference an object.
   // when refcount is 0, the object is collectible unless it gets marked during mark&sweep.
   void deref (const id_t & id) {
-    // assume refcount was > 0 
+#ifdef REENTRANT
+    id_t refc = ref_count(id).fetch_sub(1, std::memory_order_relaxed);
+    assert(refc != 0);
+    (void) refc;
+#else
+    // assume refcount was > 0
     assert(refs.test(id));
     id_t refc = refs.get(id);
     if (refc==1) {
@@ -218,14 +667,9 @@ public:
       // decrement
       refs.set(id, refc-1);
     }
+#endif
   }
 
-  typedef typename table_t::const_iterator table_it; 
-
-  table_it begin() const { return table.begin() ; }
-  table_it end() const { return table.end() ; }
-
-  
   static UniqueTableId & instance () {
     static UniqueTableId * const single_ = new UniqueTableId();
     return *single_;
@@ -234,58 +678,146 @@ public:
   /// Provide an initial size for both hash and index tables.
   /// Both will grow as needed if this size is exceeded.
   UniqueTableId(size_t s=4096):
-    table (s), head(0),peak_size_(0)
+    table (NULL), size_(0), next_(1), free_pos(0), peak_size_(0),
+    gc_next(1), minor(true), minors_since_major(0)
   {
-    index.reserve(s);
-    // position 0 is used for deleted key marker
-    index.push_back(NULL);
-    table.set_deleted_key(0);
-    // position 1 is reserved for hash comparisons of temporary objects.
-    index.push_back(NULL);
+    for (unsigned seg = 0 ; seg < nb_segments ; ++seg) {
+      segments[seg].store(NULL);
+    }
+    // position 0 is used for empty slot marker
+    ensure_segment(0);
+    size_t capacity = 1u << first_seg_bits;
+    while (capacity < 2 * s) {
+      capacity *= 2;
+    }
+    table.store(new table_t (capacity));
+#ifdef REENTRANT
+    for (unsigned seg = 0 ; seg < nb_segments ; ++seg) {
+      ref_segments[seg].store(NULL);
+    }
+#else
     refs.resize(s);
-    // so that marks and index always have congruent sizes.
-    marks.reserve(s);
-    marks.push_back(false);
-    marks.push_back(false);
+#endif
+#ifdef HASH_STAT
+    hits_ = 0;
+    misses_ = 0;
+    bounces_ = 0;
+#endif
   }
 
 
   const T * resolve (const id_t & id) const {
-    return index[id];
+    return *entry(id);
   }
 
 /* Canonical */
-  /// The application operator, returns the address of the value already in 
-  /// the table if it exists, or inserts and returns the address of the value inserted.
-  /// \param _g the pointer to the value we want to find in the table.
-  /// \return the address of an object stored in the UniqueTable such that (*_g == *return_value)
+  /// The application operator, returns the id of the value already in
+  /// the table if it exists, or inserts and returns the id of the value inserted.
+  /// \param _g the value we want to find in the table.
+  /// \return the id of an object stored in the UniqueTable such that (*_g == *resolve(return_value))
   id_t
     operator()(const T &_g)
   {
-    const int tmpid = 1;
-    // temporary store of object at index 0
-    index[tmpid]=&_g;
-    // look for object identical to the one at id 0
-    typename table_t::const_iterator it = table.find (tmpid);
-    // whatever happens, free index 0
-    index[tmpid]=NULL;
-
-    if (it != table.end()) {
-      // a hit, return the index found in table
-      return *it;
-    } else {
-      // copy object to unique table storage memory space.
-      // this step takes ownership for the memory, any deallocations must be done through "remove"
-      T * clone = unique::clone<T>() (_g);
+    return find_or_insert(object_key(_g));
+  }
 
-      id_t id = next_id();
-      index[id] = clone;
+  /// Lookup of an object described by a key, that need not be a T.
+  /// This avoids building a temporary T just to test whether it is already in the table.
+  /// The key type K should provide :
+  ///
+  ///  template interface K {
+  ///      size_t hash() const;              // equal to the hash() of the matching T
+  ///      bool operator==(const T&) const;  // true iff the object matches the key
+  ///      T * create() const;               // a new T matching the key, owned by the table
+  ///  }
+  /// \return the id of an object stored in the UniqueTable that matches the key
+  template<typename K>
+  id_t
+    find_or_insert(const K & key)
+  {
+    size_t h = slot_hash(key);
+    // the id and object we will insert, only built on a miss
+    id_t id = 0;
+    T * created = NULL;
+#ifdef PARALLEL_DD
+    local_buffer * buffer = local();
+    id_t * cached = NULL;
+    if (buffer != NULL) {
+      size_t c = h & (buffer_cache_size - 1);
+      cached = buffer->cached + c;
+      if (*cached != 0 && buffer->hashes[c] == h && key == *resolve(*cached)) {
+	return *cached;
+      }
+      buffer->hashes[c] = h;
+    }
+#endif
 
-      std::pair<typename table_t::iterator, bool> ref=table.insert(id); 
-      assert(ref.second);
-      ((void)ref); 
-//      access->second = id;
-      return id;
+    table_t * t = table.load(std::memory_order_acquire);
+    size_t i = h & t->mask;
+    for (;;) {
+      id_t s = t->slots[i].load(std::memory_order_acquire);
+      if (s == 0) {
+	if (created == NULL) {
+	  // build the object in unique table storage memory space.
+	  // this step takes ownership for the memory, any deallocations must be done through "garbage"
+	  created = key.create();
+#ifdef PARALLEL_DD
+	  id = buffer != NULL ? next_id(*buffer) : next_id();
+#else
+	  id = next_id();
+#endif
+	  *entry(id) = created;
+	}
+	if (t->slots[i].compare_exchange_strong(s, id, std::memory_order_acq_rel)) {
+#ifdef HASH_STAT
+	  ++misses_;
+#endif
+#ifdef PARALLEL_DD
+	  if (buffer != NULL) {
+	    *cached = id;
+	  }
+#endif
+	  size_.fetch_add(1, std::memory_order_relaxed);
+	  maybe_grow(t);
+	  return id;
+	}
+	// s now holds the value another thread stored in this slot, examine it
+      }
+      if (s == frozen_bit) {
+	// the table is being migrated, restart in the new one
+	t = wait_migration(t);
+	i = h & t->mask;
+	continue;
+      }
+      id_t sid = s & ~frozen_bit;
+      if (key == *resolve(sid)) {
+	// a hit, return the index found in table
+	if (created != NULL) {
+	  // we lost a race with another thread inserting the same object,
+	  // the id we took is recycled by the next garbage.
+	  *entry(id) = NULL;
+	  unique::destroy<T>()(created);
+#ifdef PARALLEL_DD
+	  if (buffer != NULL) {
+	    // or by this thread
+	    buffer->ids.push_back(id);
+	  }
+#endif
+	}
+#ifdef HASH_STAT
+	++hits_;
+#endif
+#ifdef PARALLEL_DD
+	if (cached != NULL) {
+	  *cached = sid;
+	}
+#endif
+	return sid;
+      }
+#ifdef HASH_STAT
+      ++bounces_;
+#endif
+      i = (i+1) & t->mask;
     }
   }
 
@@ -293,70 +825,270 @@ public:
   size_t
   size() const
   {
-    return table.size();
+    return size_.load(std::memory_order_relaxed);
   }
 
+  /// One past the largest id allocated so far, the size of a side table indexed by id.
+  id_t id_bound () const {
+    return next_.load(std::memory_order_relaxed);
+  }
+
+  /// Peak of size(), it is called between parallel computations.
   size_t peak_size () {
-    size_t siz = size();
-    if (siz > peak_size_) 
-      peak_size_=siz;  
-    return peak_size_;
+    d3::stat_max(peak_size_, size());
+    return peak_size_.load(std::memory_order_relaxed);
   }
-  
-  void garbage () {
+
+  /// Peak of size() as last recorded by peak_size() (at least on every collection), or the
+  /// current size if it is larger. Unlike peak_size(), it may be called from any thread.
+  size_t peak () const {
+    return std::max(peak_size_.load(std::memory_order_relaxed), size());
+  }
+
+  bool is_old (const id_t & id) const {
+    return id < ages.size() && ages[id] >= promote_age;
+  }
+
+  /// Whether an id will survive the ongoing collection, between mark_roots() and sweep().
+  /// Old ids are not marked in a minor collection, they always survive it.
+  bool is_marked (const id_t & id) const {
+    return (id < marks.size() && marks[id]) || (minor && is_old(id));
+  }
+
+  /// Mark phase of garbage(), it marks every id reachable from a refcounted one.
+  /// Further ids may be marked with mark() before calling sweep().
+  void mark_roots () {
+    gc_start = std::chrono::steady_clock::now();
+#ifdef PARALLEL_DD
+    flush_buffers();
+#endif
     peak_size();
-    // currently mark and sweep mode.
+    id_t end = next_.load();
+    if (marks.size() < end) {
+      marks.resize(end);
+    }
+    if (ages.size() < end) {
+      ages.resize(end, 0);
+    }
 
-    //     print_table(std::cerr);
-    //     print_free_list(std::cerr);
-    //     print_marked(std::cerr);
+    // iterate over refcounted entries only
+    if (d3::parallel::threads() == 1) {
+      for_each_root([this] (id_t id) { mark(id); });
+      return;
+    }
+    std::vector<id_t> frontier;
+    for_each_root([this, &frontier] (id_t id) {
+	if (! (minor && is_old(id)) && marks.set(id)) {
+	  frontier.push_back(id);
+	}
+      });
+    mark_parallel(frontier);
+  }
 
-    // mark phase
-    // iterate over refcounted entries only 
-    for (typename refs_t::nonempty_iterator it = refs.nonempty_begin() ; it != refs.nonempty_end() ; ++it ) {
-      id_t id = refs.get_pos(it);
-      mark(id);
-    }
-    //    std::cerr << "after mark ref'd : " ;  print_marked(std::cerr);
-
-    table_t newtable (table.size()*2);
-    newtable.set_deleted_key(0);
-    // sweep phase
-    for(table_it di=begin() ; di!= end();/*++ done in loop*/ ){
-      id_t id = *di;
-      // to avoid corruption if deleted
-//      table_it ci = di;
-      ++di;
-      if (id==0) {
-	continue;
+private:
+  /// Marks from the ids of frontier, that are marked already, on every thread.
+  void mark_parallel (std::vector<id_t> & frontier) {
+    // expand the frontier one level at a time : the successors marked by the ids of a level are
+    // pushed on the stack instead of being marked from
+    mark_stack & stack = local_stack();
+    stack.draining = true;
+    size_t wanted = d3::parallel::threads() * frontier_per_thread;
+    while (! frontier.empty() && frontier.size() < wanted) {
+      for (typename std::vector<id_t>::const_iterator it = frontier.begin() ; it != frontier.end() ; ++it) {
+	resolve(*it)->mark();
       }
-      // if not marked
-      if (! marks[id] ) {
-	// kill it
-	// mark an entry for deletion, the id should not be used again, 
-//	table.erase(ci);
-	// free memory allocated by clone
-	delete (T*) index[id];
-	// id may be recycled to designate something else.
-	push(id);
+      frontier.swap(stack.ids);
+      stack.ids.clear();
+    }
+    stack.draining = false;
+    if (frontier.empty())
+      return;
+
+    std::vector<size_t> weights (frontier.size(), 1);
+    d3::parallel::for_each(frontier.size(), &weights[0], [this, &frontier] (size_t i) {
+	mark_stack & stack = local_stack();
+	stack.ids.push_back(frontier[i]);
+	drain(stack);
+      });
+  }
+
+  /// What sweep() does with a range of candidate ids.
+  struct sweep_part {
+    /// ids that may be reused
+    std::vector<id_t> free;
+    std::vector<id_t> dead;
+    /// young ids that survived, and the number of ids that became old
+    std::vector<id_t> survivors;
+    size_t promoted;
+    sweep_part () : promoted(0) {}
+  };
+
+  /// Sorts the candidates [first,last) of sweep() into part. Ranges may be sorted concurrently.
+  void sweep_range (const id_t * first, const id_t * last, sweep_part & part) {
+    for ( ; first != last ; ++first) {
+      id_t id = *first;
+      if (*entry(id) == NULL) {
+	// a free id, or an id lost in a race
+	part.free.push_back(id);
+      } else if (marks[id]) {
+	marks.reset(id);
+	// count a collection survived
+	if (ages[id] < promote_age) {
+	  if (++ages[id] == promote_age) {
+	    ++part.promoted;
+	  } else {
+	    part.survivors.push_back(id);
+	  }
+	}
       } else {
-	newtable.insert(id);
+	part.dead.push_back(id);
       }
-      marks[id] = false;
     }
-    // cleanup
-    table = newtable;
+  }
+
+  /// Destroys the objects of the dead ids [first,last).
+  void destroy_range (const id_t * first, const id_t * last) {
+    for ( ; first != last ; ++first) {
+      const T ** e = entry(*first);
+      // kill it
+      // free memory allocated by clone
+      unique::destroy<T>()(*e);
+      *e = NULL;
+      ages[*first] = 0;
+    }
+  }
+
+  /// The number of ranges [0,n) is split in by for_ranges().
+  static size_t nb_ranges (size_t n) {
+    return (n >= min_parallel_sweep && d3::parallel::threads() > 1) ? 4 * d3::parallel::threads() : 1;
+  }
+
+  /// Runs body(r, first, last) on the nb_ranges(n) ranges of [0,n), on every thread.
+  static void for_ranges (size_t n, const std::function<void (size_t, size_t, size_t)> & body) {
+    size_t nb = nb_ranges(n);
+    if (nb == 1) {
+      body(0, 0, n);
+      return;
+    }
+    std::vector<size_t> weights (nb, 1);
+    d3::parallel::for_each(nb, &weights[0], [n, nb, &body] (size_t r) {
+	body(r, (n * r) / nb, (n * (r+1)) / nb);
+      });
+  }
 
-//          print_table(std::cerr);
-//          print_free_list(std::cerr);
+public:
+
+  void garbage () {
+    mark_roots();
+    sweep();
+  }
+
+  /// Sweep phase of garbage(), it destroys every object that was not marked since mark_roots().
+  void sweep () {
+#ifdef PARALLEL_DD
+    flush_buffers();
+#endif
+    id_t end = next_.load();
+    if (marks.size() < end) {
+      marks.resize(end);
+    }
+    if (ages.size() < end) {
+      ages.resize(end, 0);
+    }
+
+    // collect the ids that may be dead : young ones only in a minor collection.
+    std::vector<id_t> candidates;
+    std::vector<id_t> free_next;
+    if (minor) {
+      candidates.swap(survivors);
+      // the free ids that were handed out since the last collection, and those that were not
+      size_t handed = std::min(free_pos.load(), free_ids.size());
+      candidates.insert(candidates.end(), free_ids.begin(), free_ids.begin() + handed);
+      free_next.assign(free_ids.begin() + handed, free_ids.end());
+      for (id_t id = gc_next ; id < end ; ++id) {
+	candidates.push_back(id);
+      }
+    } else {
+      // we scan the whole index, this also recovers ids that were lost in a race.
+      survivors.clear();
+      gc_stats_.old_objects = 0;
+      for (id_t id = 1 ; id < end ; ++id) {
+	if (ages[id] >= promote_age && *entry(id) != NULL) {
+	  ages[id] = promote_age - 1;
+	}
+	candidates.push_back(id);
+      }
+    }
+
+    // sort the candidates by ranges, each range has its own lists, merged in order
+    std::vector<sweep_part> parts (nb_ranges(candidates.size()));
+    for_ranges(candidates.size(), [this, &candidates, &parts] (size_t r, size_t first, size_t last) {
+	sweep_range(candidates.data() + first, candidates.data() + last, parts[r]);
+      });
+    std::vector<id_t> dead;
+    for (typename std::vector<sweep_part>::const_iterator it = parts.begin() ; it != parts.end() ; ++it) {
+      free_next.insert(free_next.end(), it->free.begin(), it->free.end());
+      dead.insert(dead.end(), it->dead.begin(), it->dead.end());
+      survivors.insert(survivors.end(), it->survivors.begin(), it->survivors.end());
+      gc_stats_.old_objects += it->promoted;
+    }
+    size_t live = size_.load() - dead.size();
+
+    // remove the dead from the hash table, in place unless most entries died
+    bool must_rebuild = dead.size() > live;
+    if (! must_rebuild) {
+      table_t * t = table.load();
+      for (typename std::vector<id_t>::const_iterator it = dead.begin() ; it != dead.end() ; ++it) {
+	erase_private(t, *it);
+      }
+      release_retired();
+    }
+    for_ranges(dead.size(), [this, &dead] (size_t, size_t first, size_t last) {
+	destroy_range(dead.data() + first, dead.data() + last);
+      });
+    // ids may be recycled to designate something else.
+    free_next.insert(free_next.end(), dead.begin(), dead.end());
+    free_ids.swap(free_next);
+    free_pos.store(0);
+    size_.store(live);
+    if (must_rebuild) {
+      rebuild();
+    }
+    // give the slabs emptied by the sweep back to the OS
+    arena_.compact();
+
+    // book keeping, and choice of the next collection
+    gc_next = end;
+    if (minor) {
+      ++gc_stats_.minor_collections;
+      ++minors_since_major;
+    } else {
+      ++gc_stats_.major_collections;
+      minors_since_major = 0;
+    }
+    minor = minors_since_major + 1 < major_period;
+    gc_stats_.last_reclaimed = dead.size();
+    gc_stats_.total_reclaimed += dead.size();
+    gc_stats_.last_pause = std::chrono::duration<double>(std::chrono::steady_clock::now() - gc_start).count();
+    gc_stats_.total_pause += gc_stats_.last_pause;
+  }
+
+  /// Statistics on the garbage collections of this table. Collections update them, another
+  /// thread should read them under the lock of MemoryManager, see MemoryManager::stats_mutex().
+  gc_stats_t gc_stats () const {
+    return gc_stats_;
+  }
 
+  /// The allocator for the objects of this table, see unique::destroy.
+  d3::slab_arena & arena () {
+    return arena_;
   }
 
 
 #ifdef HASH_STAT
-  std::map<std::string, size_t> get_hits() const { return table.get_hits(); }
-  std::map<std::string, size_t> get_misses() const { return table.get_misses(); }
-  std::map<std::string, size_t> get_bounces() const { return table.get_bounces(); }
+  std::map<std::string, size_t> get_hits() const { std::map<std::string, size_t> res; res[typeid(T).name()] = hits_; return res; }
+  std::map<std::string, size_t> get_misses() const { std::map<std::string, size_t> res; res[typeid(T).name()] = misses_; return res; }
+  std::map<std::string, size_t> get_bounces() const { std::map<std::string, size_t> res; res[typeid(T).name()] = bounces_; return res; }
 #endif // HASH_STAT
 };
 
@@ -1,28 +1,30 @@
 #ifndef _D3_MANAGER_HH_
 #define _D3_MANAGER_HH_
 
-#ifdef PARALLEL_DD
-#include "tbb/task_scheduler_init.h"
-#endif
+#include "ddd/Parallel.h"
 
 namespace d3 {
 	
+/// To be built once at the start of main. In a PARALLEL_DD build, sets the number of threads
+/// that evaluate homomorphisms, or installs a whole execution context (see d3::parallel::context).
+/// With 0 threads, keeps the context already installed (by default the hardware concurrency).
 class init
 {
-private:
-	
-#ifdef PARALLEL_DD
-    tbb::task_scheduler_init tbb_init_;
-#endif
-
 public:
 
-	init()
+	init(unsigned threads = 0)
+	{
 #ifdef PARALLEL_DD
-        :
-        tbb_init_()
+		if (threads != 0)
+			d3::parallel::set_threads(threads);
+#else
+		(void) threads;
 #endif
+	}
+
+	init(const d3::parallel::context & ctx)
 	{
+		d3::parallel::install(ctx);
 	}
 	
 	~init()
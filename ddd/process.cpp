@@ -2,6 +2,7 @@
 
 // for clock
 #include <time.h>
+#include <atomic>
 
 #include <string>
 #include <cstdio>
@@ -38,12 +39,9 @@ namespace process {
 
 
 #ifdef USE_PROC_MEM 
-  static size_t page_mult_ = 0;
   static size_t page_mult () {
-    if (! page_mult_) {
-      size_t page_size = sysconf(_SC_PAGESIZE);
-      page_mult_ = page_size / 1024;
-    }
+    // initialized once, the sampler thread of MemoryManager may read the memory too
+    static const size_t page_mult_ = sysconf(_SC_PAGESIZE) / 1024;
     return page_mult_;
   }
 #endif
@@ -118,7 +116,7 @@ MemoryUsed( void )
 
 /** in Bytes */
 size_t getResidentMemory() {
-  static bool memAvailable = true;
+  static std::atomic<bool> memAvailable (true);
   if (memAvailable) {
 	unsigned long val = MemoryUsed();
 	if (val == 0) 
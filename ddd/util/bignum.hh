@@ -0,0 +1,243 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/* -*- C++ -*- */
+#ifndef _BIGNUM_HH_
+#define _BIGNUM_HH_
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdint.h>
+
+namespace d3 {
+
+/// An unsigned integer of unbounded size, for exact counts of states.
+/// Values below 2^64 are held in a machine word and use plain arithmetic, the value is
+/// promoted to 32 bit limbs only when an operation overflows, and demoted when it fits again.
+class bigcount {
+  /// the value when limbs_ is empty
+  uint64_t small_;
+  /// least significant limb first, no leading zero limb, empty when the value is small
+  std::vector<uint32_t> limbs_;
+
+  typedef std::vector<uint32_t> limbs_t;
+
+  static limbs_t to_limbs (uint64_t v) {
+    limbs_t res;
+    while (v != 0) {
+      res.push_back((uint32_t) v);
+      v >>= 32;
+    }
+    return res;
+  }
+
+  limbs_t limbs () const {
+    return limbs_.empty() ? to_limbs(small_) : limbs_;
+  }
+
+  /// Takes the value of l, held in a word if it fits.
+  void assign (limbs_t & l) {
+    while (! l.empty() && l.back() == 0)
+      l.pop_back();
+    if (l.size() <= 2) {
+      small_ = 0;
+      for (size_t i = l.size() ; i-- > 0 ; )
+	small_ = (small_ << 32) | l[i];
+      limbs_.clear();
+    } else {
+      small_ = 0;
+      limbs_.swap(l);
+    }
+  }
+
+public:
+  bigcount (uint64_t v = 0) : small_(v) {}
+
+  /// The integral part of a non negative value.
+  static bigcount from (long double v) {
+    if (! (v >= 1))
+      return bigcount(0);
+    if (v < 18446744073709551616.0L)
+      return bigcount((uint64_t) v);
+    int exp;
+    long double m = std::frexp(v, &exp);
+    // v = mantissa * 2^(exp-64), with a 64 bit mantissa
+    bigcount res ((uint64_t) std::ldexp(m, 64));
+    res.shift_left(exp - 64);
+    return res;
+  }
+
+  bool is_small () const { return limbs_.empty(); }
+
+  void shift_left (unsigned bits) {
+    limbs_t l = limbs();
+    if (l.empty())
+      return;
+    limbs_t res (bits / 32, 0);
+    unsigned s = bits % 32;
+    uint32_t carry = 0;
+    for (size_t i = 0 ; i < l.size() ; ++i) {
+      res.push_back((l[i] << s) | carry);
+      carry = s ? (l[i] >> (32 - s)) : 0;
+    }
+    res.push_back(carry);
+    assign(res);
+  }
+
+  bigcount & operator+= (const bigcount & b) {
+    if (is_small() && b.is_small()) {
+      uint64_t r = small_ + b.small_;
+      if (r >= small_) {
+	small_ = r;
+	return *this;
+      }
+    }
+    limbs_t x = limbs();
+    const limbs_t y = b.limbs();
+    if (x.size() < y.size())
+      x.resize(y.size(), 0);
+    uint64_t carry = 0;
+    for (size_t i = 0 ; i < x.size() ; ++i) {
+      uint64_t s = (uint64_t) x[i] + (i < y.size() ? y[i] : 0) + carry;
+      x[i] = (uint32_t) s;
+      carry = s >> 32;
+    }
+    if (carry)
+      x.push_back((uint32_t) carry);
+    assign(x);
+    return *this;
+  }
+
+  bigcount operator* (const bigcount & b) const {
+    if (is_small() && b.is_small()) {
+      uint64_t r;
+      if (! __builtin_mul_overflow(small_, b.small_, &r))
+	return bigcount(r);
+    }
+    const limbs_t x = limbs();
+    const limbs_t y = b.limbs();
+    if (x.empty() || y.empty())
+      return bigcount(0);
+    limbs_t r (x.size() + y.size(), 0);
+    for (size_t i = 0 ; i < x.size() ; ++i) {
+      uint64_t carry = 0;
+      for (size_t j = 0 ; j < y.size() ; ++j) {
+	uint64_t t = (uint64_t) x[i] * y[j] + r[i+j] + carry;
+	r[i+j] = (uint32_t) t;
+	carry = t >> 32;
+      }
+      r[i + y.size()] = (uint32_t) carry;
+    }
+    bigcount res;
+    res.assign(r);
+    return res;
+  }
+
+  bigcount operator+ (const bigcount & b) const {
+    bigcount res (*this);
+    res += b;
+    return res;
+  }
+
+  bool operator== (const bigcount & b) const {
+    return small_ == b.small_ && limbs_ == b.limbs_;
+  }
+  bool operator!= (const bigcount & b) const {
+    return ! (*this == b);
+  }
+  bool operator< (const bigcount & b) const {
+    if (limbs_.size() != b.limbs_.size())
+      return limbs_.size() < b.limbs_.size();
+    if (is_small())
+      return small_ < b.small_;
+    return std::lexicographical_compare(limbs_.rbegin(), limbs_.rend(), b.limbs_.rbegin(), b.limbs_.rend());
+  }
+
+  /// The closest long double, infinity if the value is too large.
+  long double to_long_double () const {
+    if (is_small())
+      return small_;
+    long double res = 0;
+    for (size_t i = limbs_.size() ; i-- > 0 ; )
+      res = res * 4294967296.0L + limbs_[i];
+    return res;
+  }
+
+  /// The base 2 logarithm, -infinity for 0.
+  double log2 () const {
+    if (is_small())
+      return small_ == 0 ? - std::numeric_limits<double>::infinity() : std::log2((double) small_);
+    // the three most significant limbs give the full precision of a double
+    size_t n = limbs_.size();
+    double top = 0;
+    for (size_t i = n ; i-- > n - 3 ; )
+      top = top * 4294967296.0 + limbs_[i];
+    return std::log2(top) + 32.0 * (n - 3);
+  }
+
+  /// The decimal representation.
+  std::string str () const {
+    if (is_small())
+      return std::to_string((unsigned long long) small_);
+    // repeated division by 10^9
+    limbs_t l = limbs_;
+    std::vector<uint32_t> chunks;
+    while (! l.empty()) {
+      uint64_t rem = 0;
+      for (size_t i = l.size() ; i-- > 0 ; ) {
+	uint64_t cur = (rem << 32) | l[i];
+	l[i] = (uint32_t) (cur / 1000000000u);
+	rem = cur % 1000000000u;
+      }
+      chunks.push_back((uint32_t) rem);
+      while (! l.empty() && l.back() == 0)
+	l.pop_back();
+    }
+    std::string res = std::to_string((unsigned long long) chunks.back());
+    for (size_t i = chunks.size() - 1 ; i-- > 0 ; ) {
+      std::string c = std::to_string((unsigned long long) chunks[i]);
+      res += std::string(9 - c.size(), '0') + c;
+    }
+    return res;
+  }
+
+  friend std::ostream & operator<< (std::ostream & os, const bigcount & b) {
+    return os << b.str();
+  }
+};
+
+/// log2(2^a + 2^b), adds two counts given by their base 2 logarithm.
+inline double log2_add (double a, double b) {
+  if (a < b)
+    std::swap(a, b);
+  if (b == - std::numeric_limits<double>::infinity())
+    return a;
+  return a + std::log2(1 + std::exp2(b - a));
+}
+
+} // namespace d3
+
+#endif
@@ -0,0 +1,141 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#ifndef _CACHE_POLICY_HH_
+#define _CACHE_POLICY_HH_
+
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include "ddd/util/configuration.hh"
+#include "ddd/util/op_stats.hh"
+
+namespace d3 {
+
+/// What becomes of the entries of operation caches on garbage collection.
+enum cache_sweep_t {
+  /// discard every entry
+  FULL_CLEAR,
+  /// keep the entries whose operands and result are all still live
+  KEEP_LIVE,
+  /// as KEEP_LIVE, but keep at most bound entries in each cache
+  KEEP_LIVE_BOUNDED
+};
+
+/// The policy used by the sweep of operation caches, set it through MemoryManager::setCachePolicy.
+/// Caches are swept after every unique table was marked : an entry is live when every
+/// operand and its result are marked.
+struct cache_policy
+{
+  cache_sweep_t mode;
+  size_t bound;
+
+  cache_policy () : mode(KEEP_LIVE), bound(0) {}
+
+  /// Whether an entry should be kept, given its liveness and the number of entries kept so far.
+  bool keep (bool live, size_t kept) const {
+    switch (mode) {
+    case FULL_CLEAR :
+      return false;
+    case KEEP_LIVE :
+      return live;
+    default :
+      return live && kept < bound;
+    }
+  }
+
+  /// The policy currently in use.
+  static cache_policy & current () {
+    static cache_policy policy;
+    return policy;
+  }
+};
+
+/// Hit, miss, insertion and eviction counters of a cache, that also measure the hit rate
+/// between the last two garbage collections, and since the last garbage collection.
+class cache_counters
+{
+  stat_counter_t hits_;
+  stat_counter_t misses_;
+  stat_counter_t insertions_;
+  stat_counter_t evictions_;
+  /// totals at the last gc, and between the two last gc : written by gc() and reset(),
+  /// under the lock of MemoryManager when it collects
+  op_stats_t at_gc_;
+  op_stats_t before_gc_;
+
+public:
+  cache_counters () : hits_(0), misses_(0), insertions_(0), evictions_(0) {}
+
+  void hit () { stat_add(hits_, 1); }
+  void miss () { stat_add(misses_, 1); }
+  void insertion () { stat_add(insertions_, 1); }
+  void eviction (size_t n = 1) { stat_add(evictions_, n); }
+
+  size_t hits () const { return hits_; }
+  size_t misses () const { return misses_; }
+
+  op_stats_t totals () const {
+    op_stats_t res;
+    res.hits = hits_;
+    res.misses = misses_;
+    res.insertions = insertions_;
+    res.evictions = evictions_;
+    return res;
+  }
+
+  /// To be called on garbage collection, once evictions are counted.
+  void gc () {
+    op_stats_t now = totals();
+    before_gc_ = now - at_gc_;
+    at_gc_ = now;
+  }
+
+  /// Counters between the two last gc, and since the last gc.
+  op_stats_t before_gc () const { return before_gc_; }
+  op_stats_t since_gc () const { return totals() - at_gc_; }
+
+  /// Hit rate in percent, overall, between the two last gc, and since the last gc.
+  double hit_rate () const { return totals().hit_rate(); }
+  double hit_rate_before_gc () const { return before_gc_.hit_rate(); }
+  double hit_rate_since_gc () const { return since_gc().hit_rate(); }
+
+  void reset () {
+    hits_ = 0;
+    misses_ = 0;
+    insertions_ = 0;
+    evictions_ = 0;
+    at_gc_ = op_stats_t();
+    before_gc_ = op_stats_t();
+  }
+
+  void print (std::ostream & os, const std::string & name) const {
+    os << name << " hit rate : " << hit_rate() << "% (" << hits() << "/" << misses() << "), "
+       << hit_rate_before_gc() << "% before last gc, " << hit_rate_since_gc() << "% since" << std::endl;
+  }
+};
+
+} // namespace d3
+
+#endif /* _CACHE_POLICY_HH_ */
@@ -0,0 +1,167 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#ifndef _DIRECT_MAPPED_HH_
+#define _DIRECT_MAPPED_HH_
+
+#include <cstddef>
+#include <vector>
+#include "ddd/util/configuration.hh"
+#include "ddd/util/hash_support.hh"
+#include "ddd/util/op_stats.hh"
+
+#ifdef REENTRANT
+#include <mutex>
+#endif
+
+namespace d3 {
+
+/// A fixed size, direct mapped and lossy table : each key maps to a single slot, and a new entry
+/// overwrites the one in its slot. Used as the bounded mode of operation caches, memory is
+/// allocated once in resize() and the table never rehashes.
+/// Key and Data should be default constructible, empty slots hold default values.
+template
+<
+  typename Key,
+  typename Data,
+  typename HashKey = d3::util::hash<Key>,
+  typename EqualKey = d3::util::equal<Key>
+>
+class direct_mapped_cache
+{
+  struct slot
+  {
+    bool used;
+    Key key;
+    Data data;
+    slot () : used(false), key(), data() {}
+  };
+
+  std::vector<slot> slots_;
+  size_t mask_;
+  /// number of slots, see capacity()
+  stat_counter_t capacity_;
+  /// number of used slots, updated under the locks of different slots
+  stat_counter_t size_;
+  /// number of entries overwritten by another key
+  stat_counter_t evictions_;
+#ifdef REENTRANT
+  /// slots are protected by striped locks
+  static const size_t nb_locks = 64;
+  std::mutex locks_ [nb_locks];
+#endif
+
+  size_t index (const Key & key) const {
+    return ddd::wang32_hash(HashKey() (key)) & mask_;
+  }
+
+public:
+  direct_mapped_cache () : mask_(0), capacity_(0), size_(0), evictions_(0) {}
+
+  /// Sets the number of slots, rounded up to a power of two, and discards every entry.
+  /// Zero frees the table.
+  void resize (size_t nb_slots) {
+    size_t n = 1;
+    while (n < nb_slots)
+      n <<= 1;
+    std::vector<slot> fresh (nb_slots == 0 ? 0 : n);
+    slots_.swap(fresh);
+    mask_ = slots_.empty() ? 0 : slots_.size() - 1;
+    capacity_ = slots_.size();
+    size_ = 0;
+  }
+
+  /// Number of slots, zero if the table is not allocated. Like size() and evictions(), it may
+  /// be read while another thread uses the table.
+  size_t capacity () const {
+    return capacity_.load(std::memory_order_relaxed);
+  }
+
+  size_t size () const {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  size_t evictions () const {
+    return evictions_.load(std::memory_order_relaxed);
+  }
+
+  /// Bytes held by the slots.
+  size_t bytes () const {
+    return capacity() * sizeof(slot);
+  }
+
+  /// Copies the data of key into data and returns true, if key is in the table.
+  bool find (const Key & key, Data & data) {
+    size_t i = index(key);
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock(locks_[i % nb_locks]);
+#endif
+    const slot & s = slots_[i];
+    if (s.used && EqualKey() (s.key, key)) {
+      data = s.data;
+      return true;
+    }
+    return false;
+  }
+
+  /// Stores an entry, overwriting the one in its slot.
+  void insert (const Key & key, const Data & data) {
+    size_t i = index(key);
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock(locks_[i % nb_locks]);
+#endif
+    slot & s = slots_[i];
+    if (! s.used) {
+      s.used = true;
+      stat_add(size_, 1);
+    } else if (! EqualKey() (s.key, key)) {
+      stat_add(evictions_, 1);
+    }
+    s.key = key;
+    s.data = data;
+  }
+
+  /// Empties every slot, releasing the keys and data they held.
+  void clear () {
+    for (typename std::vector<slot>::iterator it = slots_.begin() ; it != slots_.end() ; ++it) {
+      *it = slot();
+    }
+    size_ = 0;
+  }
+
+  /// Empties the slots whose entry is rejected by keep(key, data). Not thread safe.
+  template <typename Keep>
+  void filter (Keep keep) {
+    for (typename std::vector<slot>::iterator it = slots_.begin() ; it != slots_.end() ; ++it) {
+      if (it->used && ! keep(it->key, it->data)) {
+	*it = slot();
+	stat_sub(size_, 1);
+      }
+    }
+  }
+};
+
+} // namespace d3
+
+#endif /* _DIRECT_MAPPED_HH_ */
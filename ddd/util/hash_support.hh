@@ -235,6 +235,18 @@ struct clone
   }
 };
 
+/// Destruction of an object owned by a unique table, the counterpart of clone.
+/// Specialize it for types that are not allocated with the standard operator new.
+template<typename T>
+struct destroy
+{
+  void
+  operator()(const T* e1) const
+  {
+    delete e1;
+  }
+};
+
   
 template<>
 struct clone<std::vector<int> >
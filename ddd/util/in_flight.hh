@@ -0,0 +1,205 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#ifndef _IN_FLIGHT_HH_
+#define _IN_FLIGHT_HH_
+
+#include <cstddef>
+#include "ddd/util/configuration.hh"
+#include "ddd/util/hash_support.hh"
+#include "ddd/Parallel.h"
+
+#ifdef REENTRANT
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace d3 { namespace util
+{
+
+/// The computations that are running on some thread, so that another thread that needs the same
+/// one waits for its result instead of computing it again. Used by the operation caches in
+/// REENTRANT builds; otherwise every claim is granted and nothing is stored.
+///
+/// A thread claims a key before computing it. If the key is free the thread owns it until the
+/// ticket is destroyed, after it published its result. If another thread owns it the caller
+/// waits, then looks the result up again : if it is still missing (the owner threw, or did not
+/// cache it) the caller computes it without owning it.
+///
+/// A thread never waits for itself or in a cycle of waiting threads : that happens when a thread
+/// that owns a key helps run other tasks while joining, and one of them needs the key. Nor does
+/// it wait for an owner that is running a d3::parallel::for_each : the owner may be blocked
+/// joining tasks, which the cycle check cannot see, and its sons are computed by other threads
+/// whose keys are claimed in turn, so computing the key again mostly waits for those. Other waits
+/// give up after d3::parallel::max_wait() ms, and the caller computes the key itself.
+template
+<
+  typename Key,
+  typename HashKey = d3::util::hash<Key>,
+  typename EqualKey = d3::util::equal<Key>
+>
+class in_flight
+{
+#ifdef REENTRANT
+  typedef d3::parallel::thread_state waiter;
+
+  struct entry {
+    Key key;
+    const waiter * owner;
+  };
+
+  struct shard {
+    std::mutex lock;
+    std::condition_variable done;
+    std::vector<entry> pending;
+  };
+
+  static const size_t nb_shards = 64;
+  shard shards_ [nb_shards];
+  std::atomic<size_t> waits_;
+  std::atomic<size_t> bypasses_;
+  std::atomic<size_t> timeouts_;
+
+  shard & shard_of (size_t hash) {
+    return shards_[ddd::wang32_hash(hash) % nb_shards];
+  }
+
+  static typename std::vector<entry>::iterator find (std::vector<entry> & pending, const Key & key) {
+    typename std::vector<entry>::iterator it = pending.begin();
+    while (it != pending.end() && ! EqualKey() (it->key, key))
+      ++it;
+    return it;
+  }
+
+  /// True if the owner waits, directly or not, on the calling thread.
+  static bool cycle (const waiter * owner, const waiter & self) {
+    for (const waiter * w = owner ; w != NULL ; w = w->waits_on.load()) {
+      if (w == &self)
+	return true;
+    }
+    return false;
+  }
+
+  void release (shard & s, const Key & key) {
+    {
+      std::lock_guard<std::mutex> lock (s.lock);
+      s.pending.erase(find(s.pending, key));
+    }
+    s.done.notify_all();
+  }
+
+public:
+  /// Ownership of a claimed key, released when destroyed.
+  class ticket {
+    in_flight * table_;
+    shard * shard_;
+    Key key_;
+    ticket (const ticket &);
+    ticket & operator= (const ticket &);
+  public:
+    ticket (in_flight * table, shard * s, const Key & key) : table_(table), shard_(s), key_(key) {}
+    ticket (ticket && other) : table_(other.table_), shard_(other.shard_), key_(other.key_) {
+      other.table_ = NULL;
+    }
+    ~ticket () {
+      if (table_ != NULL)
+	table_->release(*shard_, key_);
+    }
+    /// True if the caller computes the key for the others, false if it should look it up again.
+    bool owner () const { return table_ != NULL; }
+  };
+
+  in_flight () : waits_(0), bypasses_(0), timeouts_(0) {}
+
+  /// Claims key. Blocks while another thread computes it.
+  ticket claim (const Key & key) {
+    return claim(key, HashKey() (key));
+  }
+
+  /// As above, when the hash of key is already known.
+  ticket claim (const Key & key, size_t hash) {
+    shard & s = shard_of(hash);
+    waiter & self = d3::parallel::this_thread();
+    std::unique_lock<std::mutex> lock (s.lock);
+    typename std::vector<entry>::iterator it = find(s.pending, key);
+    if (it == s.pending.end()) {
+      entry e = { key, &self };
+      s.pending.push_back(e);
+      return ticket (this, &s, key);
+    }
+    std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(d3::parallel::max_wait());
+    do {
+      const waiter * owner = it->owner;
+      // publish the wait before looking for a cycle, so two threads closing one see each other
+      self.waits_on.store(owner);
+      if (cycle(owner, self) || owner->forking.load() != 0) {
+	self.waits_on.store(NULL);
+	++bypasses_;
+	return ticket (NULL, NULL, key);
+      }
+      // wake up every ms to see whether the owner started forking
+      std::chrono::steady_clock::time_point until =
+	std::min(deadline, std::chrono::steady_clock::now() + std::chrono::milliseconds(1));
+      s.done.wait_until(lock, until);
+      self.waits_on.store(NULL);
+      it = find(s.pending, key);
+      if (it != s.pending.end() && std::chrono::steady_clock::now() >= deadline) {
+	++bypasses_;
+	++timeouts_;
+	return ticket (NULL, NULL, key);
+      }
+    } while (it != s.pending.end());
+    ++waits_;
+    return ticket (NULL, NULL, key);
+  }
+
+  /// The number of claims that waited for another thread, that computed the key again instead,
+  /// and among those the ones that waited max_wait() first.
+  size_t waits () const { return waits_.load(); }
+  size_t bypasses () const { return bypasses_.load(); }
+  size_t timeouts () const { return timeouts_.load(); }
+
+#else
+public:
+  class ticket {
+  public:
+    bool owner () const { return true; }
+  };
+
+  ticket claim (const Key &) { return ticket(); }
+  ticket claim (const Key &, size_t) { return ticket(); }
+  size_t waits () const { return 0; }
+  size_t bypasses () const { return 0; }
+  size_t timeouts () const { return 0; }
+#endif
+};
+
+}} // namespace d3::util
+
+#endif /* _IN_FLIGHT_HH_ */
@@ -0,0 +1,300 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#ifndef _OP_STATS_HH_
+#define _OP_STATS_HH_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include "ddd/util/configuration.hh"
+
+#include <atomic>
+#ifdef REENTRANT
+#include <mutex>
+#endif
+
+namespace d3 {
+
+/// A statistic counter. MemoryManager::snapshot() may read it from its sampler thread, so it
+/// is atomic in every build; only REENTRANT builds pay for atomic increments.
+typedef std::atomic<size_t> stat_counter_t;
+
+/// Adds n to a statistic counter. Without REENTRANT the library is used by a single thread,
+/// the only writer, so a relaxed load and store is enough.
+inline void stat_add (stat_counter_t & c, size_t n) {
+#ifdef REENTRANT
+  c.fetch_add(n, std::memory_order_relaxed);
+#else
+  c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+#endif
+}
+
+/// Subtracts n from a statistic counter, see stat_add().
+inline void stat_sub (stat_counter_t & c, size_t n) {
+#ifdef REENTRANT
+  c.fetch_sub(n, std::memory_order_relaxed);
+#else
+  c.store(c.load(std::memory_order_relaxed) - n, std::memory_order_relaxed);
+#endif
+}
+
+/// Raises a peak statistic to at least value.
+inline void stat_max (stat_counter_t & peak, size_t value) {
+  size_t p = peak.load(std::memory_order_relaxed);
+  while (p < value && ! peak.compare_exchange_weak(p, value, std::memory_order_relaxed)) {
+  }
+}
+
+/// Counters of an operation cache, for one kind of operation or in total.
+struct op_stats_t
+{
+  /// lookups that found the operation in the cache
+  size_t hits;
+  /// lookups that had to compute the operation
+  size_t misses;
+  /// entries added to the cache
+  size_t insertions;
+  /// entries discarded by garbage collection
+  size_t evictions;
+
+  op_stats_t () : hits(0), misses(0), insertions(0), evictions(0) {}
+
+  /// Hit rate in percent.
+  double hit_rate () const {
+    return (hits + misses) == 0 ? 0 : double (hits * 100) / double (hits + misses);
+  }
+
+  op_stats_t & operator+= (const op_stats_t & other) {
+    hits += other.hits;
+    misses += other.misses;
+    insertions += other.insertions;
+    evictions += other.evictions;
+    return *this;
+  }
+
+  op_stats_t operator- (const op_stats_t & other) const {
+    op_stats_t res (*this);
+    res.hits -= other.hits;
+    res.misses -= other.misses;
+    res.insertions -= other.insertions;
+    res.evictions -= other.evictions;
+    return res;
+  }
+};
+
+/// Statistics on an operation cache (e.g. the DED or SDED table), see DED::stats().
+struct op_cache_stats_t
+{
+  /// current and peak number of entries
+  size_t size;
+  size_t peak;
+  /// estimate of the bytes held by the entries
+  size_t bytes;
+  /// counters per kind of operation, with the name of the kind
+  std::vector< std::pair<std::string, op_stats_t> > ops;
+  /// sum of the counters of ops
+  op_stats_t total;
+  /// counters between the two last garbage collections, and since the last one
+  op_stats_t before_gc;
+  op_stats_t since_gc;
+
+  op_cache_stats_t () : size(0), peak(0), bytes(0) {}
+
+  void print (std::ostream & os) const {
+    os << "Cache hit rate : " << total.hit_rate() << "% (" << total.hits << "/" << (total.hits + total.misses) << "), "
+       << before_gc.hit_rate() << "% before last gc, " << since_gc.hit_rate() << "% since" << std::endl;
+    for (size_t i = 0 ; i < ops.size() ; ++i) {
+      const op_stats_t & op = ops[i].second;
+      if (op.hits + op.misses + op.evictions == 0)
+	continue;
+      os << "  " << ops[i].first << " : " << op.hit_rate() << "% hits (" << op.hits << "/" << (op.hits + op.misses) << "), "
+	 << op.insertions << " insertions, " << op.evictions << " evictions" << std::endl;
+    }
+  }
+};
+
+/// Per kind counters of an operation cache, Kind is an enumeration of N kinds.
+/// In REENTRANT builds each thread increments its own counters, they are summed on read.
+/// Tag distinguishes the instances, there should be at most one per Tag.
+/// The totals at the last collections are written by gc() and reset(), under the lock of
+/// MemoryManager, that fill() should also hold when called from another thread.
+template <typename Tag, unsigned N>
+class op_counters
+{
+  typedef stat_counter_t counter_t;
+
+  /// the counters of a thread
+  struct block
+  {
+    counter_t hits [N];
+    counter_t misses [N];
+    counter_t insertions [N];
+    counter_t evictions [N];
+
+    block () {
+      clear();
+    }
+
+    void clear () {
+      for (unsigned k = 0 ; k < N ; ++k) {
+	hits[k] = 0;
+	misses[k] = 0;
+	insertions[k] = 0;
+	evictions[k] = 0;
+      }
+    }
+  };
+
+#ifdef REENTRANT
+  /// every block ever handed to a thread, kept until destruction so that counts survive threads
+  std::vector<block *> blocks_;
+  mutable std::mutex blocks_mutex_;
+
+  block & local () {
+    static thread_local block * mine = NULL;
+    if (mine == NULL) {
+      mine = new block();
+      std::lock_guard<std::mutex> lock(blocks_mutex_);
+      blocks_.push_back(mine);
+    }
+    return *mine;
+  }
+
+  static size_t load (const counter_t & c) {
+    return c.load(std::memory_order_relaxed);
+  }
+
+  static void add (counter_t & c, size_t n) {
+    // only the owner thread writes to a block
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+#else
+  block block_;
+
+  block & local () {
+    return block_;
+  }
+
+  static size_t load (const counter_t & c) {
+    return c.load(std::memory_order_relaxed);
+  }
+
+  static void add (counter_t & c, size_t n) {
+    stat_add(c, n);
+  }
+#endif
+
+  /// totals at the last two garbage collections
+  op_stats_t at_gc_;
+  op_stats_t before_gc_;
+
+  op_stats_t read (unsigned kind) const {
+    op_stats_t res;
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock(blocks_mutex_);
+    for (typename std::vector<block *>::const_iterator it = blocks_.begin() ; it != blocks_.end() ; ++it) {
+      const block & b = **it;
+#else
+    {
+      const block & b = block_;
+#endif
+      res.hits += load(b.hits[kind]);
+      res.misses += load(b.misses[kind]);
+      res.insertions += load(b.insertions[kind]);
+      res.evictions += load(b.evictions[kind]);
+    }
+    return res;
+  }
+
+public:
+  op_counters () {}
+
+#ifdef REENTRANT
+  ~op_counters () {
+    for (typename std::vector<block *>::iterator it = blocks_.begin() ; it != blocks_.end() ; ++it) {
+      delete *it;
+    }
+  }
+#endif
+
+  void hit (unsigned kind) { add(local().hits[kind], 1); }
+  void miss (unsigned kind) { add(local().misses[kind], 1); }
+  void insertion (unsigned kind) { add(local().insertions[kind], 1); }
+  void eviction (unsigned kind, size_t n = 1) { add(local().evictions[kind], n); }
+
+  /// The counters of a kind.
+  op_stats_t stats (unsigned kind) const {
+    return read(kind);
+  }
+
+  /// The sum over all kinds.
+  op_stats_t total () const {
+    op_stats_t res;
+    for (unsigned k = 0 ; k < N ; ++k) {
+      res += read(k);
+    }
+    return res;
+  }
+
+  /// To be called on garbage collection, once evictions are counted.
+  void gc () {
+    op_stats_t now = total();
+    before_gc_ = now - at_gc_;
+    at_gc_ = now;
+  }
+
+  /// Fills the counters of an op_cache_stats_t, names holds the N names of the kinds.
+  void fill (op_cache_stats_t & res, const char * const * names) const {
+    res.ops.clear();
+    res.total = op_stats_t();
+    for (unsigned k = 0 ; k < N ; ++k) {
+      op_stats_t op = read(k);
+      res.ops.push_back(std::make_pair(std::string(names[k]), op));
+      res.total += op;
+    }
+    res.before_gc = before_gc_;
+    res.since_gc = res.total - at_gc_;
+  }
+
+  /// Resets the counters, only when no other thread is counting.
+  void reset () {
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock(blocks_mutex_);
+    for (typename std::vector<block *>::iterator it = blocks_.begin() ; it != blocks_.end() ; ++it) {
+      (*it)->clear();
+    }
+#else
+    block_.clear();
+#endif
+    at_gc_ = op_stats_t();
+    before_gc_ = op_stats_t();
+  }
+};
+
+} // namespace d3
+
+#endif /* _OP_STATS_HH_ */
@@ -0,0 +1,163 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#ifndef _SHARDED_TABLE_HH_
+#define _SHARDED_TABLE_HH_
+
+#include <cassert>
+#include <cstddef>
+#include "ddd/util/hash_support.hh"
+#include "ddd/util/hash_set.hh"
+#include "ddd/util/in_flight.hh"
+#include "ddd/util/op_stats.hh"
+
+#ifdef REENTRANT
+#include <mutex>
+#endif
+
+namespace d3 { namespace util
+{
+
+/// A unicity table for objects whose clone is expensive, like the operations of the DED and
+/// SDED caches that evaluate their result when cloned. Works as UniqueTable, except that in
+/// REENTRANT builds it is split in shards with a lock each, the clone runs outside of any lock,
+/// and two threads never clone the same object at once (see in_flight).
+/// The table owns the clones, garbage collection goes through sweep().
+template<typename T>
+class sharded_table
+{
+public:
+  typedef typename d3::hash_set<const T*>::type Table;
+
+private:
+#ifdef REENTRANT
+  static const size_t nb_shards = 64;
+#else
+  static const size_t nb_shards = 1;
+#endif
+
+  struct shard {
+#ifdef REENTRANT
+    std::mutex lock;
+#endif
+    Table table;
+    shard () {
+#ifndef USE_STD_HASH
+      table.set_deleted_key(NULL);
+#endif
+    }
+  };
+
+  shard shards_ [nb_shards];
+  in_flight<const T*> in_flight_;
+  /// number of objects in the shards, that other threads may read, see size()
+  stat_counter_t size_;
+
+  shard & shard_of (size_t hash) {
+    return shards_[ddd::wang32_hash(hash) % nb_shards];
+  }
+
+  /// The object equal to t in s, or NULL.
+  static const T * find (shard & s, const T & t) {
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock (s.lock);
+#endif
+    typename Table::const_iterator it = s.table.find(&t);
+    return it == s.table.end() ? NULL : *it;
+  }
+
+public:
+  sharded_table () : size_(0) {}
+
+  /// Returns the object equal to t in the table, cloning t into the table if there is none.
+  /// \param found set to true if the object was already in the table.
+  const T * operator() (const T & t, bool & found) {
+    size_t hash = d3::util::hash<const T*>() (&t);
+    shard & s = shard_of(hash);
+    const T * res = find(s, t);
+    found = (res != NULL);
+    if (found)
+      return res;
+
+    typename in_flight<const T*>::ticket ticket = in_flight_.claim(&t, hash);
+    if (! ticket.owner()) {
+      // another thread cloned it meanwhile
+      res = find(s, t);
+      found = (res != NULL);
+      if (found)
+	return res;
+    }
+    T * clone = unique::clone<T>() (t);
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock (s.lock);
+#endif
+    std::pair<typename Table::iterator, bool> ref = s.table.insert(clone);
+    if (! ref.second) {
+      // a thread that gave up waiting for us, or that we gave up on, got there first
+      delete clone;
+      found = true;
+      return *ref.first;
+    }
+    stat_add(size_, 1);
+    return clone;
+  }
+
+  /// Returns the current number of objects in the table, it may be called while other threads use the table.
+  size_t size () const {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+  /// Deletes the objects for which dead returns true. Not to be called while other threads use
+  /// the table.
+  template <typename Pred>
+  void sweep (Pred dead) {
+    for (size_t i = 0 ; i < nb_shards ; ++i) {
+      Table & table = shards_[i].table;
+      size_t kept = 0;
+      for (typename Table::iterator it = table.begin() ; it != table.end() ; ) {
+	typename Table::iterator ci = it;
+	++it;
+	const T * t = *ci;
+	if (dead(t)) {
+	  table.erase(ci);
+	  stat_sub(size_, 1);
+	  delete t;
+	} else {
+	  ++kept;
+	}
+      }
+      if (kept == 0)
+	table.clear();
+    }
+  }
+
+  /// The number of lookups that waited for another thread to clone, and that gave up waiting.
+  size_t waits () const { return in_flight_.waits(); }
+  size_t bypasses () const { return in_flight_.bypasses(); }
+  size_t timeouts () const { return in_flight_.timeouts(); }
+};
+
+}} // namespace d3::util
+
+#endif /* _SHARDED_TABLE_HH_ */
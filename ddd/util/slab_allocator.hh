@@ -0,0 +1,348 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/* -*- C++ -*- */
+#ifndef _SLAB_ALLOCATOR_HH_
+#define _SLAB_ALLOCATOR_HH_
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+#include "ddd/util/configuration.hh"
+#include "ddd/util/op_stats.hh"
+
+#ifdef REENTRANT
+#include <mutex>
+#endif
+
+namespace d3 {
+
+/// A size class slab allocator, for objects that are created often and mostly freed in bulk,
+/// typically the nodes of a unique table that are reclaimed by garbage collection.
+///
+/// Objects are grouped by size (a multiple of granularity) into slabs of slab_bytes.
+/// Objects larger than max_small bytes fall back to the global operator new.
+/// Slabs are aligned on their size, so that the slab owning an object is found by masking its address.
+/// Each slab keeps its own free list and count of live objects, so that compact() can return
+/// slabs that became empty to the OS, and direct new allocations to the densest slabs.
+class slab_arena
+{
+public:
+  /// Size of a slab, a power of two. Slabs are mapped directly so that they are given back to the OS when released.
+  static const size_t slab_bytes = 1 << 16;
+  /// Object sizes are rounded up to a multiple of this.
+  static const size_t granularity = 8;
+  /// Larger objects are allocated with the global operator new.
+  static const size_t max_small = 512;
+  static const size_t nb_classes = max_small / granularity + 1;
+
+  /// Allocator statistics, see stats().
+  struct stats_t
+  {
+    /// Number of slabs currently mapped.
+    size_t slabs;
+    /// Bytes currently mapped for slabs.
+    size_t reserved_bytes;
+    /// Peak of reserved_bytes.
+    size_t peak_reserved_bytes;
+    /// Bytes used by live small objects.
+    size_t used_bytes;
+    /// Live objects allocated with the global operator new and their size.
+    size_t large_objects;
+    size_t large_bytes;
+    /// Slabs given back to the OS by compact(), since creation and by the last call.
+    size_t released_slabs;
+    size_t last_released_slabs;
+
+    stats_t () : slabs(0), reserved_bytes(0), peak_reserved_bytes(0), used_bytes(0),
+		 large_objects(0), large_bytes(0), released_slabs(0), last_released_slabs(0) {}
+  };
+
+private:
+  /// The header of a slab, objects follow it.
+  struct slab
+  {
+    /// intrusive list of freed objects in this slab
+    void * free_list;
+    /// next never allocated position, and end of the slab
+    char * bump;
+    char * limit;
+    unsigned cls;
+    unsigned live;
+    /// true if the slab is in its class available list (or is the current slab)
+    bool listed;
+  };
+
+  /// Objects start after the slab header, suitably aligned.
+  static const size_t header_bytes = (sizeof(slab) + 15) & ~ (size_t) 15;
+
+  struct size_class
+  {
+    /// the slab we are allocating from
+    slab * current;
+    /// slabs that have free room, besides current
+    std::vector<slab *> available;
+    /// every slab of this class
+    std::vector<slab *> slabs;
+    /// bytes used by live objects of this class, see live_bytes()
+    stat_counter_t used_bytes;
+#ifdef REENTRANT
+    std::mutex mutex;
+#endif
+    size_class () : current(NULL), used_bytes(0) {}
+  };
+
+  size_class classes_ [nb_classes];
+  /// global counters, the per class ones are aggregated by stats()
+  size_t reserved_bytes_;
+  size_t peak_reserved_bytes_;
+  size_t large_objects_;
+  stat_counter_t large_bytes_;
+  size_t released_slabs_;
+  size_t last_released_slabs_;
+#ifdef REENTRANT
+  std::mutex stats_mutex_;
+#endif
+
+  static size_t class_of (size_t bytes) {
+    return (bytes + granularity - 1) / granularity;
+  }
+
+  static slab * slab_of (void * addr) {
+    return reinterpret_cast<slab *> (reinterpret_cast<uintptr_t> (addr) & ~ (uintptr_t) (slab_bytes - 1));
+  }
+
+  static void * map_slab () {
+#ifdef _WIN32
+    void * p = _aligned_malloc(slab_bytes, slab_bytes);
+    if (p == NULL)
+      throw std::bad_alloc();
+    return p;
+#else
+    // over allocate, then trim to get an aligned slab
+    char * p = (char *) mmap(NULL, 2 * slab_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+    char * aligned = (char *) ((reinterpret_cast<uintptr_t> (p) + slab_bytes - 1) & ~ (uintptr_t) (slab_bytes - 1));
+    if (aligned != p)
+      munmap(p, aligned - p);
+    char * end = p + 2 * slab_bytes;
+    if (end != aligned + slab_bytes)
+      munmap(aligned + slab_bytes, end - (aligned + slab_bytes));
+    return aligned;
+#endif
+  }
+
+  static void unmap_slab (slab * s) {
+#ifdef _WIN32
+    _aligned_free(s);
+#else
+    munmap(s, slab_bytes);
+#endif
+  }
+
+  slab * new_slab (size_t cls) {
+    slab * s = new (map_slab()) slab();
+    s->free_list = NULL;
+    s->bump = reinterpret_cast<char *> (s) + header_bytes;
+    s->limit = reinterpret_cast<char *> (s) + slab_bytes;
+    s->cls = cls;
+    s->live = 0;
+    s->listed = true;
+    classes_[cls].slabs.push_back(s);
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+#endif
+    reserved_bytes_ += slab_bytes;
+    if (reserved_bytes_ > peak_reserved_bytes_)
+      peak_reserved_bytes_ = reserved_bytes_;
+    return s;
+  }
+
+  /// Take an object of obj_bytes from s, or return NULL if it is full.
+  static void * take (slab * s, size_t obj_bytes) {
+    void * res = s->free_list;
+    if (res != NULL) {
+      s->free_list = * reinterpret_cast<void **> (res);
+    } else if (s->bump + obj_bytes <= s->limit) {
+      res = s->bump;
+      s->bump += obj_bytes;
+    } else {
+      return NULL;
+    }
+    ++s->live;
+    return res;
+  }
+
+public:
+  slab_arena () : reserved_bytes_(0), peak_reserved_bytes_(0), large_objects_(0), large_bytes_(0),
+		  released_slabs_(0), last_released_slabs_(0) {}
+
+  ~slab_arena () {
+    for (size_t cls = 0 ; cls < nb_classes ; ++cls) {
+      for (std::vector<slab *>::iterator it = classes_[cls].slabs.begin() ; it != classes_[cls].slabs.end() ; ++it) {
+	unmap_slab(*it);
+      }
+    }
+  }
+
+  /// Returns a block of at least bytes.
+  void * allocate (size_t bytes) {
+    if (bytes > max_small) {
+#ifdef REENTRANT
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+#endif
+      ++large_objects_;
+      stat_add(large_bytes_, bytes);
+      return ::operator new (bytes);
+    }
+    size_t cls = class_of(bytes);
+    size_t obj_bytes = cls * granularity;
+    size_class & sc = classes_[cls];
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock(sc.mutex);
+#endif
+    void * res = (sc.current != NULL) ? take(sc.current, obj_bytes) : NULL;
+    while (res == NULL) {
+      if (sc.current != NULL) {
+	// current is full, it will be listed again when an object is freed in it
+	sc.current->listed = false;
+      }
+      if (sc.available.empty()) {
+	sc.current = new_slab(cls);
+      } else {
+	sc.current = sc.available.back();
+	sc.available.pop_back();
+      }
+      res = take(sc.current, obj_bytes);
+    }
+    stat_add(sc.used_bytes, obj_bytes);
+    return res;
+  }
+
+  /// Gives back a block obtained by allocate(bytes).
+  void deallocate (void * addr, size_t bytes) {
+    if (bytes > max_small) {
+      ::operator delete (addr);
+#ifdef REENTRANT
+      std::lock_guard<std::mutex> lock(stats_mutex_);
+#endif
+      --large_objects_;
+      stat_sub(large_bytes_, bytes);
+      return;
+    }
+    size_t cls = class_of(bytes);
+    size_class & sc = classes_[cls];
+#ifdef REENTRANT
+    std::lock_guard<std::mutex> lock(sc.mutex);
+#endif
+    slab * s = slab_of(addr);
+    * reinterpret_cast<void **> (addr) = s->free_list;
+    s->free_list = addr;
+    --s->live;
+    stat_sub(sc.used_bytes, cls * granularity);
+    if (! s->listed) {
+      s->listed = true;
+      sc.available.push_back(s);
+    }
+  }
+
+  /// Give empty slabs back to the OS, and sort the remaining ones so that
+  /// new objects are allocated in the densest slabs first. Should be called after
+  /// a bulk deallocation (e.g. garbage collection), when no other thread is allocating.
+  void compact () {
+    size_t released = 0;
+    for (size_t cls = 0 ; cls < nb_classes ; ++cls) {
+      size_class & sc = classes_[cls];
+      if (sc.slabs.empty())
+	continue;
+      std::vector<slab *> kept;
+      sc.available.clear();
+      for (std::vector<slab *>::iterator it = sc.slabs.begin() ; it != sc.slabs.end() ; ++it) {
+	slab * s = *it;
+	if (s->live == 0) {
+	  unmap_slab(s);
+	  ++released;
+	} else {
+	  kept.push_back(s);
+	  s->listed = (s->free_list != NULL || s->bump + cls * granularity <= s->limit);
+	  if (s->listed)
+	    sc.available.push_back(s);
+	}
+      }
+      sc.slabs.swap(kept);
+      sc.current = NULL;
+      // available is used as a stack : densest slabs at the back
+      std::sort(sc.available.begin(), sc.available.end(), less_live);
+    }
+    reserved_bytes_ -= released * slab_bytes;
+    released_slabs_ += released;
+    last_released_slabs_ = released;
+  }
+
+  /// Bytes used by live objects, small and large. Unlike stats(), it may be called while
+  /// other threads allocate.
+  size_t live_bytes () const {
+    size_t res = large_bytes_.load(std::memory_order_relaxed);
+    for (size_t cls = 0 ; cls < nb_classes ; ++cls) {
+      res += classes_[cls].used_bytes.load(std::memory_order_relaxed);
+    }
+    return res;
+  }
+
+  /// Returns current statistics, the counts are only accurate when no other thread is allocating.
+  stats_t stats () const {
+    stats_t res;
+    for (size_t cls = 0 ; cls < nb_classes ; ++cls) {
+      res.slabs += classes_[cls].slabs.size();
+      res.used_bytes += classes_[cls].used_bytes;
+    }
+    res.reserved_bytes = reserved_bytes_;
+    res.peak_reserved_bytes = peak_reserved_bytes_;
+    res.large_objects = large_objects_;
+    res.large_bytes = large_bytes_;
+    res.released_slabs = released_slabs_;
+    res.last_released_slabs = last_released_slabs_;
+    return res;
+  }
+
+private:
+  static bool less_live (const slab * a, const slab * b) {
+    return a->live < b->live;
+  }
+
+  slab_arena (const slab_arena &);
+  slab_arena & operator= (const slab_arena &);
+};
+
+} // namespace d3
+
+#endif /* _SLAB_ALLOCATOR_HH_ */
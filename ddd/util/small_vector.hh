@@ -0,0 +1,116 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#ifndef _SMALL_VECTOR_HH_
+#define _SMALL_VECTOR_HH_
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace d3 { namespace util
+{
+
+/// A vector that keeps up to N elements inline and only goes to the heap beyond that.
+/// Meant for short lived buffers on hot paths, e.g. collecting the operands of a union,
+/// where a std::set or std::vector would allocate on every call.
+/// It is neither copyable nor assignable.
+template <typename T, size_t N>
+class small_vector {
+  T * data_;
+  size_t size_;
+  size_t capacity_;
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type inline_ [N];
+
+  bool is_inline () const { return data_ == reinterpret_cast<const T *>(inline_); }
+
+  void grow () {
+    size_t capacity = capacity_ * 2;
+    T * data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+    for (size_t i = 0 ; i < size_ ; ++i) {
+      new (data + i) T(data_[i]);
+      data_[i].~T();
+    }
+    if (! is_inline ())
+      ::operator delete(data_);
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  small_vector (const small_vector &);
+  small_vector & operator= (const small_vector &);
+public:
+  typedef T value_type;
+  typedef T * iterator;
+  typedef const T * const_iterator;
+
+  small_vector () : data_(reinterpret_cast<T *>(inline_)), size_(0), capacity_(N) {}
+
+  ~small_vector () {
+    clear();
+    if (! is_inline ())
+      ::operator delete(data_);
+  }
+
+  void push_back (const T & t) {
+    if (size_ == capacity_)
+      grow();
+    new (data_ + size_) T(t);
+    ++size_;
+  }
+
+  void pop_back () { data_[--size_].~T(); }
+
+  void clear () {
+    for (size_t i = 0 ; i < size_ ; ++i)
+      data_[i].~T();
+    size_ = 0;
+  }
+
+  size_t size () const { return size_; }
+  bool empty () const { return size_ == 0; }
+
+  T & operator[] (size_t i) { return data_[i]; }
+  const T & operator[] (size_t i) const { return data_[i]; }
+  T & back () { return data_[size_ - 1]; }
+  const T & back () const { return data_[size_ - 1]; }
+
+  iterator begin () { return data_; }
+  iterator end () { return data_ + size_; }
+  const_iterator begin () const { return data_; }
+  const_iterator end () const { return data_ + size_; }
+
+  /// Sorts the elements and removes duplicates, so that the content is a set in ascending order.
+  void sort_unique () {
+    std::sort(begin(), end());
+    iterator last = std::unique(begin(), end());
+    while (end() != last)
+      pop_back();
+  }
+};
+
+}} // namespace d3::util
+
+#endif /* _SMALL_VECTOR_HH_ */
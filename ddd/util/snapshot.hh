@@ -0,0 +1,152 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#ifndef _SNAPSHOT_HH_
+#define _SNAPSHOT_HH_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <utility>
+#include <iostream>
+#include "ddd/util/op_stats.hh"
+
+namespace d3 {
+
+/// The state of the memory of the library at some point in time, see MemoryManager::snapshot().
+/// It can be written as a JSON object, or as a CSV row.
+struct memory_snapshot_t
+{
+  /// A unicity table.
+  struct table_t
+  {
+    std::string name;
+    /// current and peak number of entries
+    size_t size;
+    size_t peak;
+    /// bytes held by the entries, exact for the DDD table, otherwise an estimate
+    size_t bytes;
+
+    table_t (const std::string & n, size_t s, size_t p, size_t b = 0) : name(n), size(s), peak(p), bytes(b) {}
+  };
+
+  /// wall clock time of the snapshot, in seconds since the epoch
+  double timestamp;
+  /// resident memory of the process in kB, 0 if it is unknown
+  size_t rss_kb;
+  std::vector<table_t> tables;
+  std::vector< std::pair<std::string, op_cache_stats_t> > caches;
+  /// garbage collections, and their pauses in seconds
+  size_t gc_count;
+  double gc_total_pause;
+  double gc_max_pause;
+  double gc_last_pause;
+  /// the policy that triggers collections, and how many times it read the resident memory
+  std::string gc_policy;
+  size_t gc_rss_reads;
+  /// generations of the DDD table collector
+  size_t ddd_minor_gc;
+  size_t ddd_major_gc;
+  size_t ddd_reclaimed;
+
+  memory_snapshot_t () : timestamp(0), rss_kb(0), gc_count(0), gc_total_pause(0), gc_max_pause(0), gc_last_pause(0),
+			 gc_rss_reads(0), ddd_minor_gc(0), ddd_major_gc(0), ddd_reclaimed(0) {}
+
+private:
+  static void json_counters (std::ostream & os, const op_stats_t & op) {
+    os << "{\"hits\":" << op.hits << ",\"misses\":" << op.misses << ",\"insertions\":" << op.insertions
+       << ",\"evictions\":" << op.evictions << ",\"hit_rate\":" << op.hit_rate() << "}";
+  }
+
+public:
+  /// Writes the snapshot as a single line JSON object. Names are library identifiers, they are not escaped.
+  void to_json (std::ostream & os) const {
+    os << "{\"timestamp\":" << std::fixed << timestamp;
+    os.unsetf(std::ios_base::floatfield);
+    os << ",\"rss_kb\":" << rss_kb;
+    os << ",\"gc\":{\"count\":" << gc_count << ",\"total_pause\":" << gc_total_pause << ",\"max_pause\":" << gc_max_pause
+       << ",\"last_pause\":" << gc_last_pause << ",\"policy\":\"" << gc_policy << "\",\"rss_reads\":" << gc_rss_reads
+       << ",\"ddd_minor\":" << ddd_minor_gc << ",\"ddd_major\":" << ddd_major_gc
+       << ",\"ddd_reclaimed\":" << ddd_reclaimed << "}";
+    os << ",\"tables\":{";
+    for (size_t i = 0 ; i < tables.size() ; ++i) {
+      const table_t & t = tables[i];
+      os << (i ? "," : "") << "\"" << t.name << "\":{\"size\":" << t.size << ",\"peak\":" << t.peak << ",\"bytes\":" << t.bytes << "}";
+    }
+    os << "},\"caches\":{";
+    for (size_t i = 0 ; i < caches.size() ; ++i) {
+      const op_cache_stats_t & c = caches[i].second;
+      os << (i ? "," : "") << "\"" << caches[i].first << "\":{\"size\":" << c.size << ",\"peak\":" << c.peak << ",\"bytes\":" << c.bytes << ",\"total\":";
+      json_counters(os, c.total);
+      os << ",\"before_gc\":";
+      json_counters(os, c.before_gc);
+      os << ",\"since_gc\":";
+      json_counters(os, c.since_gc);
+      if (! c.ops.empty()) {
+	os << ",\"ops\":{";
+	for (size_t k = 0 ; k < c.ops.size() ; ++k) {
+	  os << (k ? "," : "") << "\"" << c.ops[k].first << "\":";
+	  json_counters(os, c.ops[k].second);
+	}
+	os << "}";
+      }
+      os << "}";
+    }
+    os << "}}";
+  }
+
+  /// Writes the names of the columns of to_csv(), they depend on the tables and caches.
+  void csv_header (std::ostream & os) const {
+    os << "timestamp,rss_kb,gc_count,gc_total_pause,gc_max_pause,gc_last_pause,gc_policy,gc_rss_reads";
+    for (size_t i = 0 ; i < tables.size() ; ++i) {
+      os << "," << tables[i].name << "_size," << tables[i].name << "_peak," << tables[i].name << "_bytes";
+    }
+    for (size_t i = 0 ; i < caches.size() ; ++i) {
+      const std::string & n = caches[i].first;
+      os << "," << n << "_cache_size," << n << "_cache_bytes," << n << "_cache_hits," << n << "_cache_misses," << n << "_cache_evictions,"
+	 << n << "_cache_hit_rate_since_gc";
+    }
+    os << std::endl;
+  }
+
+  /// Writes the snapshot as a CSV row.
+  void to_csv (std::ostream & os) const {
+    os << std::fixed << timestamp;
+    os.unsetf(std::ios_base::floatfield);
+    os << "," << rss_kb << "," << gc_count << "," << gc_total_pause << "," << gc_max_pause << "," << gc_last_pause
+       << ",\"" << gc_policy << "\"," << gc_rss_reads;
+    for (size_t i = 0 ; i < tables.size() ; ++i) {
+      os << "," << tables[i].size << "," << tables[i].peak << "," << tables[i].bytes;
+    }
+    for (size_t i = 0 ; i < caches.size() ; ++i) {
+      const op_cache_stats_t & c = caches[i].second;
+      os << "," << c.size << "," << c.bytes << "," << c.total.hits << "," << c.total.misses << "," << c.total.evictions << "," << c.since_gc.hit_rate();
+    }
+    os << std::endl;
+  }
+};
+
+} // namespace d3
+
+#endif /* _SNAPSHOT_HH_ */
@@ -3,8 +3,8 @@
 
 #ifdef REENTRANT
 
+#include <mutex>
 #include <tbb/concurrent_hash_map.h>
-#include <tbb/mutex.h>
 
 #include "ddd/util/hash_support.hh"
 
@@ -20,13 +20,13 @@ struct tbb_hash_map
   struct hash_compare
   {    
     bool
-    equal( const Key& k1, const Key& k2)
+    equal( const Key& k1, const Key& k2) const
     {
       return EqualKey()(k1,k2);
     }
 
     size_t
-    hash( const Key& k)
+    hash( const Key& k) const
     {
       return HashKey()(k);
     }
@@ -34,7 +34,7 @@ struct tbb_hash_map
   };
 
   // Types
-  typedef tbb::mutex mutex;
+  typedef std::mutex mutex;
   typedef tbb::concurrent_hash_map<Key,Data,hash_compare> internal_hash_map;
   typedef typename internal_hash_map::iterator iterator;
   typedef typename internal_hash_map::const_iterator const_iterator;
@@ -54,6 +54,14 @@ struct tbb_hash_map
   {
   }
 
+  // the mutex is not copied
+  tbb_hash_map( const tbb_hash_map & other)
+    :
+    map_(other.map_),
+    map_mutex_()
+  {
+  }
+
   iterator
   begin()
   {
@@ -94,7 +102,7 @@ struct tbb_hash_map
   clear()
   {
     // non reentrant method, need to lock the hash_map
-    mutex::scoped_lock lock(map_mutex_);
+    std::lock_guard<mutex> lock(map_mutex_);
     map_.clear();
   }
 
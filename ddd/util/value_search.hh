@@ -0,0 +1,125 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#ifndef _VALUE_SEARCH_HH_
+#define _VALUE_SEARCH_HH_
+
+#include <cstddef>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace d3 {
+
+/// Index of the first element not less than v in the sorted array [vals, vals+n), or n if there is none.
+/// The arrays of arc values of a DDD node are short and searched from the current position
+/// of a merge, so they are scanned linearly rather than bisected.
+template<typename T>
+inline
+size_t
+lower_bound_index (const T * vals, size_t n, T v)
+{
+  size_t i = 0;
+  while (i < n && vals[i] < v)
+    ++i;
+  return i;
+}
+
+#ifdef __SSE2__
+
+/// 8 bit values : compare sixteen values at a time.
+inline
+size_t
+lower_bound_index (const signed char * vals, size_t n, signed char v)
+{
+  const __m128i key = _mm_set1_epi8(v);
+  size_t i = 0;
+  for ( ; i + 16 <= n ; i += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *> (vals + i));
+    unsigned less = _mm_movemask_epi8(_mm_cmplt_epi8(block, key));
+    if (less != 0xFFFF)
+      return i + __builtin_ctz(~less);
+  }
+  while (i < n && vals[i] < v)
+    ++i;
+  return i;
+}
+
+/// 16 bit values : compare eight values at a time.
+inline
+size_t
+lower_bound_index (const short * vals, size_t n, short v)
+{
+  const __m128i key = _mm_set1_epi16(v);
+  size_t i = 0;
+  for ( ; i + 8 <= n ; i += 8) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *> (vals + i));
+    // two mask bits per value less than v, the values being sorted these are a prefix
+    unsigned less = _mm_movemask_epi8(_mm_cmplt_epi16(block, key));
+    if (less != 0xFFFF)
+      return i + __builtin_ctz(~less) / 2;
+  }
+  while (i < n && vals[i] < v)
+    ++i;
+  return i;
+}
+
+/// 32 bit values : compare four values at a time.
+inline
+size_t
+lower_bound_index (const int * vals, size_t n, int v)
+{
+  const __m128i key = _mm_set1_epi32(v);
+  size_t i = 0;
+  for ( ; i + 4 <= n ; i += 4) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *> (vals + i));
+    unsigned less = _mm_movemask_epi8(_mm_cmplt_epi32(block, key));
+    if (less != 0xFFFF)
+      return i + __builtin_ctz(~less) / 4;
+  }
+  while (i < n && vals[i] < v)
+    ++i;
+  return i;
+}
+
+#endif // __SSE2__
+
+/// Same as lower_bound_index, for values stored in a narrower type than the value searched for.
+template<typename Stored, typename V>
+inline
+size_t
+lower_bound_index_narrow (const Stored * vals, size_t n, V v)
+{
+  if ((long) v > (long) std::numeric_limits<Stored>::max())
+    return n;
+  if ((long) v < (long) std::numeric_limits<Stored>::min())
+    return 0;
+  return lower_bound_index(vals, n, (Stored) v);
+}
+
+} // namespace d3
+
+#endif /* _VALUE_SEARCH_HH_ */
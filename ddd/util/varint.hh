@@ -0,0 +1,84 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+
+/* -*- C++ -*- */
+#ifndef _VARINT_HH_
+#define _VARINT_HH_
+
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <stdint.h>
+
+namespace d3 {
+
+/// Variable length encoding of integers for binary serialization : 7 bits per byte,
+/// least significant first, the high bit of a byte tells whether more bytes follow.
+/// Signed values are first zigzag encoded, so that small negative values are short too.
+
+inline void write_varint (std::ostream & os, uint64_t v) {
+  char buf [10];
+  int n = 0;
+  while (v >= 0x80) {
+    buf[n++] = (char) ((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  buf[n++] = (char) v;
+  os.write(buf, n);
+}
+
+/// Reads a value written by write_varint, throws std::runtime_error on a truncated or invalid input.
+inline uint64_t read_varint (std::istream & is) {
+  uint64_t v = 0;
+  for (int shift = 0 ; shift < 64 ; shift += 7) {
+    int c = is.get();
+    if (c == std::char_traits<char>::eof()) {
+      throw std::runtime_error("unexpected end of input in a varint");
+    }
+    v |= (uint64_t) (c & 0x7f) << shift;
+    if (! (c & 0x80)) {
+      return v;
+    }
+  }
+  throw std::runtime_error("varint too long");
+}
+
+inline uint64_t zigzag (int64_t v) {
+  return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+inline int64_t unzigzag (uint64_t v) {
+  return (int64_t) (v >> 1) ^ - (int64_t) (v & 1);
+}
+
+inline void write_svarint (std::ostream & os, int64_t v) {
+  write_varint(os, zigzag(v));
+}
+
+inline int64_t read_svarint (std::istream & is) {
+  return unzigzag(read_varint(is));
+}
+
+} // namespace d3
+
+#endif /* _VARINT_HH_ */
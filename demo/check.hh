@@ -0,0 +1,46 @@
+#ifndef __CHECK_HH
+#define __CHECK_HH
+
+// The harness shared by the checks run by make check : each check program is a single
+// translation unit, that counts its failed checks and reports them from main.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ddd/DDD.h"
+
+static int failures = 0;
+
+// Records a failed check, with a description of what was checked.
+static inline void check (bool ok, const std::string & what) {
+  if (! ok) {
+    std::cerr << "FAILED : " << what << std::endl;
+    ++failures;
+  }
+}
+
+// Prints the outcome of the checks on what, and returns the exit status of the program.
+static inline int report (const std::string & what) {
+  if (failures) {
+    std::cerr << failures << " " << what << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << what << " checks passed" << std::endl;
+  return 0;
+}
+
+// Raw bytes, to build hand written binary streams.
+static inline std::string bytes (const unsigned char * data, size_t size) {
+  return std::string((const char *) data, size);
+}
+
+// The binary form of a DDD, it only depends on its structure, not on its node ids.
+static inline std::string bytes (const DDD & d) {
+  std::ostringstream os;
+  saveDDDBinary(os, std::vector<DDD>(1, d));
+  return os.str();
+}
+
+#endif
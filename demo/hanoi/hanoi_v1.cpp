@@ -33,7 +33,6 @@ using namespace std;
 #include "ddd/MemoryManager.h"
 #include "ddd/init.hh"
 #include "hanoiHom.hh"
-// #include "tbb/task_scheduler_init.h"
 
 
 int 
@@ -45,7 +44,6 @@ main(int argc, char **argv)
 	}
 
 	d3::init init;
-	// tbb::task_scheduler_init init;
 
     // Define a name for each variable
 	initName();
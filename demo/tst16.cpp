@@ -0,0 +1,145 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Stress test of the generational garbage collection of DDD : minor and major collections
+/// are interleaved while DDD are built on top of old ones and dropped. The DDD kept by
+/// handles, by SDD arcs, by homomorphisms and by the operation caches must not change.
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/SDD.h"
+#include "ddd/Hom.h"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+static const int nbvar = 12;
+static const int nbval = 5;
+
+/// A random path over variables [0,top), ending in tail.
+static GDDD path (int top, const GDDD & tail) {
+  GDDD res = tail;
+  for (int v = nbvar - top ; v < nbvar ; ++v) {
+    res = GDDD(v, rand() % nbval, res);
+  }
+  return res;
+}
+
+/// A set of random paths, some of them sharing the bottom of an older DDD.
+static DDD young (const vector<DDD> & old) {
+  GDDD res = GDDD::null;
+  for (int i = 0 ; i < 300 ; ++i) {
+    GDDD tail = GDDD::one;
+    int top = nbvar;
+    if (! old.empty() && i % 2) {
+      // a young parent of an old node
+      tail = old[i % old.size()].begin().son();
+      top = 1;
+    }
+    res = res + path(top, tail);
+  }
+  return res;
+}
+
+/// Something that must survive the collections, and what it must look like.
+struct kept_t {
+  DDD ddd;
+  string expected;
+  long double states;
+};
+
+int main () {
+  srand(42);
+  // each DDD is kept from the round it is built on, and is checked after every collection
+  vector<kept_t> kept;
+  // DDD only reachable from an SDD arc or from a homomorphism
+  vector<SDD> sdds;
+  vector<Hom> homs;
+  vector<string> held;
+  // the union of two old DDD, only reachable from the cache
+  string cached;
+
+  d3::memory_snapshot_t start = MemoryManager::snapshot();
+  for (int round = 0 ; round < 3 * 8 ; ++round) {
+    vector<DDD> old;
+    for (size_t i = 0 ; i < kept.size() ; ++i) {
+      old.push_back(kept[i].ddd);
+    }
+    DDD d = young(old);
+    // garbage that refers to old nodes
+    for (int i = 0 ; i < 4 ; ++i) {
+      young(old);
+    }
+    if (round % 4 == 0) {
+      kept_t k = { d, bytes(d), d.nbStates() };
+      kept.push_back(k);
+    }
+    if (round % 3 == 1) {
+      DDD h = young(old);
+      held.push_back(bytes(h));
+      sdds.push_back(SDD(0, h));
+      DDD g = young(old);
+      held.push_back(bytes(g));
+      homs.push_back(Hom(g));
+    }
+    if (round == 10) {
+      cached = bytes(kept[0].ddd + kept[1].ddd);
+    }
+
+    MemoryManager::garbage();
+
+    ostringstream r;
+    r << " after round " << round;
+    for (size_t i = 0 ; i < kept.size() ; ++i) {
+      check(bytes(kept[i].ddd) == kept[i].expected, "kept DDD unchanged" + r.str());
+      check(kept[i].ddd.nbStates() == kept[i].states, "kept DDD states unchanged" + r.str());
+    }
+    for (size_t i = 0 ; i < sdds.size() ; ++i) {
+      // rebuild the arc from its bytes, the SDD must still refer to this node
+      vector<DDD> arc;
+      istringstream is (held[2 * i]);
+      loadDDDBinary(is, arc);
+      check(sdds[i] == SDD(0, arc[0]), "DDD held by an SDD unchanged" + r.str());
+      check(bytes(homs[i](GDDD::one)) == held[2 * i + 1], "DDD held by a Hom unchanged" + r.str());
+    }
+    if (! cached.empty()) {
+      check(bytes(kept[0].ddd + kept[1].ddd) == cached, "cached union unchanged" + r.str());
+    }
+  }
+
+  d3::memory_snapshot_t end = MemoryManager::snapshot();
+  check(end.ddd_minor_gc - start.ddd_minor_gc >= 2 * 7, "minor collections ran");
+  check(end.ddd_major_gc - start.ddd_major_gc >= 2, "major collections ran");
+  check(end.ddd_reclaimed > start.ddd_reclaimed, "collections reclaimed nodes");
+
+  kept.clear();
+  sdds.clear();
+  homs.clear();
+  MemoryManager::garbage();
+  return report("garbage collection");
+}
@@ -0,0 +1,92 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the bounded mode of the operation caches : with setCacheSlots(n) the cache of
+/// homomorphisms never holds more than n entries, counts the entries it overwrites, and a
+/// fixpoint computed with it is the same as with an unbounded cache.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/Hom.h"
+#include "ddd/Hom_Basic.hh"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+static const int nbvar = 6;
+static const int nbval = 5;
+
+/// Every state where each variable is in [0,nbval), reached from 0 by incrementing one variable at a time.
+static Hom reach () {
+  Hom next = GHom::id;
+  for (int v = 0 ; v < nbvar ; ++v) {
+    next = next + (incVar(v, 1) & varLtState(v, nbval - 1));
+  }
+  return fixpoint(next);
+}
+
+static DDD initial () {
+  GDDD res = GDDD::one;
+  for (int v = nbvar - 1 ; v >= 0 ; --v) {
+    res = GDDD(v, 0, res);
+  }
+  return res;
+}
+
+int main () {
+  // reference, with an unbounded cache
+  string expected;
+  {
+    DDD all = reach()(initial());
+    check(all.nbStates() == 15625, "reachable states");
+    expected = bytes(all);
+  }
+  check(GHom::cacheStats().size > 64, "unbounded cache grows past 64 entries");
+  MemoryManager::garbage();
+
+  for (size_t slots = 64 ; slots >= 4 ; slots /= 4) {
+    ostringstream with;
+    with << " with " << slots << " slots";
+    GHom::setCacheSlots(slots);
+    check(GHom::cacheStats().size == 0, "bounding the cache discards its entries" + with.str());
+    d3::op_cache_stats_t before = GHom::cacheStats();
+    check(bytes(reach()(initial())) == expected, "fixpoint unchanged" + with.str());
+    d3::op_cache_stats_t after = GHom::cacheStats();
+    check(after.size <= slots, "bounded cache size" + with.str());
+    check(after.total.evictions > before.total.evictions, "bounded cache evicts entries" + with.str());
+    check(after.total.insertions > slots, "bounded cache keeps inserting" + with.str());
+    MemoryManager::garbage();
+    check(GHom::cacheStats().size <= slots, "bounded cache size after garbage" + with.str());
+  }
+
+  GHom::setCacheSlots(0);
+  check(bytes(reach()(initial())) == expected, "fixpoint unchanged when unbounded again");
+  check(GHom::cacheStats().size > 64, "unbounded cache grows again");
+
+  MemoryManager::garbage();
+  return report("bounded cache");
+}
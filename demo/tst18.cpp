@@ -0,0 +1,204 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks MemoryManager::snapshot() : the tables and caches it reports match the library,
+/// it counts collections, and its JSON and CSV forms are well formed. Also the sampler
+/// thread, that writes snapshots to a file while DDD are built.
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/SDD.h"
+#include "ddd/Hom.h"
+#include "ddd/Hom_Basic.hh"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+/// A DDD of n paths over 4 variables.
+static DDD build (int n) {
+  GDDD res = GDDD::null;
+  for (int i = 0 ; i < n ; ++i) {
+    res = res + GDDD(3, i % 5, GDDD(2, i % 7, GDDD(1, i % 11, GDDD(0, i))));
+  }
+  return res;
+}
+
+static const d3::memory_snapshot_t::table_t * table (const d3::memory_snapshot_t & snap, const string & name) {
+  for (size_t i = 0 ; i < snap.tables.size() ; ++i) {
+    if (snap.tables[i].name == name)
+      return &snap.tables[i];
+  }
+  return NULL;
+}
+
+static const d3::op_cache_stats_t * cache (const d3::memory_snapshot_t & snap, const string & name) {
+  for (size_t i = 0 ; i < snap.caches.size() ; ++i) {
+    if (snap.caches[i].first == name)
+      return &snap.caches[i].second;
+  }
+  return NULL;
+}
+
+/// True if the braces and quotes of a single line JSON object match.
+static bool balanced (const string & json) {
+  if (json.empty() || json[0] != '{' || json[json.size() - 1] != '}')
+    return false;
+  int depth = 0;
+  bool quoted = false;
+  for (size_t i = 0 ; i < json.size() ; ++i) {
+    char c = json[i];
+    if (c == '"')
+      quoted = ! quoted;
+    else if (! quoted && c == '{')
+      ++depth;
+    else if (! quoted && c == '}' && --depth < 0)
+      return false;
+    else if (c == '\n')
+      return false;
+  }
+  return depth == 0 && ! quoted;
+}
+
+/// The number of columns of a CSV row, commas within quotes do not count.
+static size_t columns (const string & row) {
+  size_t res = 1;
+  bool quoted = false;
+  for (size_t i = 0 ; i < row.size() ; ++i) {
+    if (row[i] == '"')
+      quoted = ! quoted;
+    else if (! quoted && row[i] == ',')
+      ++res;
+  }
+  return res;
+}
+
+static vector<string> lines (const string & path) {
+  ifstream is (path.c_str());
+  vector<string> res;
+  string line;
+  while (getline(is, line)) {
+    res.push_back(line);
+  }
+  return res;
+}
+
+static void test_snapshot () {
+  DDD d = build(200);
+  Hom h = incVar(0, 1);
+  DDD img = h(d);
+  img = h(d);
+  SDD s = SDD(0, d, SDD(1, img));
+
+  d3::memory_snapshot_t snap = MemoryManager::snapshot();
+  const char * names [] = { "DDD", "SDD", "Hom", "Shom" };
+  for (size_t i = 0 ; i < 4 ; ++i) {
+    check(table(snap, names[i]) != NULL, string("table ") + names[i] + " is reported");
+  }
+  const d3::memory_snapshot_t::table_t * t = table(snap, "DDD");
+  if (t != NULL) {
+    check(t->size == MemoryManager::nbDDD(), "DDD table size");
+    check(t->peak >= t->size, "DDD table peak");
+    check(t->bytes > 0, "DDD table bytes");
+  }
+  t = table(snap, "SDD");
+  if (t != NULL) {
+    check(t->size == MemoryManager::nbSDD() && t->size > 0, "SDD table size");
+  }
+  t = table(snap, "Hom");
+  if (t != NULL) {
+    check(t->size == MemoryManager::nbHom() && t->peak >= t->size, "Hom table size and peak");
+  }
+  const char * caches [] = { "DED", "SDED", "Hom", "HomImage", "Shom", "ShomImage" };
+  for (size_t i = 0 ; i < 6 ; ++i) {
+    check(cache(snap, caches[i]) != NULL, string("cache ") + caches[i] + " is reported");
+  }
+  const d3::op_cache_stats_t * c = cache(snap, "Hom");
+  if (c != NULL) {
+    check(c->total.hits > 0 && c->total.misses > 0, "Hom cache hits and misses");
+    check(c->size > 0 && c->peak >= c->size, "Hom cache size and peak");
+  }
+  c = cache(snap, "DED");
+  if (c != NULL) {
+    check(c->size == MemoryManager::nbDED(), "DED cache size");
+  }
+
+  MemoryManager::garbage();
+  d3::memory_snapshot_t after = MemoryManager::snapshot();
+  check(after.gc_count == snap.gc_count + 1, "collections are counted");
+  check(after.gc_total_pause >= after.gc_last_pause && after.gc_max_pause >= after.gc_last_pause, "collection pauses");
+  check(after.timestamp >= snap.timestamp, "timestamps increase");
+
+  ostringstream json;
+  after.to_json(json);
+  check(balanced(json.str()), "JSON is a single line object");
+  ostringstream ddd;
+  ddd << "\"DDD\":{\"size\":" << MemoryManager::nbDDD() << ",";
+  check(json.str().find(ddd.str()) != string::npos, "JSON holds the size of the DDD table");
+  check(json.str().find("\"caches\":{") != string::npos, "JSON holds the caches");
+
+  ostringstream header, row;
+  after.csv_header(header);
+  after.to_csv(row);
+  check(columns(header.str()) == columns(row.str()), "CSV row has a value per column");
+  check(header.str().find("DDD_size") != string::npos, "CSV header names the DDD table");
+}
+
+static void test_sampler (bool csv) {
+  const string path = csv ? "tst18.csv" : "tst18.json";
+  remove(path.c_str());
+  check(MemoryManager::startSampler(path, 0.005, csv), "sampler starts");
+  check(! MemoryManager::startSampler(path, 0.005, csv), "a single sampler runs");
+  for (int i = 0 ; i < 20 ; ++i) {
+    DDD d = build(50 + 10 * i);
+    this_thread::sleep_for(chrono::milliseconds(2));
+    if (i % 5 == 4)
+      MemoryManager::garbage();
+  }
+  MemoryManager::stopSampler();
+  vector<string> out = lines(path);
+  // a first snapshot at start, and a last one at stop
+  check(out.size() >= (csv ? 3u : 2u), "sampler wrote snapshots");
+  for (size_t i = 0 ; i < out.size() ; ++i) {
+    if (csv) {
+      check(columns(out[i]) == columns(out[0]), "sampled CSV row has a value per column");
+    } else {
+      check(balanced(out[i]), "sampled JSON line is an object");
+    }
+  }
+  remove(path.c_str());
+}
+
+int main () {
+  test_snapshot();
+  test_sampler(false);
+  test_sampler(true);
+  MemoryManager::garbage();
+  return report("memory snapshot");
+}
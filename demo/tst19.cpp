@@ -0,0 +1,171 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the serialization of DDD : text and binary round trips, and rejection of corrupted
+/// binary streams.
+
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/MemoryManager.h"
+#include "ddd/util/varint.hh"
+
+#include "check.hh"
+
+/// A few DDD that share nodes, with negative and large values, and the terminals.
+static vector<DDD> sample () {
+  DDD a = DDD(0, 1, DDD(1, 2, DDD(2, 3))) + DDD(0, 1, DDD(1, 5, DDD(2, 3)));
+  DDD b = DDD(0, -7, 12, DDD(1, 2, DDD(2, 3))) + DDD(0, 30000, DDD(1, 0, 4));
+  DDD c = a + b + DDD(0, 2, DDD(1, 2, DDD(2, 3, DDD(3, -1))));
+  vector<DDD> list;
+  list.push_back(a);
+  list.push_back(b);
+  list.push_back(c);
+  list.push_back(a);
+  list.push_back(GDDD::one);
+  list.push_back(GDDD::null);
+  list.push_back(GDDD::top);
+  return list;
+}
+
+static string to_binary (const vector<DDD> & list) {
+  ostringstream os;
+  saveDDDBinary(os, list);
+  return os.str();
+}
+
+/// Loads a binary stream, returns false if the reader rejects it.
+static bool load_binary (const string & bytes, vector<DDD> & list) {
+  istringstream is (bytes);
+  try {
+    loadDDDBinary(is, list);
+  } catch (const runtime_error &) {
+    return false;
+  }
+  return true;
+}
+
+/// A stream with one node on variable 0 : the largest value, then if step is not 0 a second
+/// value step further, both to one.
+static string node_after_max (uint64_t step) {
+  ostringstream os;
+  os.write("DDDB", 4);
+  d3::write_varint(os, 1);
+  d3::write_varint(os, 1);
+  d3::write_svarint(os, 0);
+  d3::write_varint(os, step ? 2 : 1);
+  d3::write_svarint(os, numeric_limits<GDDD::val_t>::max());
+  d3::write_varint(os, 2);
+  if (step) {
+    d3::write_varint(os, step);
+    d3::write_varint(os, 2);
+  }
+  d3::write_varint(os, 0);
+  d3::write_varint(os, 1);
+  d3::write_varint(os, 3);
+  return os.str();
+}
+
+static void test_text_round_trip () {
+  vector<DDD> list = sample();
+  ostringstream os;
+  saveDDD(os, list);
+  vector<DDD> loaded (list.size());
+  istringstream is (os.str());
+  loadDDD(is, loaded);
+  check(loaded == list, "text round trip");
+}
+
+static void test_binary_round_trip () {
+  vector<DDD> list = sample();
+  vector<DDD> loaded;
+  check(load_binary(to_binary(list), loaded), "binary round trip loads");
+  check(loaded == list, "binary round trip");
+  // saving the loaded DDD gives back the same stream
+  check(to_binary(loaded) == to_binary(list), "binary round trip is stable");
+
+  vector<DDD> empty;
+  loaded = list;
+  check(load_binary(to_binary(empty), loaded) && loaded.empty(), "binary round trip of no DDD");
+}
+
+static void test_corrupted () {
+  vector<DDD> loaded;
+  const unsigned char magic [] = { 'D', 'D', 'D', 'X', 1, 0, 0 };
+  check(! load_binary(bytes(magic, sizeof(magic)), loaded), "bad magic is rejected");
+  const unsigned char version0 [] = { 'D', 'D', 'D', 'B', 0, 0, 0 };
+  check(! load_binary(bytes(version0, sizeof(version0)), loaded), "version 0 is rejected");
+  const unsigned char version2 [] = { 'D', 'D', 'D', 'B', 2, 0, 0 };
+  check(! load_binary(bytes(version2, sizeof(version2)), loaded), "future version is rejected");
+
+  // every strict prefix of a valid stream is truncated
+  string valid = to_binary(sample());
+  for (size_t i = 0 ; i < valid.size() ; ++i) {
+    if (load_binary(valid.substr(0, i), loaded)) {
+      ostringstream what;
+      what << "stream truncated to " << i << " bytes is rejected";
+      check(false, what.str());
+    }
+  }
+
+  const unsigned char son0 [] = { 'D', 'D', 'D', 'B', 1, 1, 0, 1, 2, 0, 0, 1, 3 };
+  check(! load_binary(bytes(son0, sizeof(son0)), loaded), "successor distance 0 is rejected");
+  const unsigned char son_far [] = { 'D', 'D', 'D', 'B', 1, 1, 0, 1, 2, 4, 0, 1, 3 };
+  check(! load_binary(bytes(son_far, sizeof(son_far)), loaded), "successor before the first node is rejected");
+  // arcs 1->one and 2->null : null is never the successor of an arc
+  const unsigned char son_null [] = { 'D', 'D', 'D', 'B', 1, 1, 0, 2, 2, 2, 1, 3, 0, 1, 3 };
+  check(! load_binary(bytes(son_null, sizeof(son_null)), loaded), "successor null is rejected");
+  // 2^40 does not fit in the variable of a node
+  const unsigned char var [] = { 'D', 'D', 'D', 'B', 1, 1, 0x80, 0x80, 0x80, 0x80, 0x80, 0x40, 1, 2, 2, 0, 1, 3 };
+  check(! load_binary(bytes(var, sizeof(var)), loaded), "variable out of range is rejected");
+  // 2^40 does not fit in DDD::val_t, whatever its width
+  const unsigned char big [] = { 'D', 'D', 'D', 'B', 1, 1, 0, 1, 0x80, 0x80, 0x80, 0x80, 0x80, 0x40, 2, 0, 1, 3 };
+  check(! load_binary(bytes(big, sizeof(big)), loaded), "value out of range is rejected");
+  // second value past the largest value, by one and by the largest step
+  check(load_binary(node_after_max(0), loaded) && loaded[0] == DDD(0, numeric_limits<GDDD::val_t>::max()),
+	"largest value loads");
+  check(! load_binary(node_after_max(1), loaded), "increasing value out of range is rejected");
+  check(! load_binary(node_after_max(numeric_limits<uint64_t>::max()), loaded), "overflowing value is rejected");
+  const unsigned char same [] = { 'D', 'D', 'D', 'B', 1, 1, 0, 2, 2, 2, 0, 2, 0, 1, 3 };
+  check(! load_binary(bytes(same, sizeof(same)), loaded), "repeated value is rejected");
+  const unsigned char record [] = { 'D', 'D', 'D', 'B', 1, 7, 0, 1, 1 };
+  check(! load_binary(bytes(record, sizeof(record)), loaded), "unknown record is rejected");
+  const unsigned char root [] = { 'D', 'D', 'D', 'B', 1, 1, 0, 1, 2, 2, 0, 1, 4 };
+  check(! load_binary(bytes(root, sizeof(root)), loaded), "invalid root index is rejected");
+  const unsigned char long_varint [] = { 'D', 'D', 'D', 'B', 1, 0, 1,
+					 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01 };
+  check(! load_binary(bytes(long_varint, sizeof(long_varint)), loaded), "varint too long is rejected");
+}
+
+int main () {
+  test_text_round_trip();
+  test_binary_round_trip();
+  test_corrupted();
+  MemoryManager::garbage();
+  return report("DDD serialization");
+}
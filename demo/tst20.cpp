@@ -0,0 +1,144 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the binary serialization of SDD, with DDD, SDD and IntDataSet arcs,
+/// and the rejection of streams that use codecs that are not registered.
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/SDD.h"
+#include "ddd/IntDataSet.h"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+static IntDataSet ints (int a, int b, int c) {
+  vector<int> v;
+  v.push_back(a);
+  v.push_back(b);
+  v.push_back(c);
+  return IntDataSet(v);
+}
+
+/// SDD over four variables : 3 has IntDataSet arcs, 2 has SDD arcs, 1 and 0 have DDD arcs.
+static SDD state (int i) {
+  DDD low = DDD(0, i, DDD(1, -i)) + DDD(0, 2 * i, DDD(1, 7));
+  SDD inner = SDD(1, DDD(5, i), SDD(0, low));
+  return SDD(3, ints(i, i + 4, 100 * i), SDD(2, inner, SDD(1, DDD(2, i, i + 3), SDD(0, low))));
+}
+
+static vector<SDD> sample () {
+  SDD a = state(1) + state(2);
+  SDD b = state(2) + state(3) + state(-4);
+  vector<SDD> list;
+  list.push_back(a);
+  list.push_back(b);
+  list.push_back(a + b);
+  list.push_back(a);
+  list.push_back(GSDD::one);
+  list.push_back(GSDD::null);
+  list.push_back(GSDD::top);
+  return list;
+}
+
+static string to_binary (const vector<SDD> & list) {
+  ostringstream os;
+  saveSDDBinary(os, list);
+  return os.str();
+}
+
+/// Loads a binary stream, returns false if the reader rejects it.
+static bool load_binary (const string & bytes, vector<SDD> & list) {
+  istringstream is (bytes);
+  try {
+    loadSDDBinary(is, list);
+  } catch (const runtime_error &) {
+    return false;
+  }
+  return true;
+}
+
+static void test_round_trip () {
+  vector<SDD> list = sample();
+  vector<SDD> loaded;
+  check(load_binary(to_binary(list), loaded), "SDD round trip loads");
+  check(loaded == list, "SDD round trip");
+  check(loaded[2].nbStates() == list[2].nbStates(), "SDD round trip keeps the states");
+  check(to_binary(loaded) == to_binary(list), "SDD round trip is stable");
+
+  // every strict prefix of a valid stream is truncated
+  string valid = to_binary(list);
+  for (size_t i = 0 ; i < valid.size() ; ++i) {
+    if (load_binary(valid.substr(0, i), loaded)) {
+      ostringstream what;
+      what << "SDD stream truncated to " << i << " bytes is rejected";
+      check(false, what.str());
+    }
+  }
+}
+
+static void test_codecs () {
+  vector<SDD> loaded;
+  // a CODEC record naming a codec that is not registered
+  const unsigned char unknown [] = { 'D', 'D', 'D', 'B', 1, 3, 3, 'F', 'o', 'o', 0, 0 };
+  check(! load_binary(bytes(unknown, sizeof(unknown)), loaded), "unknown codec name is rejected");
+  // a node using codec 0 before any codec is declared
+  const unsigned char undeclared [] = { 'D', 'D', 'D', 'B', 1, 2, 0, 1, 0, 1, 2, 0, 1, 3 };
+  check(! load_binary(bytes(undeclared, sizeof(undeclared)), loaded), "undeclared codec is rejected");
+  // a codec name longer than the limit
+  const unsigned char name [] = { 'D', 'D', 'D', 'B', 1, 3, 0x81, 0x10, 'F' };
+  check(! load_binary(bytes(name, sizeof(name)), loaded), "overlong codec name is rejected");
+  // an IntDataSet arc whose second value overflows
+  const unsigned char overflow [] = { 'D', 'D', 'D', 'B', 1, 3, 10, 'I', 'n', 't', 'D', 'a', 't', 'a', 'S', 'e', 't',
+				      2, 0, 1, 0, 2, 0xfe, 0xff, 0xff, 0xff, 0x0f,
+				      0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 2, 0, 1, 3 };
+  check(! load_binary(bytes(overflow, sizeof(overflow)), loaded), "IntDataSet value out of range is rejected");
+  // the same stream with a valid second value loads
+  const unsigned char valid [] = { 'D', 'D', 'D', 'B', 1, 3, 10, 'I', 'n', 't', 'D', 'a', 't', 'a', 'S', 'e', 't',
+				   2, 0, 1, 0, 2, 2, 3, 2, 0, 1, 3 };
+  check(load_binary(bytes(valid, sizeof(valid)), loaded), "IntDataSet arc loads");
+  vector<int> values;
+  values.push_back(1);
+  values.push_back(4);
+  check(loaded.size() == 1 && loaded[0] == SDD(0, IntDataSet(values)), "IntDataSet arc content");
+  // the same arc to null : null is never the successor of an arc
+  const unsigned char son_null [] = { 'D', 'D', 'D', 'B', 1, 3, 10, 'I', 'n', 't', 'D', 'a', 't', 'a', 'S', 'e', 't',
+				      2, 0, 1, 0, 2, 2, 3, 3, 0, 1, 3 };
+  check(! load_binary(bytes(son_null, sizeof(son_null)), loaded), "successor null is rejected");
+  // an arc labelled by an empty IntDataSet
+  const unsigned char empty [] = { 'D', 'D', 'D', 'B', 1, 3, 10, 'I', 'n', 't', 'D', 'a', 't', 'a', 'S', 'e', 't',
+				   2, 0, 1, 0, 0, 2, 0, 1, 3 };
+  check(! load_binary(bytes(empty, sizeof(empty)), loaded), "empty arc label is rejected");
+}
+
+int main () {
+  test_round_trip();
+  test_codecs();
+  MemoryManager::garbage();
+  return report("SDD serialization");
+}
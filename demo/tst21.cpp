@@ -0,0 +1,184 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks FrozenDDD : a store is written and mapped, verified, and its set operations
+/// with live DDD give the same results as the operations on the live DDD it was saved from.
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/FrozenDDD.h"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+/// DDD over variables 0, 1, 2 that share nodes, DDD whose variables do not match them
+/// at the top or below it, and the terminals.
+static vector<DDD> sample () {
+  DDD low = DDD(1, 2, DDD(2, 3)) + DDD(1, 5, DDD(2, 3)) + DDD(1, 5, DDD(2, 4));
+  DDD a = DDD(0, 1, low) + DDD(0, 4, DDD(1, 2, DDD(2, 3)));
+  DDD b = DDD(0, 1, DDD(1, 5, DDD(2, 0, 4))) + DDD(0, 2, low) + DDD(0, 4, low);
+  vector<DDD> list;
+  list.push_back(a);
+  list.push_back(b);
+  list.push_back(a + b);
+  list.push_back(a * b);
+  list.push_back(a - b);
+  // variable mismatch at the top, and below the top
+  list.push_back(DDD(7, 1, DDD(1, 2, DDD(2, 3))));
+  list.push_back(DDD(0, 1, DDD(7, 2, DDD(2, 3))) + DDD(0, 4, DDD(1, 2, DDD(2, 3))));
+  // depth mismatch, one reached early
+  list.push_back(DDD(0, 1, DDD(1, 2)));
+  list.push_back(GDDD::one);
+  list.push_back(GDDD::null);
+  list.push_back(GDDD::top);
+  return list;
+}
+
+static string read_file (const string & path) {
+  ifstream is (path.c_str(), ios::in | ios::binary);
+  ostringstream os;
+  os << is.rdbuf();
+  return os.str();
+}
+
+static void write_file (const string & path, const string & content) {
+  ofstream os (path.c_str(), ios::out | ios::binary | ios::trunc);
+  os << content;
+}
+
+/// Returns false if the store cannot be opened, or does not verify.
+static bool opens (const string & path) {
+  try {
+    FrozenDDD store (path);
+    return store.verify();
+  } catch (const runtime_error &) {
+    return false;
+  }
+}
+
+static void test_operations (const string & path) {
+  vector<DDD> saved = sample();
+  FrozenDDD::save(path, saved);
+  FrozenDDD store (path);
+  check(store.verify(), "store verifies");
+  check(store.size() == saved.size(), "store size");
+
+  vector<DDD> live = sample();
+  // the store does not depend on the unicity table
+  MemoryManager::garbage();
+  for (size_t i = 0 ; i < store.size() ; ++i) {
+    FrozenDDD::node f = store[i];
+    ostringstream which;
+    which << " of stored " << i;
+    check(f.import() == saved[i], "import" + which.str());
+    check(f.nbStates() == saved[i].nbStates(), "nbStates" + which.str());
+    for (size_t j = 0 ; j < live.size() ; ++j) {
+      const GDDD & g = live[j];
+      ostringstream with;
+      with << which.str() << " and live " << j;
+      check(f * g == saved[i] * g, "f * g" + with.str());
+      check(g * f == g * saved[i], "g * f" + with.str());
+      check(g - f == g - saved[i], "g - f" + with.str());
+      check(f - g == saved[i] - g, "f - g" + with.str());
+      check(f + g == saved[i] + g, "f + g" + with.str());
+      check(g + f == g + saved[i], "g + f" + with.str());
+    }
+  }
+
+  // paths are found by value
+  vector<GDDD::val_t> values;
+  values.push_back(1);
+  values.push_back(5);
+  values.push_back(4);
+  check(store[0].contains(values), "stored DDD contains a path");
+  values[2] = 0;
+  check(! store[0].contains(values), "stored DDD does not contain a path");
+}
+
+static void test_corrupted (const string & path) {
+  vector<DDD> saved = sample();
+  FrozenDDD::save(path, saved);
+  string valid = read_file(path);
+  check(opens(path), "valid store opens");
+
+  string bad = valid;
+  bad[0] = 'X';
+  write_file(path, bad);
+  check(! opens(path), "store with a bad magic is rejected");
+
+  write_file(path, valid.substr(0, valid.size() - 1));
+  check(! opens(path), "truncated store is rejected");
+
+  write_file(path, "");
+  check(! opens(path), "empty store is rejected");
+
+  // the son of the first arc after the node itself
+  FrozenDDD::header_t h;
+  valid.copy(reinterpret_cast<char *> (&h), sizeof(h));
+  size_t arc = sizeof(h) + h.nb_nodes * sizeof(FrozenDDD::node_t);
+  FrozenDDD::arc_t a;
+  bad = valid;
+  bad.copy(reinterpret_cast<char *> (&a), sizeof(a), arc);
+  a.son = h.nb_nodes;
+  bad.replace(arc, sizeof(a), reinterpret_cast<const char *> (&a), sizeof(a));
+  write_file(path, bad);
+  check(! opens(path), "store with a forward son does not verify");
+
+  // a root past the last node
+  bad = valid;
+  uint32_t root = h.nb_nodes;
+  bad.replace(bad.size() - sizeof(root), sizeof(root), reinterpret_cast<const char *> (&root), sizeof(root));
+  write_file(path, bad);
+  check(! opens(path), "store with an invalid root does not verify");
+
+  // counts that wrap the size of the file around
+  bad = valid;
+  FrozenDDD::header_t wrap = h;
+  wrap.nb_arcs = ~uint64_t(0) / sizeof(FrozenDDD::arc_t) + 1;
+  bad.replace(0, sizeof(wrap), reinterpret_cast<const char *> (&wrap), sizeof(wrap));
+  write_file(path, bad);
+  check(! opens(path), "store with a wrapping arc count is rejected");
+
+  bad = valid;
+  wrap = h;
+  wrap.nb_roots = ~uint64_t(0) / sizeof(uint32_t) + 1;
+  bad.replace(0, sizeof(wrap), reinterpret_cast<const char *> (&wrap), sizeof(wrap));
+  write_file(path, bad);
+  check(! opens(path), "store with a wrapping root count is rejected");
+}
+
+int main () {
+  const string path = "tst21.store";
+  test_operations(path);
+  test_corrupted(path);
+  remove(path.c_str());
+  MemoryManager::garbage();
+  return report("FrozenDDD");
+}
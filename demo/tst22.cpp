@@ -0,0 +1,149 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the counts of DDD and SDD nodes : nbStates(), size() and noSharedSize() of deep DDD,
+/// that do not fit the call stack of a recursive count, and counts of DDD and SDD across
+/// garbage collections, that keep the counts of live nodes and forget those of dead ones,
+/// whose ids or addresses new nodes reuse.
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/SDD.h"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+static const int nbvar = 5;
+
+/// The number of paths of d, walking every path.
+static long double paths (const GDDD & d) {
+  if (d == GDDD::one)
+    return 1;
+  long double res = 0;
+  for (GDDD::const_iterator it = d.begin() ; it != d.end() ; ++it) {
+    res += paths(it->second);
+  }
+  return res;
+}
+
+/// The number of paths of s, walking every path, the DDD on arcs count their own paths.
+static long double paths (const GSDD & s) {
+  if (s == GSDD::one)
+    return 1;
+  long double res = 0;
+  for (GSDD::const_iterator it = s.begin() ; it != s.end() ; ++it) {
+    res += paths(static_cast<const DDD &> (*it->first)) * paths(it->second);
+  }
+  return res;
+}
+
+static GDDD random_ddd (int count) {
+  GDDD res = GDDD::null;
+  for (int i = 0 ; i < count ; ++i) {
+    GDDD p = GDDD::one;
+    for (int v = 0 ; v < nbvar ; ++v) {
+      p = GDDD(v, rand() % 4, p);
+    }
+    res = res + p;
+  }
+  return res;
+}
+
+static GSDD random_sdd (int count) {
+  GSDD res = GSDD::null;
+  for (int i = 0 ; i < count ; ++i) {
+    GSDD p = GSDD::one;
+    for (int v = 0 ; v < 3 ; ++v) {
+      p = GSDD(v, DDD(random_ddd(1 + rand() % 3)), p);
+    }
+    res = res + p;
+  }
+  return res;
+}
+
+/// A DDD over depth variables, with two values on each of the first wide ones : a single node
+/// per variable, and 2^wide paths.
+static GDDD deep (int depth, int wide) {
+  GDDD res = GDDD::one;
+  for (int v = 0 ; v < depth ; ++v) {
+    res = v < wide ? GDDD(v, 0, res) + GDDD(v, 1, res) : GDDD(v, 0, res);
+  }
+  return res;
+}
+
+static void test_deep () {
+  const int depth = 200000;
+  GDDD d = deep(depth, 40);
+  check(d.nbStates() == 1099511627776.0L, "nbStates of a deep DDD");
+  // the nodes and the terminal one
+  check(d.size() == (unsigned long) depth + 1, "size of a deep DDD");
+  check(d.noSharedSize() > 0, "noSharedSize of a deep DDD");
+  GSDD s = GSDD(1, DDD(d), GSDD(0, DDD(d)));
+  check(s.nbStates() == 1099511627776.0L * 1099511627776.0L, "nbStates of an SDD over deep DDD");
+}
+
+static void test_collections () {
+  srand(7);
+  vector<DDD> kept;
+  vector<long double> kept_states;
+  vector<unsigned long> kept_size;
+  vector<SDD> skept;
+  vector<long double> skept_states;
+  for (int round = 0 ; round < 20 ; ++round) {
+    ostringstream r;
+    r << " in round " << round;
+    // counted, then dropped : their nodes die and their ids are reused by the next rounds
+    for (int i = 0 ; i < 10 ; ++i) {
+      GDDD d = random_ddd(1 + rand() % 30);
+      check(d.nbStates() == paths(d), "nbStates of a new DDD" + r.str());
+      GSDD s = random_sdd(1 + rand() % 5);
+      check(s.nbStates() == paths(s), "nbStates of a new SDD" + r.str());
+    }
+    GDDD d = random_ddd(1 + rand() % 30);
+    kept.push_back(d);
+    kept_states.push_back(d.nbStates());
+    kept_size.push_back(d.size());
+    GSDD s = random_sdd(1 + rand() % 5);
+    skept.push_back(s);
+    skept_states.push_back(s.nbStates());
+
+    MemoryManager::garbage();
+    for (size_t i = 0 ; i < kept.size() ; ++i) {
+      check(kept[i].nbStates() == kept_states[i] && kept_states[i] == paths(kept[i]), "nbStates kept across collections" + r.str());
+      check(kept[i].size() == kept_size[i], "size kept across collections" + r.str());
+      check(skept[i].nbStates() == skept_states[i] && skept_states[i] == paths(skept[i]), "SDD nbStates kept across collections" + r.str());
+    }
+  }
+}
+
+int main () {
+  test_deep();
+  MemoryManager::garbage();
+  test_collections();
+  MemoryManager::garbage();
+  return report("node counts");
+}
@@ -0,0 +1,117 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the exact and logarithmic counts of states of DDD and SDD, on sets with more
+/// than 2^64 states, against the counts computed with long double.
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/SDD.h"
+#include "ddd/IntDataSet.h"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+static void check_count (const d3::bigcount & count, const string & expected, const string & what) {
+  if (count.str() != expected) {
+    cerr << "FAILED : " << what << " is " << count << ", expected " << expected << endl;
+    ++failures;
+  }
+}
+
+/// The logarithm matches the count, up to the precision of a double.
+static void check_log2 (double log2, long double count, const string & what) {
+  check(fabs(log2 - log2l(count)) < 1e-9 * log2l(count), what + " log2 matches nbStates");
+}
+
+/// nbvar variables numbered from 0, each with the values 0 to nbval - 1.
+static DDD product (int nbvar, int nbval) {
+  GDDD res = GDDD::one;
+  for (int v = 0 ; v < nbvar ; ++v) {
+    res = GDDD(v, 0, nbval - 1, res);
+  }
+  return res;
+}
+
+static void test_ddd () {
+  check_count(DDD(GDDD::null).exactNbStates(), "0", "null");
+  check_count(DDD(GDDD::one).exactNbStates(), "1", "one");
+
+  DDD d64 = product(64, 2);
+  check_count(d64.exactNbStates(), "18446744073709551616", "2^64 states");
+  check_log2(d64.log2NbStates(), d64.nbStates(), "2^64 states");
+  check(d64.log2NbStates() == 64, "2^64 states log2 is exact");
+
+  DDD d3 = product(70, 3);
+  check_count(d3.exactNbStates(), "2503155504993241601315571986085849", "3^70 states");
+  check_log2(d3.log2NbStates(), d3.nbStates(), "3^70 states");
+
+  // one more path, lost by a long double
+  DDD path = GDDD::one;
+  for (int v = 0 ; v < 70 ; ++v) {
+    path = DDD(v, 5, path);
+  }
+  DDD d3p = d3 + path;
+  check_count(d3p.exactNbStates(), "2503155504993241601315571986085850", "3^70 + 1 states");
+  check_log2(d3p.log2NbStates(), d3p.nbStates(), "3^70 + 1 states");
+
+  check_count(d3::bigcount::from(ldexpl(1, 100)), "1267650600228229401496703205376", "2^100 from long double");
+}
+
+static void test_sdd () {
+  // 9 states per variable, 30 variables
+  DDD inner = product(2, 3);
+  GSDD chain = GSDD::one;
+  for (int v = 0 ; v < 30 ; ++v) {
+    chain = GSDD(v, inner, chain);
+  }
+  SDD flat (chain);
+  check_count(flat.exactNbStates(), "42391158275216203514294433201", "9^30 SDD states");
+  check_log2(flat.log2NbStates(), flat.nbStates(), "9^30 SDD states");
+
+  // IntDataSet arcs, 7 and 1 values
+  vector<int> seven, ten;
+  for (int i = 0 ; i < 7 ; ++i) {
+    seven.push_back(i);
+  }
+  ten.push_back(10);
+  SDD ints = SDD(30, IntDataSet(seven), chain) + SDD(30, IntDataSet(ten), chain);
+  check_count(ints.exactNbStates(), "339129266201729628114355465608", "8 * 9^30 SDD states");
+  check_log2(ints.log2NbStates(), ints.nbStates(), "8 * 9^30 SDD states");
+
+  // SDD arcs
+  SDD nested = SDD(0, flat, SDD(1, flat, GSDD::one));
+  check_count(nested.exactNbStates(), "1797010299914431210413179829509605039731475627537851106401", "9^60 nested SDD states");
+  check_log2(nested.log2NbStates(), nested.nbStates(), "9^60 nested SDD states");
+}
+
+int main () {
+  test_ddd();
+  test_sdd();
+  MemoryManager::garbage();
+  return report("count");
+}
@@ -0,0 +1,134 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the triggers of garbage collection : MemoryManager::should_garbage() with the
+/// allocation threshold and with the sparse readings of the resident memory, and the policies
+/// that can be installed, on the states MemoryManager gives them.
+
+#include <string>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+/// Creates at least n DDD nodes.
+static DDD build (int n) {
+  GDDD res = GDDD::null;
+  for (int i = 0 ; i < n ; ++i) {
+    res = res + GDDD(1, i, GDDD(0, i));
+  }
+  return res;
+}
+
+static GCState state (size_t objects, size_t before, size_t after) {
+  GCState s;
+  s.objects = objects;
+  s.objects_before_gc = before;
+  s.objects_after_gc = after;
+  s.nb_gc = 1;
+  return s;
+}
+
+static void test_allocation () {
+  MemoryManager::setGCAllocationThreshold(1000);
+  MemoryManager::garbage();
+  check(! MemoryManager::should_garbage(), "no collection right after one");
+  DDD d = build(100);
+  check(! MemoryManager::should_garbage(), "no collection below the threshold");
+  DDD e = build(1000);
+  check(MemoryManager::should_garbage(), "collection above the threshold");
+  MemoryManager::garbage();
+  check(MemoryManager::nbObjects() >= 1000, "the DDD are alive");
+  check(! MemoryManager::should_garbage(), "the threshold counts from the objects alive after a collection");
+  MemoryManager::setGCAllocationThreshold(0);
+}
+
+static void test_sampling () {
+  // a threshold that is never reached
+  MemoryManager::setGCPolicy(new RssGrowthPolicy(1ul << 40));
+  MemoryManager::setGCSampling(10, 1000000);
+  MemoryManager::garbage();
+  size_t reads = MemoryManager::gcPolicy().rss_reads();
+  for (int i = 0 ; i < 100 ; ++i) {
+    check(! MemoryManager::should_garbage(), "no collection below the resident memory threshold");
+  }
+  check(MemoryManager::gcPolicy().rss_reads() == reads + 10, "resident memory read every 10 calls");
+
+  MemoryManager::setGCSampling(1000, 500);
+  reads = MemoryManager::gcPolicy().rss_reads();
+  MemoryManager::should_garbage();
+  check(MemoryManager::gcPolicy().rss_reads() == reads, "resident memory not read before the period");
+  DDD d = build(1000);
+  MemoryManager::should_garbage();
+  check(MemoryManager::gcPolicy().rss_reads() == reads + 1, "resident memory read once objects grew");
+
+  MemoryManager::setGCPolicy(new RssBudgetPolicy(1, 0));
+  MemoryManager::setGCSampling(1);
+  check(MemoryManager::should_garbage(), "collection above the resident memory budget");
+  check(MemoryManager::gcPolicy().rss_reads() == 1, "a new policy reads the resident memory");
+}
+
+static void test_adaptive () {
+  AdaptivePolicy p (100, 1, 0.25, 4);
+  check(! p.should_garbage(state(150, 0, 100)), "adaptive : below the minimum growth");
+  check(p.should_garbage(state(200, 0, 100)), "adaptive : growth by the ratio");
+  // most objects survived, the collection was mostly wasted
+  p.collected(state(1000, 1000, 900));
+  check(p.ratio() == 2, "adaptive : ratio doubles when most objects survive");
+  check(! p.should_garbage(state(2000, 1000, 900)) && p.should_garbage(state(2700, 1000, 900)), "adaptive : growth by the doubled ratio");
+  p.collected(state(1000, 1000, 900));
+  p.collected(state(1000, 1000, 900));
+  check(p.ratio() == 4, "adaptive : ratio bounded above");
+  // most objects died
+  p.collected(state(1000, 1000, 100));
+  check(p.ratio() == 2, "adaptive : ratio halves when most objects die");
+  p.collected(state(1000, 1000, 500));
+  check(p.ratio() == 2, "adaptive : ratio kept in between");
+  for (int i = 0 ; i < 4 ; ++i) {
+    p.collected(state(1000, 1000, 100));
+  }
+  check(p.ratio() == 0.25, "adaptive : ratio bounded below");
+
+  // through MemoryManager, collections feed the policy
+  AdaptivePolicy * q = new AdaptivePolicy (10, 1);
+  MemoryManager::setGCPolicy(q);
+  DDD d = build(100);
+  {
+    // most objects die
+    DDD dropped = build(5000);
+  }
+  MemoryManager::garbage();
+  check(q->ratio() == 0.5, "adaptive : MemoryManager reports collections");
+  check(MemoryManager::gcPolicy().rss_reads() == 0, "adaptive : resident memory is not read");
+  check(MemoryManager::snapshot().gc_policy == q->name(), "the policy is reported");
+}
+
+int main () {
+  test_allocation();
+  test_sampling();
+  test_adaptive();
+  MemoryManager::setGCPolicy(new RssGrowthPolicy());
+  MemoryManager::garbage();
+  return report("GC triggers");
+}
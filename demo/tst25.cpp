@@ -0,0 +1,88 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the partitions of Hom Add by variable : unions of homomorphisms over small, large and
+/// negative variables give the union of their images, also when an Add meets the same variable
+/// again and when several Add share operands.
+
+#include <climits>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/Hom.h"
+#include "ddd/Hom_Basic.hh"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+/// A DDD over the given variables, the first one at the top, with two values on each.
+static GDDD sample (const vector<int> & vars) {
+  GDDD res = GDDD::one;
+  for (size_t i = vars.size() ; i > 0 ; --i) {
+    res = GDDD(vars[i-1], 0, res) + GDDD(vars[i-1], 2, res);
+  }
+  return res;
+}
+
+int main () {
+  vector<int> vars;
+  vars.push_back(INT_MIN + 1);
+  vars.push_back(-70000);
+  vars.push_back(-1);
+  vars.push_back(0);
+  vars.push_back(255);
+  vars.push_back(256);
+  vars.push_back(16383);
+  vars.push_back(16384);
+  vars.push_back(1000000);
+  vars.push_back(INT_MAX);
+  GDDD d = sample(vars);
+
+  for (int round = 0 ; round < 2 ; ++round) {
+    d3::set<GHom>::type ops;
+    GDDD expected = GDDD::null;
+    for (size_t i = 0 ; i < vars.size() ; ++i) {
+      GHom inc = incVar(vars[i], 1 + round);
+      GHom set = setVarConst(vars[i], 7);
+      ops.insert(inc);
+      ops.insert(set);
+      expected = expected + inc(d) + set(d);
+    }
+    GHom add = GHom::add(ops);
+    ostringstream r;
+    r << " in round " << round;
+    check(add(d) == expected, "Add is the union of the images of its operands" + r.str());
+    // the partitions are now computed
+    check(add(d) == expected, "Add gives the same image again" + r.str());
+    check(add(GDDD::null) == GDDD::null, "Add of the empty set" + r.str());
+
+    // an Add whose operands skip the top variables
+    ops.insert(GHom::id);
+    check(GHom::add(ops)(d) == expected + d, "Add with the identity" + r.str());
+  }
+
+  MemoryManager::garbage();
+  return report("Hom Add");
+}
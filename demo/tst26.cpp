@@ -0,0 +1,138 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the n-ary union of DDD : DED::add of many overlapping operands, whose values are
+/// disjoint, equal or overlapping, is the node obtained by folding the binary +, and holds
+/// exactly the paths of the operands.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/DED.h"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+static const int nbvar = 4;
+static const int nbval = 6;
+
+typedef vector<int> path_t;
+typedef set<path_t> paths_t;
+
+/// Adds the paths of d, below the prefix p, to res.
+static void paths (const GDDD & d, path_t & p, paths_t & res) {
+  if (d == GDDD::one) {
+    res.insert(p);
+    return;
+  }
+  for (GDDD::const_iterator it = d.begin() ; it != d.end() ; ++it) {
+    p.push_back(it->first);
+    paths(it->second, p, res);
+    p.pop_back();
+  }
+}
+
+static paths_t paths (const GDDD & d) {
+  paths_t res;
+  path_t p;
+  paths(d, p, res);
+  return res;
+}
+
+/// A DDD of count random paths, whose value on the top variable is taken in top.
+static GDDD random_ddd (int count, const vector<int> & top) {
+  GDDD res = GDDD::null;
+  for (int i = 0 ; i < count ; ++i) {
+    GDDD p = GDDD::one;
+    for (int v = 0 ; v < nbvar - 1 ; ++v) {
+      p = GDDD(v, rand() % nbval, p);
+    }
+    res = res + GDDD(nbvar - 1, top[rand() % top.size()], p);
+  }
+  return res;
+}
+
+/// Checks both forms of the n-ary union against a fold of the binary + and against the paths.
+static void compare (const vector<GDDD> & ops, const string & what) {
+  GDDD folded = GDDD::null;
+  paths_t expected;
+  for (size_t i = 0 ; i < ops.size() ; ++i) {
+    folded = folded + ops[i];
+    paths_t p = paths(ops[i]);
+    expected.insert(p.begin(), p.end());
+  }
+  d3::set<GDDD>::type operands (ops.begin(), ops.end());
+  GDDD nary = DED::add(operands);
+  vector<GDDD> sorted (operands.begin(), operands.end());
+  check(nary == folded, "n-ary union is the folded union " + what);
+  check(DED::add(&sorted[0], &sorted[0] + sorted.size()) == nary, "union of a sorted array " + what);
+  check(paths(nary) == expected, "n-ary union holds the paths of the operands " + what);
+}
+
+static vector<int> range (int first, int last) {
+  vector<int> res;
+  for (int v = first ; v < last ; ++v) {
+    res.push_back(v);
+  }
+  return res;
+}
+
+int main () {
+  srand(42);
+  for (int round = 0 ; round < 300 ; ++round) {
+    int nbops = 3 + rand() % 14;
+    vector<GDDD> disjoint, equal, overlap;
+    for (int i = 0 ; i < nbops ; ++i) {
+      // the operands do not share a top value
+      disjoint.push_back(random_ddd(1 + rand() % 4, vector<int>(1, i)));
+      // the operands have the same top values, only their sons differ
+      equal.push_back(random_ddd(8, range(0, 2)));
+      // the operands share some top values
+      overlap.push_back(random_ddd(1 + rand() % 20, range(i % nbval, i % nbval + 3)));
+    }
+    // an operand that is the union of others, and one that is in the union twice
+    overlap.push_back(overlap[0] + overlap[1]);
+    overlap.push_back(overlap[2]);
+
+    ostringstream r;
+    r << "round " << round;
+    compare(disjoint, "of disjoint values, " + r.str());
+    compare(equal, "of equal values, " + r.str());
+    compare(overlap, "of overlapping values, " + r.str());
+    vector<GDDD> all (disjoint);
+    all.insert(all.end(), equal.begin(), equal.end());
+    all.insert(all.end(), overlap.begin(), overlap.end());
+    compare(all, "of all operands, " + r.str());
+    if (round % 100 == 99)
+      MemoryManager::garbage();
+  }
+
+  MemoryManager::garbage();
+  return report("DDD union");
+}
@@ -0,0 +1,203 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the square union of SDD : unions of multi-arc SDD whose IntDataSet labels are equal,
+/// contain one another or overlap, n-ary and folded two at a time, are the node built value by
+/// value, where the arcs of the values with the same successor are merged by square_union.
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/SDD.h"
+#include "ddd/SDED.h"
+#include "ddd/IntDataSet.h"
+#include "ddd/MemoryManager.h"
+
+#include "check.hh"
+
+/// the values of the labels of the top variable, and of the variable below
+static const int nbval = 8;
+static const int nbsucc = 5;
+
+/// An arc of an operand, as a label and the values of its successor.
+struct arc_t {
+  vector<int> label;
+  vector<int> succ;
+};
+typedef vector<arc_t> operand_t;
+
+/// The successor of an arc : the values of variable 0.
+static GSDD successor (const vector<int> & values) {
+  return GSDD(0, IntDataSet(values));
+}
+
+/// An operand on variable 1, its arcs have disjoint labels and distinct successors.
+static GSDD build (const operand_t & op) {
+  GSDD::Valuation value;
+  for (size_t i = 0 ; i < op.size() ; ++i) {
+    value.push_back(make_pair(new IntDataSet(op[i].label), successor(op[i].succ)));
+  }
+  return GSDD(1, value);
+}
+
+/// The union built value by value : each value of variable 1 leads to the union of the
+/// successors of the arcs that hold it, then square_union merges the values with the same successor.
+static GSDD expected (const vector<operand_t> & ops) {
+  map<GSDD,DataSet *> res;
+  for (int v = 0 ; v < nbval ; ++v) {
+    set<int> succ;
+    for (size_t i = 0 ; i < ops.size() ; ++i) {
+      for (size_t j = 0 ; j < ops[i].size() ; ++j) {
+	const arc_t & a = ops[i][j];
+	if (find(a.label.begin(), a.label.end(), v) != a.label.end()) {
+	  succ.insert(a.succ.begin(), a.succ.end());
+	}
+      }
+    }
+    if (! succ.empty()) {
+      IntDataSet value (vector<int>(1, v));
+      square_union(res, successor(vector<int>(succ.begin(), succ.end())), &value);
+    }
+  }
+  if (res.empty())
+    return GSDD::null;
+  GSDD::Valuation value;
+  for (map<GSDD,DataSet *>::const_iterator it = res.begin() ; it != res.end() ; ++it) {
+    value.push_back(make_pair(it->second, it->first));
+  }
+  return GSDD(1, value);
+}
+
+/// Checks the n-ary union and the union folded two at a time against expected().
+static void compare (const vector<operand_t> & ops, const string & what) {
+  d3::set<GSDD>::type operands;
+  GSDD folded = GSDD::null;
+  for (size_t i = 0 ; i < ops.size() ; ++i) {
+    GSDD g = build(ops[i]);
+    operands.insert(g);
+    folded = folded + g;
+  }
+  GSDD exp = expected(ops);
+  check(folded == exp, "union folded two at a time " + what);
+  if (operands.size() > 1) {
+    check(SDED::add(operands) == exp, "n-ary union " + what);
+  }
+}
+
+static arc_t arc (const vector<int> & label, const vector<int> & succ) {
+  arc_t a = { label, succ };
+  return a;
+}
+
+static vector<int> values (int a, int b = -1, int c = -1) {
+  vector<int> res (1, a);
+  if (b >= 0) res.push_back(b);
+  if (c >= 0) res.push_back(c);
+  return res;
+}
+
+/// An operand with at most 4 arcs, over random values of [0,nbval).
+static operand_t random_operand () {
+  int nbarcs = 1 + rand() % 4;
+  // distinct successors
+  set<vector<int> > succs;
+  while ((int) succs.size() < nbarcs) {
+    vector<int> s;
+    for (int v = 0 ; v < nbsucc ; ++v) {
+      if (rand() % 2)
+	s.push_back(v);
+    }
+    if (! s.empty())
+      succs.insert(s);
+  }
+  operand_t res;
+  for (set<vector<int> >::const_iterator it = succs.begin() ; it != succs.end() ; ++it) {
+    res.push_back(arc(vector<int>(), *it));
+  }
+  // each value is on one arc, or on none
+  for (int v = 0 ; v < nbval ; ++v) {
+    int a = rand() % (nbarcs + 1);
+    if (a < nbarcs)
+      res[a].label.push_back(v);
+  }
+  operand_t arcs;
+  for (size_t i = 0 ; i < res.size() ; ++i) {
+    if (! res[i].label.empty())
+      arcs.push_back(res[i]);
+  }
+  if (arcs.empty())
+    arcs.push_back(arc(values(rand() % nbval), *succs.begin()));
+  return arcs;
+}
+
+int main () {
+  srand(42);
+  vector<int> s1 = values(0), s2 = values(1), s3 = values(1, 2);
+
+  // the label of an arc equal to a label of the union so far
+  vector<operand_t> equal (2);
+  equal[0].push_back(arc(values(0, 1), s1));
+  equal[1].push_back(arc(values(0, 1), s2));
+  compare(equal, "of equal labels");
+
+  // the label of an arc containing a label of the union so far, and contained in one
+  vector<operand_t> contains (2);
+  contains[0].push_back(arc(values(0), s1));
+  contains[0].push_back(arc(values(3, 4, 5), s3));
+  contains[1].push_back(arc(values(0, 1, 2), s2));
+  contains[1].push_back(arc(values(4), s1));
+  compare(contains, "of labels containing one another");
+
+  // overlapping labels, that leave a remainder on both sides
+  vector<operand_t> overlap (2);
+  overlap[0].push_back(arc(values(0, 1), s1));
+  overlap[1].push_back(arc(values(1, 2), s2));
+  compare(overlap, "of overlapping labels");
+
+  // disjoint labels, merged by their common successor
+  vector<operand_t> disjoint (3);
+  disjoint[0].push_back(arc(values(0), s1));
+  disjoint[1].push_back(arc(values(1), s1));
+  disjoint[2].push_back(arc(values(2, 3), s2));
+  compare(disjoint, "of disjoint labels");
+
+  for (int round = 0 ; round < 500 ; ++round) {
+    vector<operand_t> ops (2 + rand() % 5);
+    for (size_t i = 0 ; i < ops.size() ; ++i) {
+      ops[i] = random_operand();
+    }
+    ostringstream what;
+    what << "of random operands, round " << round;
+    compare(ops, what.str());
+    if (round % 100 == 99)
+      MemoryManager::garbage();
+  }
+
+  MemoryManager::garbage();
+  return report("SDD union");
+}
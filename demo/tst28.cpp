@@ -0,0 +1,191 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the parallel evaluation : DDD and SDD fixpoints computed by several threads with a
+/// small grain are the very nodes computed by a single thread. Also when threads create nodes
+/// through their own buffers, across collections that free and reuse nodes.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/SDD.h"
+#include "ddd/Hom.h"
+#include "ddd/SHom.h"
+#include "ddd/Hom_Basic.hh"
+#include "ddd/MemoryManager.h"
+#include "ddd/Parallel.h"
+
+#include "check.hh"
+
+static const int nbvar = 8;
+static const int nbval = 4;
+static const int nbsdd = 4;
+
+/// A fixpoint that increments the variables of a DDD over [0,nbvar) one at a time, up to nbval - 1.
+static Hom reach () {
+  Hom next = GHom::id;
+  for (int v = 0 ; v < nbvar ; ++v) {
+    next = next + (incVar(v, 1) & varLtState(v, nbval - 1));
+  }
+  return fixpoint(next);
+}
+
+static DDD initial () {
+  GDDD res = GDDD::one;
+  for (int v = nbvar - 1 ; v >= 0 ; --v) {
+    res = GDDD(v, 0, res);
+  }
+  return res;
+}
+
+/// The same on nbsdd SDD variables, each holding a DDD over 3 variables.
+static Shom sreach () {
+  Shom next = GShom::id;
+  for (int s = 0 ; s < nbsdd ; ++s) {
+    for (int v = 0 ; v < 3 ; ++v) {
+      next = next + localApply(incVar(v, 1) & varLtState(v, nbval - 1), s);
+    }
+  }
+  return fixpoint(next);
+}
+
+static SDD sinitial () {
+  DDD d = DDD(2, 0, DDD(1, 0, DDD(0, 0)));
+  GSDD res = GSDD::one;
+  for (int s = 0 ; s < nbsdd ; ++s) {
+    res = GSDD(s, d, res);
+  }
+  return res;
+}
+
+/// A union of chains over every SDD variable, many nodes built by the calling thread. Built
+/// in reverse order, the nodes do not get back the addresses they had in a collected union.
+static SDD chains (bool reverse) {
+  GSDD res = GSDD::null;
+  for (int k = 0 ; k < 256 ; ++k) {
+    int i = reverse ? 255 - k : k;
+    GSDD c = GSDD::one;
+    for (int s = 0 ; s < nbsdd ; ++s) {
+      c = GSDD(s, DDD(0, (i >> (2 * s)) & 3, DDD(1, i % 7)), c);
+    }
+    res = res + c;
+  }
+  return res;
+}
+
+struct result_t {
+  DDD ddd;
+  SDD sdd;
+};
+
+static string bytes (const SDD & s) {
+  ostringstream os;
+  saveSDDBinary(os, vector<SDD>(1, s));
+  return os.str();
+}
+
+static DDD load_ddd (const string & b) {
+  vector<DDD> list;
+  istringstream is (b);
+  loadDDDBinary(is, list);
+  return list[0];
+}
+
+static SDD load_sdd (const string & b) {
+  vector<SDD> list;
+  istringstream is (b);
+  loadSDDBinary(is, list);
+  return list[0];
+}
+
+/// Computes both fixpoints, and checks they are the nodes of expected, and whether they forked.
+static result_t compute (const string & what, const result_t * expected, bool forks) {
+  size_t forked = d3::parallel::stats().forked;
+  result_t res = { reach()(initial()), sreach()(sinitial()) };
+  check(res.ddd.nbStates() == 65536, "DDD states " + what);
+  check(res.sdd.nbStates() == 16777216, "SDD states " + what);
+  if (expected != NULL) {
+    check(res.ddd == expected->ddd, "DDD fixpoint " + what);
+    check(res.sdd == expected->sdd, "SDD fixpoint " + what);
+  }
+  if (forks) {
+    check(d3::parallel::stats().forked > forked, "forked " + what);
+  } else {
+    check(d3::parallel::stats().forked == forked, "did not fork " + what);
+  }
+  return res;
+}
+
+int main () {
+  // the results are kept across collections, but not the cache entries that lead to them
+  MemoryManager::setCachePolicy(d3::FULL_CLEAR);
+
+  d3::parallel::set_threads(1);
+  result_t seq = compute("with one thread", NULL, false);
+  MemoryManager::garbage();
+
+  d3::parallel::set_threads(4);
+  d3::parallel::set_grain(4, false);
+  compute("with four workers", &seq, true);
+  MemoryManager::garbage();
+
+  // the node buffers of the threads must not survive the nodes a collection frees : each round
+  // builds nodes, collects them all, then builds them again, as the threads looked them up before
+  string dbytes = bytes(seq.ddd);
+  string sbytes = bytes(seq.sdd);
+  seq = result_t();
+  d3::parallel::set_threads(4);
+  d3::parallel::set_grain(4, false);
+  d3::parallel::set_node_buffers(true);
+  for (int round = 0 ; round < 8 ; ++round) {
+    ostringstream what;
+    what << " with node buffers, round " << round;
+    {
+      result_t dropped = compute("dropped" + what.str(), NULL, true);
+      check(bytes(dropped.ddd) == dbytes && bytes(dropped.sdd) == sbytes, "dropped fixpoints" + what.str());
+      chains(false);
+    }
+    MemoryManager::garbage();
+    result_t res = compute("rebuilt" + what.str(), NULL, true);
+    SDD chained = chains(true);
+    // the same nodes, created without buffers, are the ones in the unique tables
+    d3::parallel::set_node_buffers(false);
+    result_t loaded = { load_ddd(dbytes), load_sdd(sbytes) };
+    SDD unbuffered = chains(false);
+    d3::parallel::set_node_buffers(true);
+    check(res.ddd == loaded.ddd, "DDD fixpoint is canonical" + what.str());
+    check(res.sdd == loaded.sdd, "SDD fixpoint is canonical" + what.str());
+    check(chained == unbuffered, "SDD chains are canonical" + what.str());
+    res = result_t();
+    loaded = result_t();
+    chained = unbuffered = SDD();
+    MemoryManager::garbage();
+  }
+  check(d3::parallel::node_buffers(), "node buffers in use");
+
+  MemoryManager::garbage();
+  return report("parallel evaluation");
+}
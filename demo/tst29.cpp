@@ -0,0 +1,191 @@
+/****************************************************************************/
+/*								            */
+/* This file is part of libDDD, a library for manipulation of DDD and SDD.  */
+/*     						                            */
+/*     Copyright (C) 2001-2008 Yann Thierry-Mieg, Jean-Michel Couvreur      */
+/*                             and Denis Poitrenaud                         */
+/*     						                            */
+/*     This program is free software; you can redistribute it and/or modify */
+/*     it under the terms of the GNU Lesser General Public License as       */
+/*     published by the Free Software Foundation; either version 3 of the   */
+/*     License, or (at your option) any later version.                      */
+/*     This program is distributed in the hope that it will be useful,      */
+/*     but WITHOUT ANY WARRANTY; without even the implied warranty of       */
+/*     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the        */
+/*     GNU LEsserGeneral Public License for more details.                   */
+/*     						                            */
+/* You should have received a copy of the GNU Lesser General Public License */
+/*     along with this program; if not, write to the Free Software          */
+/*Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA */
+/*     						                            */
+/****************************************************************************/
+
+/// Checks the execution context : install() and set_threads() replace the workers, a context
+/// keeps its settings when only its thread count changes, the workers report what they ran
+/// since they were installed, and a thread pool of the host given as the executor of the
+/// context evaluates the same nodes as the workers of the library.
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#include "ddd/DDD.h"
+#include "ddd/Hom.h"
+#include "ddd/Hom_Basic.hh"
+#include "ddd/MemoryManager.h"
+#include "ddd/Parallel.h"
+
+#include "check.hh"
+
+static const int nbvar = 8;
+static const int nbval = 4;
+
+/// A fixpoint that increments the variables of a DDD over [0,nbvar) one at a time, up to nbval - 1.
+static DDD reach () {
+  Hom next = GHom::id;
+  GDDD init = GDDD::one;
+  for (int v = 0 ; v < nbvar ; ++v) {
+    next = next + (incVar(v, 1) & varLtState(v, nbval - 1));
+    init = GDDD(v, 0, init);
+  }
+  return fixpoint(next)(init);
+}
+
+/// The chunks run by the workers of the context since it was installed.
+static size_t chunks () {
+  vector<d3::parallel::worker_stats_t> workers = d3::parallel::worker_stats();
+  size_t res = 0;
+  for (size_t i = 0 ; i < workers.size() ; ++i) {
+    res += workers[i].chunks;
+  }
+  return res;
+}
+
+/// Computes the fixpoint from scratch, checks it is expected and whether it forked.
+static DDD compute (const string & what, const DDD * expected, bool forks) {
+  MemoryManager::garbage();
+  size_t forked = d3::parallel::stats().forked;
+  DDD res = reach();
+  check(res.nbStates() == 65536, "states " + what);
+  if (expected != NULL) {
+    check(res == *expected, "fixpoint " + what);
+  }
+  check((d3::parallel::stats().forked > forked) == forks, (forks ? "forked " : "did not fork ") + what);
+  return res;
+}
+
+/// A thread pool of the host application, for context::executor.
+class pool_t
+{
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<d3::parallel::job_t> jobs_;
+  std::vector<std::thread> threads_;
+  bool stop_;
+
+  void work () {
+    std::unique_lock<std::mutex> lock (mutex_);
+    while (true) {
+      wake_.wait(lock, [this] { return stop_ || ! jobs_.empty(); });
+      if (jobs_.empty())
+	return;
+      d3::parallel::job_t job = jobs_.front();
+      jobs_.pop_front();
+      lock.unlock();
+      job();
+      lock.lock();
+      ++ran;
+    }
+  }
+
+public:
+  size_t submitted;
+  size_t ran;
+
+  pool_t (unsigned n) : stop_(false), submitted(0), ran(0) {
+    for (unsigned i = 0 ; i < n ; ++i) {
+      threads_.push_back(std::thread(&pool_t::work, this));
+    }
+  }
+
+  ~pool_t () {
+    join();
+  }
+
+  /// Runs the jobs left and stops the threads.
+  void join () {
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (size_t i = 0 ; i < threads_.size() ; ++i) {
+      threads_[i].join();
+    }
+    threads_.clear();
+  }
+
+  void submit (const d3::parallel::job_t & job) {
+    {
+      std::lock_guard<std::mutex> lock (mutex_);
+      jobs_.push_back(job);
+      ++submitted;
+    }
+    wake_.notify_one();
+  }
+};
+
+int main () {
+  // the results are kept across collections, but not the cache entries that lead to them
+  MemoryManager::setCachePolicy(d3::FULL_CLEAR);
+
+  d3::parallel::install(d3::parallel::context(1));
+  check(d3::parallel::threads() == 1, "one thread installed");
+  DDD seq = compute("with one thread", NULL, false);
+
+  d3::parallel::context ctx (3);
+  ctx.stack_size = 16 << 20;
+  d3::parallel::install(ctx);
+  check(d3::parallel::threads() == 3 && d3::parallel::current().threads == 3, "three threads installed");
+  check(d3::parallel::worker_stats().size() == 3, "a worker entry per thread");
+  check(chunks() == 0, "new workers ran nothing");
+  d3::parallel::set_grain(4, false);
+  compute("with three workers", &seq, true);
+  check(chunks() > 0, "workers ran chunks");
+
+  // the thread count changes, the other settings stay
+  d3::parallel::set_threads(2);
+  check(d3::parallel::threads() == 2, "two threads set");
+  check(d3::parallel::current().stack_size == ctx.stack_size, "stack size kept by set_threads");
+  check(d3::parallel::worker_stats().size() == 2, "a worker entry per thread after set_threads");
+  check(chunks() == 0, "replaced workers ran nothing");
+  compute("with two workers", &seq, true);
+  check(chunks() > 0, "replaced workers ran chunks");
+
+  {
+    pool_t pool (3);
+    d3::parallel::context ctx (4);
+    ctx.executor = [&pool] (d3::parallel::job_t job) { pool.submit(job); };
+    d3::parallel::install(ctx);
+    d3::parallel::set_grain(4, false);
+    compute("on the executor", &seq, true);
+    MemoryManager::garbage();
+    // back to the workers of the library before the pool goes, late jobs return at once
+    d3::parallel::install(d3::parallel::context(1));
+    pool.join();
+    check(pool.submitted > 0, "jobs submitted to the executor");
+    check(pool.ran == pool.submitted, "executor ran every job");
+  }
+
+
+  d3::parallel::set_threads(1);
+  compute("with one thread again", &seq, false);
+
+  MemoryManager::garbage();
+  return report("execution context");
+}